@@ -0,0 +1,67 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Loads a large set of key-values much faster than WriteBatch, typically
+// into an empty cluster. The key-values are sorted by shard and key on the
+// client, and each node writes the ones of his shards straight into SST
+// files, which he ingests at the end. So they are written to the disk of
+// the node just once, without going through the WAL, the memtables and
+// the compactions.
+//
+// A key that is added more than once gets the last value added. Once
+// loaded, a key-value overrides any previous value of the key. The load is
+// atomic on each node, but not across nodes. If a shard moves to another
+// node during the load, Finish() fails and the load should be repeated.
+
+#ifndef CROCKS_BULK_LOADER_H
+#define CROCKS_BULK_LOADER_H
+
+#include <stddef.h>
+
+#include <string>
+
+#include <crocks/status.h>
+
+namespace crocks {
+
+class Cluster;
+
+class BulkLoader {
+ public:
+  // Up to memory bytes of key-values are kept in memory. Beyond that, they
+  // are sorted and written to temporary files in dir, and merged on Finish().
+  explicit BulkLoader(Cluster* db, size_t memory = 256 * 1024 * 1024,
+                      const std::string& dir = "/tmp");
+  ~BulkLoader();
+
+  void Add(const std::string& key, const std::string& value);
+
+  // Send the key-values to the nodes and wait until they are ingested.
+  // The loader is empty afterwards and can be used again.
+  Status Finish();
+
+ private:
+  class BulkLoaderImpl;
+  BulkLoaderImpl* const impl_;
+  // No copying allowed
+  BulkLoader(const BulkLoader&) = delete;
+  void operator=(const BulkLoader&) = delete;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_BULK_LOADER_H
@@ -18,6 +18,10 @@
 #ifndef CROCKS_CLUSTER_H
 #define CROCKS_CLUSTER_H
 
+#include <stdint.h>
+
+#include <functional>
+#include <future>
 #include <string>
 #include <unordered_map>
 
@@ -25,10 +29,39 @@
 
 namespace crocks {
 
+struct CallOptions;
 struct Options;
 class ClusterImpl;
 class Node;
 
+typedef std::function<void(const Status&)> Callback;
+typedef std::function<void(const Status&, const std::string&)> GetCallback;
+
+// Counters of the retries of failed requests, since the cluster was opened
+struct RetryStats {
+  // Retries made
+  uint64_t retries = 0;
+  // Time spent backing off before retrying, in microseconds
+  uint64_t backoff_micros = 0;
+  // Retries that waited longer than their backoff, to stay
+  // within the retry rate of the node (see Options::retry_rate)
+  uint64_t throttled = 0;
+  // Requests that failed after using up their retry budget
+  uint64_t exhausted = 0;
+};
+
+// Counters of the client cache (see Options::cache_size)
+struct CacheStats {
+  // Gets served from the cache
+  uint64_t hits = 0;
+  // Gets sent to the nodes, including those of invalidated entries
+  uint64_t misses = 0;
+  // Entries found stale or expired when looked up
+  uint64_t invalidations = 0;
+  // Entries dropped to make room for new ones
+  uint64_t evictions = 0;
+};
+
 class Cluster {
  public:
   explicit Cluster(const Options& options, const std::string& address);
@@ -41,8 +74,36 @@ class Cluster {
   Status SingleDelete(const std::string& key);
   Status Merge(const std::string& key, const std::string& value);
 
+  // Same as above, with options for this request only
+  Status Get(const CallOptions& options, const std::string& key,
+             std::string* value);
+  Status Put(const CallOptions& options, const std::string& key,
+             const std::string& value);
+  Status Delete(const CallOptions& options, const std::string& key);
+  Status SingleDelete(const CallOptions& options, const std::string& key);
+  Status Merge(const CallOptions& options, const std::string& key,
+               const std::string& value);
+
+  // Asynchronous versions of Get(), Put() and Delete(). The callback is
+  // run by one of the threads of the cluster that poll for completed
+  // requests (see Options::async_threads), so it should not block.
+  void GetAsync(const std::string& key, const GetCallback& callback);
+  void PutAsync(const std::string& key, const std::string& value,
+                const Callback& callback);
+  void DeleteAsync(const std::string& key, const Callback& callback);
+
+  // Same as above, but return a future instead. For GetAsync(),
+  // *value must not be destroyed before the future is ready.
+  std::future<Status> GetAsync(const std::string& key, std::string* value);
+  std::future<Status> PutAsync(const std::string& key,
+                               const std::string& value);
+  std::future<Status> DeleteAsync(const std::string& key);
+
   void WaitUntilHealthy();
 
+  RetryStats GetRetryStats() const;
+  CacheStats GetCacheStats() const;
+
   // Return a pointer to the underlying implementation. For internal use only.
   ClusterImpl* get() const {
     return impl_;
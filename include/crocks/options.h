@@ -18,6 +18,8 @@
 #ifndef CROCKS_OPTIONS_H
 #define CROCKS_OPTIONS_H
 
+#include <stddef.h>
+
 namespace crocks {
 
 struct Options {
@@ -28,6 +30,72 @@ struct Options {
   // If true, after a status UNAVAILABLE is received, the client waits
   // until the cluster is healthy again, and then retries the request.
   bool wait_on_unhealthy = true;
+
+  // Number of threads that poll for the completion of asynchronous
+  // requests and run their callbacks. They are started on the first
+  // asynchronous request.
+  int async_threads = 2;
+
+  // Number of connections to each node. Using more than one helps when
+  // many threads share the same cluster, as a single HTTP/2 connection
+  // limits the number of concurrent streams.
+  int channels_per_node = 1;
+
+  // If true, a background thread watches the cluster info in etcd, so that
+  // requests are routed to new nodes and new masters as soon as they change,
+  // instead of after a request fails.
+  bool watch_info = true;
+
+  // When a request fails because a node is unavailable or no longer holds
+  // the shard, the client waits for a random time between zero and
+  // retry_base_ms * 2^retries milliseconds, capped at retry_max_ms,
+  // before retrying it.
+  int retry_base_ms = 50;
+  int retry_max_ms = 2000;
+
+  // Number of times a single request is retried before giving up and
+  // returning the last status. Zero means that there is no limit. The
+  // time spent waiting for the cluster to become healthy does not count.
+  int retry_budget = 20;
+
+  // Retries sent to each node, by all threads together, are limited to
+  // retry_rate per second, with bursts of up to retry_burst.
+  double retry_rate = 10;
+  int retry_burst = 20;
+
+  // If true, when a Get has not been answered within the hedge_percentile
+  // of the latencies of recent Gets, a second request is sent for the same
+  // key over another channel (see channels_per_node), and the first answer
+  // is used. This cuts the tail latency caused by requests that are stuck
+  // behind slow ones, at the cost of 1 - hedge_percentile more requests.
+  // It needs at least two channels, so channels_per_node is raised to 2
+  // if it is lower.
+  bool hedged_reads = false;
+  double hedge_percentile = 0.95;
+
+  // Time in milliseconds after which a request fails with status
+  // DEADLINE_EXCEEDED, including its retries. The deadline is sent to the
+  // nodes, which drop requests that expire before they get to them. Zero
+  // means that there is no deadline. Can be overridden per request.
+  int timeout_ms = 0;
+
+  // Size in bytes of a cache of recently read values, which serves repeated
+  // Gets of the same keys without asking the nodes. Zero disables it. The
+  // cache forgets a shard when the client writes to it or when it moves to
+  // another node. Writes by other clients are noticed when the client next
+  // reads a newer value of the same shard, and in any case values are not
+  // served for longer than cache_ttl_ms after they were read.
+  size_t cache_size = 0;
+  int cache_ttl_ms = 1000;
+};
+
+// Options for a single request
+struct CallOptions {
+  // If greater than zero, overrides Options::timeout_ms
+  int timeout_ms = 0;
+
+  // If true, Get() asks the nodes even if the key is in the client cache
+  bool skip_cache = false;
 };
 
 }  // namespace crocks
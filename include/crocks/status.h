@@ -112,6 +112,10 @@ class Status {
     return grpc_code_ == grpc::StatusCode::UNAVAILABLE;
   }
 
+  bool IsBusy() const {
+    return rocksdb_code_ == rocksdb::StatusCode::BUSY;
+  }
+
  private:
   grpc::StatusCode grpc_code_;
   rocksdb::StatusCode rocksdb_code_;
@@ -0,0 +1,78 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+// Writes a stream of updates that is too long to be written atomically, e.g.
+// by an ingestion pipeline. The updates are streamed to the nodes like those
+// of a WriteBatch, but each node writes them as they arrive, in chunks of
+// about 64KB per node, instead of holding all of them until the commit. So
+// the memory of the nodes stays bounded and the write throughput is steady,
+// without a spike at the end.
+//
+// Every checkpoint_bytes of updates, and on Checkpoint(), the writer waits
+// until the nodes have written every update added so far, and advances
+// checkpoint(). If a checkpoint fails, some of the updates added after the
+// previous one may have been written and some not. A producer that then
+// adds again every update after the first checkpoint() ones gets each
+// update written at least once. Updates of the same key are written in the
+// order they were added.
+
+#ifndef CROCKS_STREAMING_WRITER_H
+#define CROCKS_STREAMING_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <crocks/status.h>
+
+namespace crocks {
+
+class Cluster;
+
+class StreamingWriter {
+ public:
+  explicit StreamingWriter(Cluster* db,
+                           size_t checkpoint_bytes = 64 * 1024 * 1024);
+  ~StreamingWriter();
+
+  // Once a checkpoint has failed, updates are dropped until Checkpoint()
+  // returns its status
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+  void SingleDelete(const std::string& key);
+  void Merge(const std::string& key, const std::string& value);
+
+  // Wait until every update added so far has been written, or return the
+  // status of the automatic checkpoint that failed, if any
+  Status Checkpoint();
+
+  // Number of updates added since the writer was created that are known to
+  // be written. Updates added after the last checkpoint may be written or
+  // not if the writer is destroyed.
+  uint64_t checkpoint() const;
+
+ private:
+  class StreamingWriterImpl;
+  StreamingWriterImpl* const impl_;
+  // No copying allowed
+  StreamingWriter(const StreamingWriter&) = delete;
+  void operator=(const StreamingWriter&) = delete;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_STREAMING_WRITER_H
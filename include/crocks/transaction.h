@@ -0,0 +1,70 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Optimistic transactions over any number of keys, in the spirit of
+// rocksdb::OptimisticTransaction. Reads go to the nodes right away and
+// remember what they read, while writes are buffered. Commit() checks, on
+// each node involved, that none of the keys read has changed since, and
+// applies the writes atomically with the check. If the keys of the
+// transaction are on more than one node, they are committed in two phases.
+//
+// Transactions do not block each other. A transaction that conflicts with
+// another one fails with status Busy, and may be retried from the start.
+// Writes made outside of transactions are not checked for conflicts.
+
+#ifndef CROCKS_TRANSACTION_H
+#define CROCKS_TRANSACTION_H
+
+#include <string>
+
+#include <crocks/status.h>
+
+namespace crocks {
+
+class Cluster;
+
+class Transaction {
+ public:
+  explicit Transaction(Cluster* db);
+  ~Transaction();
+
+  // Reads see the writes of the transaction
+  Status Get(const std::string& key, std::string* value);
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+
+  // Apply the writes, unless a key that was read has changed. Either way,
+  // the transaction is empty afterwards and can be used again. If a node
+  // could not be reached in time to commit its part of the transaction,
+  // which it then aborts, Commit() fails with Aborted and only the parts
+  // of the other nodes are applied.
+  Status Commit();
+
+  // Drop the reads and writes of the transaction
+  void Rollback();
+
+ private:
+  class TransactionImpl;
+  TransactionImpl* const impl_;
+  // No copying allowed
+  Transaction(const Transaction&) = delete;
+  void operator=(const Transaction&) = delete;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_TRANSACTION_H
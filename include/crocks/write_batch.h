@@ -42,27 +42,35 @@ class WriteBatch {
   explicit WriteBatch(Cluster* db, int threshold_low, int threshold_high);
   ~WriteBatch();
 
-  // Batch operations get inserted in a per-node buffer. Once the buffer exceeds
-  // a certain threshold (kByteSizeThreshold defined in src/client/node.h), it
-  // is sent asynchronously to the corresponding node. If there is a pending
-  // request for a previous buffer, to the same node, for which there is no
-  // response yet, the call blocks.
+  // Batch operations get inserted in a per-shard buffer. Once the buffers of
+  // the shards of a node exceed threshold_low bytes (64KB by default), they
+  // are handed off as a single message to a background thread of the batch,
+  // which streams it to the node. So the call only appends to memory, unless
+  // the messages waiting to be streamed exceed threshold_high bytes (4MB by
+  // default), in which case it blocks until enough of them have been sent.
   void Put(const std::string& key, const std::string& value);
   void Delete(const std::string& key);
   void SingleDelete(const std::string& key);
   void Merge(const std::string& key, const std::string& value);
   void Clear();
 
-  // Write() sends the remaining buffers (again waiting for any pending requests
-  // to be completed) followed by a commit request, simultaneously. Then, blocks
-  // waiting for every single server to respond.
+  // Write() sends the remaining buffers, waiting for the ones handed off
+  // before them, followed by a commit request to every node, simultaneously.
+  // Then, blocks waiting for every single server to respond. A batch that
+  // has not exceeded threshold_low and involves a single node is instead
+  // sent in one request, and written in a single round trip.
   Status Write();
 
-  // The same as Write, but wrap the request in a lock. This ensures that
-  // batches get committed in the same order at each node.
+  // The same as Write, but ensures that batches written this way get
+  // committed in the same order at each node. Before committing, the
+  // nodes agree on a timestamp for the batch, and each one applies such
+  // batches in timestamp order. This costs one more round trip to the
+  // nodes of the batch, but no global lock.
   Status WriteWithLock();
 
  private:
+  friend class StreamingWriter;
+  friend class WriteBatchWithIndex;
   class WriteBatchImpl;
   WriteBatchImpl* const impl_;
   // No copying allowed
@@ -0,0 +1,68 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+// A WriteBatch that also keeps an index of its updates, in the spirit of
+// rocksdb::WriteBatchWithIndex, so that the caller can read its own writes
+// before writing the batch. The updates are sent to the nodes as in a
+// (non-streaming) WriteBatch, so the nodes apply them atomically only on
+// Write(). The index keeps a copy of the last update of each key, grouped
+// by shard.
+
+#ifndef CROCKS_WRITE_BATCH_WITH_INDEX_H
+#define CROCKS_WRITE_BATCH_WITH_INDEX_H
+
+#include <string>
+
+#include <crocks/status.h>
+
+namespace crocks {
+
+class Cluster;
+
+class WriteBatchWithIndex {
+ public:
+  explicit WriteBatchWithIndex(Cluster* db);
+  ~WriteBatchWithIndex();
+
+  // The same as in WriteBatch
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+  void SingleDelete(const std::string& key);
+  void Merge(const std::string& key, const std::string& value);
+  void Clear();
+  Status Write();
+  Status WriteWithLock();
+
+  // Read the last update of key in the batch. Returns NotFound if the batch
+  // has no update of the key, or deletes it, and MergeInProgress if the
+  // last update is a merge, as there is no merge operator on the client.
+  Status GetFromBatch(const std::string& key, std::string* value);
+
+  // The same, but read the key from the cluster if the batch has no update
+  // of it, without a round trip otherwise
+  Status GetFromBatchAndCluster(const std::string& key, std::string* value);
+
+ private:
+  class WriteBatchWithIndexImpl;
+  WriteBatchWithIndexImpl* const impl_;
+  // No copying allowed
+  WriteBatchWithIndex(const WriteBatchWithIndex&) = delete;
+  void operator=(const WriteBatchWithIndex&) = delete;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_WRITE_BATCH_WITH_INDEX_H
@@ -0,0 +1,151 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/client/async_client.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "src/client/cluster_impl.h"
+#include "src/client/node.h"
+#include "src/common/util.h"
+
+namespace crocks {
+
+AsyncClient::AsyncClient(ClusterImpl* db, int num_threads)
+    : db_(db), shutdown_(false), next_(0) {
+  assert(num_threads > 0);
+  for (int i = 0; i < num_threads; i++)
+    cqs_.emplace_back(new grpc::CompletionQueue);
+  for (int i = 0; i < num_threads; i++)
+    threads_.emplace_back(std::thread(&AsyncClient::PollThread, this, i));
+}
+
+AsyncClient::~AsyncClient() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  // Next() keeps returning the pending events after Shutdown(),
+  // and returns false only once the queue has been drained.
+  for (auto& cq : cqs_)
+    cq->Shutdown();
+  for (auto& thread : threads_)
+    thread.join();
+}
+
+void AsyncClient::Start(AsyncCall* call) {
+  call->cq = cqs_[next_++ % cqs_.size()].get();
+  Send(call);
+}
+
+void AsyncClient::PollThread(int i) {
+  void* tag;
+  bool ok;
+  while (cqs_[i]->Next(&tag, &ok)) {
+    AsyncCall* call = static_cast<AsyncCall*>(tag);
+    if (call->backing_off) {
+      call->backing_off = false;
+      Resend(call);
+    } else {
+      Complete(call);
+    }
+  }
+}
+
+void AsyncClient::Send(AsyncCall* call) {
+  // The same deadline as in Ensure(). Requests that
+  // exceed it are retried on completion.
+  call->context.reset(new grpc::ClientContext);
+  call->context->set_deadline(std::min(
+      call->deadline,
+      std::chrono::system_clock::now() + std::chrono::seconds(1)));
+  call->response.Clear();
+  call->node = db_->NodeForKey(call->key);
+  Node* node = call->node.get();
+  if (node == nullptr) {
+    // The master is a node that we have not connected to yet. Complete the
+    // attempt as failed right away, so that it is retried after an update.
+    call->status =
+        grpc::Status(grpc::StatusCode::UNAVAILABLE, "No node for the key");
+    call->alarm.reset(
+        new grpc::Alarm(call->cq, std::chrono::system_clock::now(), call));
+    return;
+  }
+  pb::Key key_request;
+  pb::KeyValue request;
+  switch (call->op) {
+    case AsyncCall::GET:
+      key_request.set_key(call->key);
+      call->rpc = node->AsyncGet(call->context.get(), key_request, call->cq);
+      break;
+    case AsyncCall::PUT:
+      request.set_key(call->key);
+      request.set_value(call->value);
+      call->rpc = node->AsyncPut(call->context.get(), request, call->cq);
+      break;
+    case AsyncCall::DELETE:
+      key_request.set_key(call->key);
+      call->rpc = node->AsyncDelete(call->context.get(), key_request, call->cq);
+      break;
+  }
+  call->rpc->Finish(&call->response, &call->status, call);
+}
+
+void AsyncClient::Complete(AsyncCall* call) {
+  Status status(call->status, call->response.status());
+  // The shard may have moved or the node may have failed
+  if (status.IsUnavailable() ||
+      status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT ||
+      status.grpc_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+    if (std::chrono::system_clock::now() >= call->deadline) {
+      Finish(call, Status(grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                                       "Deadline exceeded")));
+      return;
+    }
+    std::chrono::microseconds delay;
+    if (db_->PrepareRetry(call, status, &delay)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!shutdown_) {
+        call->backing_off = true;
+        call->alarm.reset(new grpc::Alarm(
+            call->cq, std::chrono::system_clock::now() + delay, call));
+        return;
+      }
+    }
+  }
+  Finish(call, status);
+}
+
+void AsyncClient::Resend(AsyncCall* call) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (shutdown_) {
+    lock.unlock();
+    Finish(call, Status(call->status, call->response.status()));
+    return;
+  }
+  Send(call);
+}
+
+void AsyncClient::Finish(AsyncCall* call, const Status& status) {
+  call->callback(status, call->response.value());
+  delete call;
+}
+
+}  // namespace crocks
@@ -0,0 +1,104 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_ASYNC_CLIENT_H
+#define CROCKS_CLIENT_ASYNC_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpc++/alarm.h>
+#include <grpc++/grpc++.h>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include "gen/crocks.grpc.pb.h"
+
+namespace crocks {
+
+class ClusterImpl;
+class Node;
+
+// A single asynchronous request, used as its own completion queue tag
+struct AsyncCall {
+  enum Operation { GET, PUT, DELETE };
+  Operation op;
+  std::string key;
+  std::string value;
+  GetCallback callback;
+  std::chrono::system_clock::time_point deadline;
+  // The queue of the request, which its retries are sent on too
+  grpc::CompletionQueue* cq = nullptr;
+  std::shared_ptr<Node> node;
+  // A new one for every attempt, as contexts cannot be reused
+  std::unique_ptr<grpc::ClientContext> context;
+  grpc::Status status;
+  pb::Response response;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> rpc;
+  // The request is resent when the alarm goes off
+  std::unique_ptr<grpc::Alarm> alarm;
+  bool backing_off = false;
+  int retries = 0;
+  int hint_retries = 0;
+};
+
+// Sends asynchronous requests, and polls for their completion with a few
+// threads, each one with its own completion queue. The callback of each
+// request is run by the thread that polled it. Failed requests are resent
+// from the same queue after backing off, so the threads never sleep.
+class AsyncClient {
+ public:
+  AsyncClient(ClusterImpl* db, int num_threads);
+
+  // Wait for every pending request to complete and stop the threads
+  ~AsyncClient();
+
+  // Send the request and take ownership of the call
+  void Start(AsyncCall* call);
+
+ private:
+  void PollThread(int i);
+
+  // Send an attempt of the request to the current master of its key
+  void Send(AsyncCall* call);
+
+  // Retry a completed call that failed, or else finish it
+  void Complete(AsyncCall* call);
+
+  // Send the call again once its backoff is over
+  void Resend(AsyncCall* call);
+
+  // Run the callback of the call and delete it
+  void Finish(AsyncCall* call, const Status& status);
+
+  ClusterImpl* db_;
+  // Nothing may be added to the queues once they are shut down
+  std::mutex mutex_;
+  bool shutdown_;
+  std::vector<std::unique_ptr<grpc::CompletionQueue>> cqs_;
+  std::vector<std::thread> threads_;
+  std::atomic<unsigned int> next_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_ASYNC_CLIENT_H
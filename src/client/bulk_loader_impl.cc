@@ -0,0 +1,246 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#include "src/client/bulk_loader_impl.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <grpc++/grpc++.h>
+
+#include <crocks/cluster.h>
+#include "src/client/cluster_impl.h"
+#include "src/client/node.h"
+#include "src/common/run_file.h"
+#include "src/common/util.h"
+
+namespace crocks {
+
+namespace {
+
+// Approximate size of a LoadRequest message
+const size_t kMessageSize = 1024 * 1024;
+
+// Messages of a node that wait to be sent
+const size_t kMaxQueued = 4;
+
+// Memory used by an entry besides its key and value
+const size_t kEntryOverhead = 64;
+
+// The entries of a run have no type, but RunWriter needs one
+const char kTypePut = 0;
+
+}  // namespace
+
+// BulkLoaderImpl wrapper
+BulkLoader::BulkLoader(Cluster* db, size_t memory, const std::string& dir)
+    : impl_(new BulkLoaderImpl(db, memory, dir)) {}
+
+BulkLoader::~BulkLoader() {
+  delete impl_;
+}
+
+void BulkLoader::Add(const std::string& key, const std::string& value) {
+  impl_->Add(key, value);
+}
+
+Status BulkLoader::Finish() {
+  return impl_->Finish();
+}
+
+// NodeLoader
+NodeLoader::NodeLoader(std::shared_ptr<Node> node)
+    : node_(node),
+      writer_(node_->LoadStream(&context_, &response_)),
+      thread_(&NodeLoader::Send, this) {}
+
+void NodeLoader::Push(pb::LoadRequest* msg) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return queue_.size() < kMaxQueued; });
+  queue_.emplace_back();
+  queue_.back().Swap(msg);
+  lock.unlock();
+  cv_.notify_all();
+}
+
+Status NodeLoader::Finish(bool commit) {
+  if (commit) {
+    pb::LoadRequest msg;
+    msg.set_commit(true);
+    Push(&msg);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+  writer_->WritesDone();
+  grpc::Status status = writer_->Finish();
+  return Status(status, response_.status());
+}
+
+void NodeLoader::Send() {
+  bool ok = true;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return !queue_.empty() || done_; });
+    if (queue_.empty())
+      break;
+    pb::LoadRequest msg;
+    msg.Swap(&queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    cv_.notify_all();
+    // Once the stream is broken, the rest of the messages are dropped, and
+    // Finish() returns the status of the node
+    if (ok)
+      ok = writer_->Write(msg);
+    lock.lock();
+  }
+}
+
+// BulkLoader implementation
+BulkLoader::BulkLoaderImpl::BulkLoaderImpl(Cluster* db, size_t memory,
+                                           const std::string& dir)
+    : db_(db->get()),
+      memory_(memory),
+      prefix_(dir + "/crocks_load_" + std::to_string(RandomId())) {}
+
+BulkLoader::BulkLoaderImpl::~BulkLoaderImpl() {
+  Clear();
+}
+
+void BulkLoader::BulkLoaderImpl::Add(const std::string& key,
+                                     const std::string& value) {
+  entries_.push_back(Entry{db_->ShardForKey(key), key, value});
+  bytes_ += key.size() + value.size() + kEntryOverhead;
+  if (bytes_ > memory_ && !Spill())
+    failed_ = true;
+}
+
+Status BulkLoader::BulkLoaderImpl::Finish() {
+  if (!runs_.empty() && !Spill())
+    failed_ = true;
+  if (failed_) {
+    Clear();
+    return Status(rocksdb::IO_ERROR);
+  }
+
+  bool ok = true;
+  if (runs_.empty()) {
+    Sort();
+    for (const Entry& entry : entries_)
+      Send(entry.shard, entry.key, entry.value);
+  } else {
+    RunMerger merger(runs_);
+    for (; merger.Valid(); merger.Next()) {
+      const RunReader& record = merger.record();
+      Send(record.tag, record.key, record.value);
+    }
+    ok = merger.ok();
+  }
+  SendMessage();
+
+  // If a run could not be read, no node ingests anything
+  Status status = ok ? Status() : Status(rocksdb::IO_ERROR);
+  for (const auto& pair : loaders_) {
+    Status s = pair.second->Finish(ok);
+    if (status.ok() && !s.ok())
+      status = s;
+  }
+  Clear();
+  return status;
+}
+
+void BulkLoader::BulkLoaderImpl::Sort() {
+  std::stable_sort(entries_.begin(), entries_.end(),
+                   [](const Entry& a, const Entry& b) {
+                     return a.shard < b.shard ||
+                            (a.shard == b.shard && a.key < b.key);
+                   });
+  // Of the entries with the same key, keep the last one added
+  size_t n = 0;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (i + 1 < entries_.size() && entries_[i + 1].key == entries_[i].key)
+      continue;
+    if (n != i)
+      entries_[n] = std::move(entries_[i]);
+    n++;
+  }
+  entries_.resize(n);
+}
+
+bool BulkLoader::BulkLoaderImpl::Spill() {
+  Sort();
+  std::string filename = prefix_ + "_" + std::to_string(runs_.size());
+  runs_.push_back(filename);
+  RunWriter writer(filename);
+  for (const Entry& entry : entries_)
+    writer.Add(entry.shard, kTypePut, entry.key.data(), entry.key.size(),
+               entry.value.data(), entry.value.size());
+  entries_.clear();
+  bytes_ = 0;
+  return writer.Close();
+}
+
+void BulkLoader::BulkLoaderImpl::Send(int shard, const std::string& key,
+                                      const std::string& value) {
+  if (msg_.kvs_size() > 0 &&
+      (msg_.shard() != shard || msg_bytes_ >= kMessageSize))
+    SendMessage();
+  msg_.set_shard(shard);
+  msg_bytes_ += key.size() + value.size();
+  pb::KeyValue* kv = msg_.add_kvs();
+  kv->set_key(key);
+  kv->set_value(value);
+}
+
+void BulkLoader::BulkLoaderImpl::SendMessage() {
+  if (msg_.kvs_size() == 0)
+    return;
+  int shard = msg_.shard();
+  int idx = db_->IndexForShard(shard);
+  std::unique_ptr<NodeLoader>& loader = loaders_[idx];
+  if (loader == nullptr)
+    loader.reset(new NodeLoader(db_->NodeByIndex(idx)));
+  loader->Push(&msg_);
+  msg_.Clear();
+  msg_bytes_ = 0;
+  loaded_.insert(shard);
+}
+
+void BulkLoader::BulkLoaderImpl::Clear() {
+  for (const std::string& run : runs_)
+    remove(run.c_str());
+  runs_.clear();
+  entries_.clear();
+  bytes_ = 0;
+  failed_ = false;
+  msg_.Clear();
+  msg_bytes_ = 0;
+  loaders_.clear();
+  // The cached values of the loaded shards are stale
+  for (int shard : loaded_)
+    db_->FlushCache(shard);
+  loaded_.clear();
+}
+
+}  // namespace crocks
@@ -0,0 +1,117 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_BULK_LOADER_IMPL_H
+#define CROCKS_CLIENT_BULK_LOADER_IMPL_H
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include <crocks/bulk_loader.h>
+#include <crocks/status.h>
+#include "gen/crocks.pb.h"
+
+namespace crocks {
+
+class Cluster;
+class ClusterImpl;
+class Node;
+
+// Streams the key-values of the shards of a node, from a thread of its own,
+// so that the nodes are loaded in parallel
+class NodeLoader {
+ public:
+  explicit NodeLoader(std::shared_ptr<Node> node);
+
+  // Queue a message, blocking while too many are waiting to be sent
+  void Push(pb::LoadRequest* msg);
+
+  // Wait until every message has been sent. If commit is true, the node
+  // then ingests them, else he drops them.
+  Status Finish(bool commit);
+
+ private:
+  void Send();
+
+  std::shared_ptr<Node> node_;
+  grpc::ClientContext context_;
+  pb::Response response_;
+  std::unique_ptr<grpc::ClientWriter<pb::LoadRequest>> writer_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<pb::LoadRequest> queue_;
+  bool done_ = false;
+  std::thread thread_;
+};
+
+class BulkLoader::BulkLoaderImpl {
+ public:
+  BulkLoaderImpl(Cluster* db, size_t memory, const std::string& dir);
+  ~BulkLoaderImpl();
+
+  void Add(const std::string& key, const std::string& value);
+  Status Finish();
+
+ private:
+  struct Entry {
+    int shard;
+    std::string key;
+    std::string value;
+  };
+
+  // Sort the entries by shard and key, and drop those overridden by a
+  // later entry with the same key
+  void Sort();
+  // Sort the entries and write them to a new run
+  bool Spill();
+  // Add a key-value to the message of its shard, sending the message
+  // first if it is full or is for another shard
+  void Send(int shard, const std::string& key, const std::string& value);
+  void SendMessage();
+  void Clear();
+
+  ClusterImpl* db_;
+  size_t memory_;
+  // Prefix of the runs, unique to this loader
+  std::string prefix_;
+  std::vector<Entry> entries_;
+  size_t bytes_ = 0;
+  std::vector<std::string> runs_;
+  // Set if a run could not be written
+  bool failed_ = false;
+
+  // Used by Finish()
+  pb::LoadRequest msg_;
+  size_t msg_bytes_ = 0;
+  std::map<int, std::unique_ptr<NodeLoader>> loaders_;
+  std::set<int> loaded_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_BULK_LOADER_IMPL_H
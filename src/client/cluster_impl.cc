@@ -19,18 +19,38 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <utility>
 
 #include <grpc++/grpc++.h>
 
 #include <crocks/cluster.h>
+#include "src/client/async_client.h"
 #include "src/client/node.h"
 
 namespace crocks {
 
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+// Routing hints are followed at most kMaxHintRetries times in a row
+// before asking etcd. While a hint points to the node that sent it, we
+// back off starting from kHintBackoffMicros, doubling every time.
+const int kMaxHintRetries = 10;
+const int kHintBackoffMicros = 100;
+
+// A hedged Get must go over another connection than the slow one, or it
+// would only queue behind it, so hedging needs at least two channels
+Options WithHedging(Options options) {
+  if (options.hedged_reads)
+    options.channels_per_node = std::max(options.channels_per_node, 2);
+  return options;
+}
+
 Cluster::Cluster(const Options& options, const std::string& address)
     : impl_(new ClusterImpl(options, address)) {}
 
@@ -42,116 +62,405 @@ Cluster::~Cluster() {
 }
 
 Status Cluster::Get(const std::string& key, std::string* value) {
-  return impl_->Get(key, value);
+  return impl_->Get(CallOptions(), key, value);
 }
 
 Status Cluster::Put(const std::string& key, const std::string& value) {
-  return impl_->Put(key, value);
+  return impl_->Put(CallOptions(), key, value);
 }
 
 Status Cluster::Delete(const std::string& key) {
-  return impl_->Delete(key);
+  return impl_->Delete(CallOptions(), key);
 }
 
 Status Cluster::SingleDelete(const std::string& key) {
-  return impl_->SingleDelete(key);
+  return impl_->SingleDelete(CallOptions(), key);
 }
 
 Status Cluster::Merge(const std::string& key, const std::string& value) {
-  return impl_->Merge(key, value);
+  return impl_->Merge(CallOptions(), key, value);
+}
+
+Status Cluster::Get(const CallOptions& options, const std::string& key,
+                    std::string* value) {
+  return impl_->Get(options, key, value);
+}
+
+Status Cluster::Put(const CallOptions& options, const std::string& key,
+                    const std::string& value) {
+  return impl_->Put(options, key, value);
+}
+
+Status Cluster::Delete(const CallOptions& options, const std::string& key) {
+  return impl_->Delete(options, key);
+}
+
+Status Cluster::SingleDelete(const CallOptions& options,
+                             const std::string& key) {
+  return impl_->SingleDelete(options, key);
+}
+
+Status Cluster::Merge(const CallOptions& options, const std::string& key,
+                      const std::string& value) {
+  return impl_->Merge(options, key, value);
+}
+
+void Cluster::GetAsync(const std::string& key, const GetCallback& callback) {
+  impl_->GetAsync(key, callback);
+}
+
+void Cluster::PutAsync(const std::string& key, const std::string& value,
+                       const Callback& callback) {
+  impl_->PutAsync(key, value, callback);
+}
+
+void Cluster::DeleteAsync(const std::string& key, const Callback& callback) {
+  impl_->DeleteAsync(key, callback);
+}
+
+std::future<Status> Cluster::GetAsync(const std::string& key,
+                                      std::string* value) {
+  return impl_->GetAsync(key, value);
+}
+
+std::future<Status> Cluster::PutAsync(const std::string& key,
+                                      const std::string& value) {
+  return impl_->PutAsync(key, value);
+}
+
+std::future<Status> Cluster::DeleteAsync(const std::string& key) {
+  return impl_->DeleteAsync(key);
 }
 
 void Cluster::WaitUntilHealthy() {
   impl_->WaitUntilHealthy();
 }
 
+RetryStats Cluster::GetRetryStats() const {
+  return impl_->GetRetryStats();
+}
+
+CacheStats Cluster::GetCacheStats() const {
+  return impl_->GetCacheStats();
+}
+
 Cluster* DBOpen(const std::string& address) {
   return new Cluster(address);
 }
 
 // Cluster implementation
 ClusterImpl::ClusterImpl(const Options& options, const std::string& address)
-    : options_(options), info_(address) {
+    : options_(WithHedging(options)),
+      info_(address),
+      retry_(options),
+      get_latency_(options.hedge_percentile),
+      watch_info_(address) {
   info_.Get();
   info_.Run();
-  int id = 0;
+  auto routing = std::make_shared<Routing>();
+  routing->map = info_.map();
+  routing->revision = info_.revision();
+  routing->revisions.assign(routing->map.size(), info_.revision());
   for (const auto& address : info_.Addresses()) {
+    std::shared_ptr<Node> node;
     if (!address.empty())
-      nodes_[id] = new Node(address);
-    id++;
+      node = std::make_shared<Node>(address, options_.channels_per_node);
+    routing->nodes.push_back(node);
+  }
+  routing_ = routing;
+  if (options_.cache_size > 0)
+    cache_.reset(new NearCache(options_.cache_size,
+                               std::chrono::milliseconds(options_.cache_ttl_ms),
+                               routing->map.size()));
+
+  if (options_.watch_info) {
+    watch_call_ = watch_info_.Watch();
+    Publish(watch_info_);
+    watcher_ = std::thread(&ClusterImpl::WatchThread, this);
   }
 }
 
 ClusterImpl::~ClusterImpl() {
-  for (const auto& pair : nodes_)
-    delete pair.second;
+  // Wait for the pending asynchronous requests first
+  async_.reset();
+  if (watcher_.joinable()) {
+    watch_info_.WatchCancel(watch_call_);
+    watcher_.join();
+    watch_info_.WatchEnd(watch_call_);
+  }
+}
+
+Status ClusterImpl::Get(const CallOptions& options, const std::string& key,
+                        std::string* value) {
+  auto deadline = Deadline(options);
+  int shard = 0;
+  uint64_t generation = 0;
+  uint64_t version = 0;
+  if (cache_) {
+    shard = ShardForKey(key);
+    if (!options.skip_cache && cache_->Lookup(shard, key, value))
+      return Status();
+    generation = cache_->generation(shard);
+  }
+  Status status;
+  if (!options_.hedged_reads) {
+    auto op = std::bind(&Node::Get, _1, key, value, _2, deadline, &version);
+    status = Operation(op, key, deadline);
+  } else {
+    auto op = [&](Node* node, RoutingHint* hint) {
+      // Do not hedge before there is an estimate
+      std::chrono::microseconds delay = get_latency_.Percentile();
+      auto start = std::chrono::steady_clock::now();
+      Status status =
+          delay.count() > 0
+              ? node->HedgedGet(key, value, delay, hint, deadline, &version)
+              : node->Get(key, value, hint, deadline, &version);
+      if (status.ok() || status.IsNotFound())
+        get_latency_.Record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start));
+      return status;
+    };
+    status = Operation(op, key, deadline);
+  }
+  // Nodes that do not send versions return zero
+  if (cache_ && status.ok() && version > 0)
+    cache_->Insert(shard, key, *value, version, generation);
+  return status;
+}
+
+Status ClusterImpl::Put(const CallOptions& options, const std::string& key,
+                        const std::string& value) {
+  auto deadline = Deadline(options);
+  auto op = std::bind(&Node::Put, _1, key, value, _2, deadline);
+  Status status = Operation(op, key, deadline);
+  FlushCache(ShardForKey(key));
+  return status;
+}
+
+Status ClusterImpl::Delete(const CallOptions& options,
+                           const std::string& key) {
+  auto deadline = Deadline(options);
+  auto op = std::bind(&Node::Delete, _1, key, _2, deadline);
+  Status status = Operation(op, key, deadline);
+  FlushCache(ShardForKey(key));
+  return status;
+}
+
+Status ClusterImpl::SingleDelete(const CallOptions& options,
+                                 const std::string& key) {
+  auto deadline = Deadline(options);
+  auto op = std::bind(&Node::SingleDelete, _1, key, _2, deadline);
+  Status status = Operation(op, key, deadline);
+  FlushCache(ShardForKey(key));
+  return status;
+}
+
+Status ClusterImpl::Merge(const CallOptions& options, const std::string& key,
+                          const std::string& value) {
+  auto deadline = Deadline(options);
+  auto op = std::bind(&Node::Merge, _1, key, value, _2, deadline);
+  Status status = Operation(op, key, deadline);
+  FlushCache(ShardForKey(key));
+  return status;
+}
+
+void ClusterImpl::GetAsync(const std::string& key,
+                           const GetCallback& callback) {
+  AsyncCall* call = new AsyncCall;
+  call->op = AsyncCall::GET;
+  call->key = key;
+  call->deadline = Deadline(CallOptions());
+  call->callback = callback;
+  async_client()->Start(call);
 }
 
-Status ClusterImpl::Get(const std::string& key, std::string* value) {
-  auto op = std::bind(&Node::Get, std::placeholders::_1, key, value);
-  return Operation(op, key);
+void ClusterImpl::PutAsync(const std::string& key, const std::string& value,
+                           const Callback& callback) {
+  AsyncCall* call = new AsyncCall;
+  call->op = AsyncCall::PUT;
+  call->key = key;
+  call->deadline = Deadline(CallOptions());
+  call->value = value;
+  call->callback = [this, key, callback](const Status& status,
+                                         const std::string&) {
+    FlushCache(ShardForKey(key));
+    callback(status);
+  };
+  async_client()->Start(call);
 }
 
-Status ClusterImpl::Put(const std::string& key, const std::string& value) {
-  auto op = std::bind(&Node::Put, std::placeholders::_1, key, value);
-  return Operation(op, key);
+void ClusterImpl::DeleteAsync(const std::string& key,
+                              const Callback& callback) {
+  AsyncCall* call = new AsyncCall;
+  call->op = AsyncCall::DELETE;
+  call->key = key;
+  call->deadline = Deadline(CallOptions());
+  call->callback = [this, key, callback](const Status& status,
+                                         const std::string&) {
+    FlushCache(ShardForKey(key));
+    callback(status);
+  };
+  async_client()->Start(call);
 }
 
-Status ClusterImpl::Delete(const std::string& key) {
-  auto op = std::bind(&Node::Delete, std::placeholders::_1, key);
-  return Operation(op, key);
+std::future<Status> ClusterImpl::GetAsync(const std::string& key,
+                                          std::string* value) {
+  auto promise = std::make_shared<std::promise<Status>>();
+  GetAsync(key, [promise, value](const Status& status, const std::string& v) {
+    *value = v;
+    promise->set_value(status);
+  });
+  return promise->get_future();
 }
 
-Status ClusterImpl::SingleDelete(const std::string& key) {
-  auto op = std::bind(&Node::SingleDelete, std::placeholders::_1, key);
-  return Operation(op, key);
+std::future<Status> ClusterImpl::PutAsync(const std::string& key,
+                                          const std::string& value) {
+  auto promise = std::make_shared<std::promise<Status>>();
+  PutAsync(key, value,
+           [promise](const Status& status) { promise->set_value(status); });
+  return promise->get_future();
 }
 
-Status ClusterImpl::Merge(const std::string& key, const std::string& value) {
-  auto op = std::bind(&Node::Merge, std::placeholders::_1, key, value);
-  return Operation(op, key);
+std::future<Status> ClusterImpl::DeleteAsync(const std::string& key) {
+  auto promise = std::make_shared<std::promise<Status>>();
+  DeleteAsync(key,
+              [promise](const Status& status) { promise->set_value(status); });
+  return promise->get_future();
 }
 
 void ClusterImpl::WaitUntilHealthy() {
   info_.WaitUntilHealthy();
 }
 
+bool ClusterImpl::PrepareRetry(AsyncCall* call, const Status& status,
+                               std::chrono::microseconds* delay) {
+  if (status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT &&
+      call->hint_retries < kMaxHintRetries) {
+    RoutingHint hint;
+    GetRoutingHint(*call->context, &hint);
+    if (hint.valid()) {
+      ApplyHint(ShardForKey(call->key), hint);
+      if (NodeForKey(call->key) == call->node)
+        *delay = std::chrono::microseconds(kHintBackoffMicros
+                                           << call->hint_retries);
+      else
+        *delay = std::chrono::microseconds(0);
+      call->hint_retries++;
+      return true;
+    }
+  }
+  if (!retry_.Delay(IndexForKey(call->key), call->retries++, call->deadline,
+                    delay))
+    return false;
+  // Getting the info from etcd blocks the polling thread, but only briefly
+  if (status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT) {
+    call->hint_retries = 0;
+    Update();
+  } else if (status.IsUnavailable()) {
+    Update(call->node);
+  }
+  return true;
+}
+
+std::chrono::system_clock::time_point ClusterImpl::Deadline(
+    const CallOptions& options) const {
+  int timeout_ms =
+      options.timeout_ms > 0 ? options.timeout_ms : options_.timeout_ms;
+  if (timeout_ms <= 0)
+    return kNoDeadline;
+  return std::chrono::system_clock::now() +
+         std::chrono::milliseconds(timeout_ms);
+}
+
+RetryStats ClusterImpl::GetRetryStats() const {
+  return retry_.stats();
+}
+
+CacheStats ClusterImpl::GetCacheStats() const {
+  if (!cache_)
+    return CacheStats();
+  return cache_->stats();
+}
+
+void ClusterImpl::FlushCache(int shard) {
+  if (cache_)
+    cache_->Flush(shard);
+}
+
 int ClusterImpl::IndexForShard(int shard, bool update) {
   if (update)
     Update();
-  return info_.IndexForShard(shard);
+  return routing()->map[shard];
 }
 
 int ClusterImpl::ShardForKey(const std::string& key) {
-  return info_.ShardForKey(key);
+  return routing()->ShardForKey(key);
 }
 
 int ClusterImpl::IndexForKey(const std::string& key) {
-  return info_.IndexForKey(key);
+  return routing()->IndexForKey(key);
 }
 
-Node* ClusterImpl::NodeForKey(const std::string& key) {
-  int idx = info_.IndexForKey(key);
-  return nodes_[idx];
+std::shared_ptr<Node> ClusterImpl::NodeForKey(const std::string& key) {
+  return routing()->NodeForKey(key);
 }
 
-Node* ClusterImpl::NodeByIndex(int idx) {
-  return nodes_[idx];
+std::shared_ptr<Node> ClusterImpl::NodeByIndex(int idx) {
+  return routing()->nodes[idx];
 }
 
-Status ClusterImpl::Operation(const std::function<Status(Node*)>& op,
-                              const std::string& key) {
-  Status status = op(NodeForKey(key));
+Status ClusterImpl::Operation(
+    const std::function<Status(Node*, RoutingHint*)>& op,
+    const std::string& key, std::chrono::system_clock::time_point deadline) {
+  // Hold the node until the request is over, even if
+  // another thread replaces him in the meantime
+  std::shared_ptr<Node> node = NodeForKey(key);
+  RoutingHint hint;
+  // The master may be a node that has been removed, or one that we have
+  // only heard of from a hint. Then we need an update, as if he had failed.
+  const Status no_node(
+      grpc::Status(grpc::StatusCode::UNAVAILABLE, "No node for the key"));
+  auto run = [&]() {
+    return node == nullptr ? no_node : op(node.get(), &hint);
+  };
+  auto ping = [&]() { return node == nullptr ? no_node : node->Ping(); };
+  Status status = run();
+  int hint_retries = 0;
+  int retries = 0;
   while (status.IsUnavailable() ||
          (status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT)) {
+    if (std::chrono::system_clock::now() >= deadline)
+      return Status(grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                                 "Deadline exceeded"));
     int id = IndexForKey(key);
+    if (status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT &&
+        hint.valid() && hint_retries < kMaxHintRetries) {
+      // Retry right away if the hint points to another node. Else the node
+      // is still the master, but cannot serve the shard yet, e.g. while
+      // handing it over. This is brief, so back off just a little.
+      ApplyHint(ShardForKey(key), hint);
+      std::shared_ptr<Node> master = NodeForKey(key);
+      if (master == node)
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(kHintBackoffMicros << hint_retries));
+      hint_retries++;
+      node = master;
+      status = run();
+      continue;
+    }
     if (status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT) {
+      // The node did not send a hint, or we have been following hints for
+      // too long, so ask etcd. This is how it was done before hints.
       std::cerr << "Got status INVALID_ARGUMENT from node " << id << std::endl;
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      if (!retry_.Backoff(id, retries++, deadline))
+        return status;
       Update();
+      hint_retries = 0;
       std::cerr << "Retrying with the new master (node " << IndexForKey(key)
                 << ")... ";
-      status = op(NodeForKey(key));
+      node = NodeForKey(key);
+      status = run();
       std::cerr << "OK (status " << status.grpc_code() << ": "
                 << status.error_message() << ")" << std::endl;
       continue;
@@ -164,84 +473,151 @@ Status ClusterImpl::Operation(const std::function<Status(Node*)>& op,
     // In any case we close the current connection
     std::cerr << "Got status UNAVAILABLE from node " << id << std::endl;
 
-    if (status.error_message() == "The former master has crashed") {
-      std::cerr << "The former master has crashed" << std::endl;
+    if (!retry_.Backoff(id, retries++, deadline))
+      return status;
+    Update(node);
+    if (IndexForKey(key) != id) {
+      // Case 1. Retry with the new master
+      std::cerr << "He has shut down. Retrying with the new master (node "
+                << IndexForKey(key) << ")... ";
+      node = NodeForKey(key);
+      status = run();
+      std::cerr << "OK" << std::endl;
+      continue;
+    }
+    std::cerr << "Pinging node " << id << "..." << std::endl;
+    node = NodeForKey(key);
+    Status ping_status = ping();
+    if (ping_status.grpc_code() == grpc::StatusCode::OK) {
+      // Case 2. Do nothing, we'll just retry
+      std::cerr << "He is back online" << std::endl;
     } else {
-      delete nodes_[id];
-      nodes_[id] = nullptr;
-      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-      Update();
-      if (IndexForKey(key) != id) {
-        // Case 1. Retry with the new master
-        std::cerr << "He has shut down. Retrying with the new master (node "
-                  << IndexForKey(key) << ")... ";
-        status = op(NodeForKey(key));
-        std::cerr << "OK" << std::endl;
-        continue;
-      }
-      std::cerr << "Pinging node " << id << "..." << std::endl;
-      assert(IndexForKey(key) == id);
-      Status ping_status = NodeForKey(key)->Ping();
-      if (ping_status.grpc_code() == grpc::StatusCode::OK) {
-        // Case 2. Do nothing, we'll just retry
-        std::cerr << "He is back online" << std::endl;
-      } else {
-        // Case 3. Wait until the cluster is healthy again
-        // FIXME: It crashed once, cannot reproduce
-        if (!ping_status.IsUnavailable())
-          EnsureRpc(ping_status);
-        while (info_.IsHealthy() &&
-               (ping_status.grpc_code() != grpc::StatusCode::OK)) {
-          id = IndexForKey(key);
-          std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-          delete nodes_[id];
-          nodes_[id] = nullptr;
-          Update();
-          ping_status = NodeForKey(key)->Ping();
-          std::cerr << "He has crashed but etcd is not aware" << std::endl;
-          if (options_.inform_on_unavailable) {
-            std::cerr << "Informing etcd" << std::endl;
-            info_.SetAvailable(id, false);
-          }
+      // Case 3. Wait until the cluster is healthy again
+      // FIXME: It crashed once, cannot reproduce
+      if (!ping_status.IsUnavailable())
+        EnsureRpc(ping_status);
+      while (info_.IsHealthy() &&
+             (ping_status.grpc_code() != grpc::StatusCode::OK)) {
+        id = IndexForKey(key);
+        if (!retry_.Backoff(id, retries++, deadline))
+          return status;
+        Update(node);
+        node = NodeForKey(key);
+        ping_status = ping();
+        std::cerr << "He has crashed but etcd is not aware" << std::endl;
+        if (options_.inform_on_unavailable && node != nullptr) {
+          std::cerr << "Informing etcd" << std::endl;
+          info_.SetAvailable(id, false);
         }
       }
     }
 
     if (!info_.IsHealthy()) {
-      id = IndexForKey(key);
-      if (!options_.wait_on_unhealthy)
+      // There is no telling how long it will take
+      if (!options_.wait_on_unhealthy || deadline != kNoDeadline)
         return status;
       std::cerr << "Cluster is unhealthy. Waiting... ";
       info_.WaitUntilHealthy();
       std::cerr << "OK" << std::endl;
-      delete nodes_[id];
-      nodes_[id] = nullptr;
-      Update();
+      Update(node);
     }
 
     std::cerr << "Retrying with node " << IndexForKey(key) << "...";
-    status = op(NodeForKey(key));
+    node = NodeForKey(key);
+    status = run();
     std::cerr << "OK (status " << status.grpc_code() << ": "
               << status.error_message() << ")" << std::endl;
   }
   return status;
 }
 
-void ClusterImpl::Update() {
+void ClusterImpl::ApplyHint(int shard, const RoutingHint& hint) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
+  std::shared_ptr<const Routing> current = routing();
+  if (hint.revision <= current->revisions[shard])
+    return;
+  auto next = std::make_shared<Routing>(*current);
+  next->map[shard] = hint.master;
+  next->revisions[shard] = hint.revision;
+  // The master may be a node that we have not heard of yet
+  if (hint.master >= static_cast<int>(next->nodes.size()))
+    next->nodes.resize(hint.master + 1);
+  std::shared_ptr<Node>& node = next->nodes[hint.master];
+  if (node == nullptr || node->address() != hint.address)
+    node = std::make_shared<Node>(hint.address, options_.channels_per_node);
+  FlushMoved(*current, *next);
+  std::atomic_store(&routing_, std::shared_ptr<const Routing>(next));
+}
+
+void ClusterImpl::FlushMoved(const Routing& current, const Routing& next) {
+  if (!cache_)
+    return;
+  for (size_t i = 0; i < next.map.size(); i++)
+    if (i >= current.map.size() || current.map[i] != next.map[i])
+      cache_->Flush(i);
+}
+
+AsyncClient* ClusterImpl::async_client() {
+  std::call_once(async_once_, [this] {
+    async_.reset(new AsyncClient(this, options_.async_threads));
+  });
+  return async_.get();
+}
+
+void ClusterImpl::Update(const std::shared_ptr<Node>& failed) {
+  std::lock_guard<std::mutex> lock(update_mutex_);
   info_.Get();
+  Publish(info_, failed);
+}
+
+void ClusterImpl::WatchThread() {
+  while (!watch_info_.WatchNext(watch_call_)) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    Publish(watch_info_);
+  }
+}
+
+void ClusterImpl::Publish(const Info& info,
+                          const std::shared_ptr<Node>& failed) {
+  std::shared_ptr<const Routing> current = routing();
+  int revision = info.revision();
+  // Updates from the watch and from Update() may arrive out of order
+  if (revision < current->revision)
+    return;
+  auto next = std::make_shared<Routing>();
+  next->map = info.map();
+  next->revision = revision;
+  next->revisions.assign(next->map.size(), revision);
+  // Keep what we learned from hints that are more recent than the info
+  if (current->map.size() == next->map.size()) {
+    for (size_t i = 0; i < next->map.size(); i++) {
+      if (current->revisions[i] > revision) {
+        next->map[i] = current->map[i];
+        next->revisions[i] = current->revisions[i];
+      }
+    }
+  }
   int id = 0;
-  for (const auto& address : info_.Addresses()) {
+  for (const auto& address : info.Addresses()) {
+    std::shared_ptr<Node> node;
+    if (id < static_cast<int>(current->nodes.size()))
+      node = current->nodes[id];
     if (address.empty()) {
-      delete nodes_[id];
-      nodes_[id] = nullptr;
-    } else if (nodes_[id] == nullptr) {
+      node = nullptr;
+    } else if (node == nullptr || node == failed ||
+               node->address() != address) {
+      // Threads that still use the old connection keep it alive
       std::cerr << "New connection with node " << id << std::endl;
-      nodes_[id] = new Node(address);
-    } else {
-      assert(nodes_[id]->address() == address);
+      node = std::make_shared<Node>(address, options_.channels_per_node);
     }
+    next->nodes.push_back(node);
     id++;
   }
+  // Keep the nodes that we learned about from such hints
+  for (size_t i = next->nodes.size(); i < current->nodes.size(); i++)
+    next->nodes.push_back(current->nodes[i]);
+  FlushMoved(*current, *next);
+  std::atomic_store(&routing_, std::shared_ptr<const Routing>(next));
 }
 
 }  // namespace crocks
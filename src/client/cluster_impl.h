@@ -18,47 +18,121 @@
 #ifndef CROCKS_CLIENT_CLUSTER_IMPL_H
 #define CROCKS_CLIENT_CLUSTER_IMPL_H
 
+#include <chrono>
 #include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <vector>
 
+#include <crocks/cluster.h>
 #include <crocks/options.h>
 #include <crocks/status.h>
+#include "src/client/latency_tracker.h"
+#include "src/client/near_cache.h"
+#include "src/client/retry_policy.h"
+#include "src/common/hash.h"
 #include "src/common/info.h"
+#include "src/common/routing_hint.h"
 
 namespace crocks {
 
+class AsyncClient;
+struct AsyncCall;
 class Node;
 
+// An immutable view of the cluster, used to route requests. It is never
+// modified once published; ClusterImpl::Update() builds a new one and swaps
+// it in atomically. A thread that holds it keeps its nodes alive, even if
+// they have been replaced in the meantime.
+struct Routing {
+  int ShardForKey(const std::string& key) const {
+    return Hash(key) % map.size();
+  }
+
+  int IndexForKey(const std::string& key) const {
+    return map[ShardForKey(key)];
+  }
+
+  std::shared_ptr<Node> NodeForKey(const std::string& key) const {
+    return nodes[IndexForKey(key)];
+  }
+
+  // The etcd revision of the cluster info that the snapshot was built from
+  int revision = 0;
+  // The id of the node that holds each shard
+  std::vector<int> map;
+  // The etcd revision of the cluster info that each entry of map comes from
+  std::vector<int> revisions;
+  // Indexed by node id, nullptr for removed nodes
+  std::vector<std::shared_ptr<Node>> nodes;
+};
+
 class ClusterImpl {
  public:
   ClusterImpl(const Options&, const std::string& address);
   ~ClusterImpl();
 
-  Status Get(const std::string& key, std::string* value);
-  Status Put(const std::string& key, const std::string& value);
-  Status Delete(const std::string& key);
-  Status SingleDelete(const std::string& key);
-  Status Merge(const std::string& key, const std::string& value);
+  Status Get(const CallOptions& options, const std::string& key,
+             std::string* value);
+  Status Put(const CallOptions& options, const std::string& key,
+             const std::string& value);
+  Status Delete(const CallOptions& options, const std::string& key);
+  Status SingleDelete(const CallOptions& options, const std::string& key);
+  Status Merge(const CallOptions& options, const std::string& key,
+               const std::string& value);
+
+  void GetAsync(const std::string& key, const GetCallback& callback);
+  void PutAsync(const std::string& key, const std::string& value,
+                const Callback& callback);
+  void DeleteAsync(const std::string& key, const Callback& callback);
+
+  std::future<Status> GetAsync(const std::string& key, std::string* value);
+  std::future<Status> PutAsync(const std::string& key,
+                               const std::string& value);
+  std::future<Status> DeleteAsync(const std::string& key);
 
   void WaitUntilHealthy();
 
+  // Prepare the retry of an asynchronous request that failed with the given
+  // status, and return how long to back off before resending it, or false
+  // if it must not be retried. Like Operation(), it follows routing hints
+  // and refreshes the routing, but it never pings nodes or waits for the
+  // cluster to become healthy.
+  bool PrepareRetry(AsyncCall* call, const Status& status,
+                    std::chrono::microseconds* delay);
+
+  RetryStats GetRetryStats() const;
+  CacheStats GetCacheStats() const;
+
+  // Invalidate the cached values of the shard, after writing to it
+  void FlushCache(int shard);
+
+  // Get the cluster info from etcd and publish a new routing snapshot, e.g.
+  // after a node rejected a request because it no longer has the shard
+  void Refresh() {
+    Update();
+  }
+
   int IndexForShard(int shard, bool update = false);
   int ShardForKey(const std::string& key);
   int IndexForKey(const std::string& key);
-  Node* NodeForKey(const std::string& key);
-  Node* NodeByIndex(int idx);
+  std::shared_ptr<Node> NodeForKey(const std::string& key);
+  std::shared_ptr<Node> NodeByIndex(int idx);
 
   int num_nodes() const {
     return info_.num_nodes();
   }
 
   int num_shards() const {
-    return info_.num_shards();
+    return routing()->map.size();
   }
 
-  std::unordered_map<int, Node*> nodes() const {
-    return nodes_;
+  // Return the current routing snapshot. No locks are taken.
+  std::shared_ptr<const Routing> routing() const {
+    return std::atomic_load(&routing_);
   }
 
   void Lock() {
@@ -70,12 +144,55 @@ class ClusterImpl {
   }
 
  private:
-  Status Operation(const std::function<Status(Node*)>&, const std::string& key);
-  void Update();
+  // Run op on the master of the key, and retry it until it succeeds, its
+  // retry budget is used up, or the deadline passes. In the last case, the
+  // status is DEADLINE_EXCEEDED.
+  Status Operation(const std::function<Status(Node*, RoutingHint*)>& op,
+                   const std::string& key,
+                   std::chrono::system_clock::time_point deadline);
+
+  // Return the deadline of a request with the given options
+  std::chrono::system_clock::time_point Deadline(
+      const CallOptions& options) const;
+  // Get the cluster info from etcd and publish a new routing snapshot. If
+  // the failed node is still in use, his connection is replaced by a new one.
+  void Update(const std::shared_ptr<Node>& failed = nullptr);
+
+  // Keep the routing snapshot up to date with the cluster info in etcd
+  void WatchThread();
+
+  // Build a routing snapshot from the given info and swap it in, unless it
+  // is older than the current one. Connect to new nodes and to the failed
+  // one, and reuse the rest of the connections. Requires update_mutex_.
+  void Publish(const Info& info, const std::shared_ptr<Node>& failed = nullptr);
+
+  // Invalidate the cached values of the shards that have moved to
+  // another node between the two snapshots
+  void FlushMoved(const Routing& current, const Routing& next);
+
+  // Route the shard as told by the hint of a node that rejected a
+  // request for it, if the hint is more recent than what we know.
+  void ApplyHint(int shard, const RoutingHint& hint);
+
+  // Return the asynchronous client, and create it on first use
+  AsyncClient* async_client();
 
   const Options options_;
   Info info_;
-  std::unordered_map<int, Node*> nodes_;
+  RetryPolicy retry_;
+  // Latencies of Gets, to decide when to hedge them
+  LatencyTracker get_latency_;
+  // Null if Options::cache_size is zero
+  std::unique_ptr<NearCache> cache_;
+  std::shared_ptr<const Routing> routing_;
+  // Serializes updates. Readers never take it.
+  std::mutex update_mutex_;
+  // Used only by the watch thread, which blocks while waiting for updates
+  Info watch_info_;
+  void* watch_call_ = nullptr;
+  std::thread watcher_;
+  std::once_flag async_once_;
+  std::unique_ptr<AsyncClient> async_;
 };
 
 }  // namespace crocks
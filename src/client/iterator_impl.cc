@@ -71,9 +71,11 @@ Status Iterator::status() const {
 }
 
 // Iterator implementation
-Iterator::IteratorImpl::IteratorImpl(Cluster* db) : db_(db->get()) {
-  for (const auto& pair : db_->nodes())
-    iters_.push_back(new NodeIterator(pair.second, &cq_));
+Iterator::IteratorImpl::IteratorImpl(Cluster* db)
+    : db_(db->get()), routing_(db_->routing()) {
+  for (const auto& node : routing_->nodes)
+    if (node != nullptr)
+      iters_.push_back(new NodeIterator(node.get(), &cq_));
 }
 
 Iterator::IteratorImpl::~IteratorImpl() {
@@ -186,18 +188,15 @@ void Iterator::IteratorImpl::Next() {
   // key, to make the servers send the next key-values.
   if (!forward_)
     Seek(key());
-  // Pop the node iterator with the smallest key, and push it again after
-  // calling Next() on it, to assure that the heap properties are maintained.
-  // TODO: This requires at least logN comparisons for each of the two
-  // operations even if it belongs to the top. We could achieve just logN for
-  // the whole thing and only 1 or 2 comparisons if no rearrangement is actually
-  // needed, with a custom priority queue implementation. Some things could
-  // be copied from the rocksdb heap implementation in rocksdb/util/heap.h.
+  // Advance the node iterator with the smallest key, and sift it down to
+  // where its next key belongs, which takes only two comparisons if it
+  // still has the smallest key.
   assert(current_ == min_heap_.top());
-  min_heap_.pop();
   current_->Next();
   if (current_->Valid())
-    min_heap_.push(current_);
+    min_heap_.replace_top(current_);
+  else
+    min_heap_.pop();
   current_ = min_heap_.top();
 }
 
@@ -206,10 +205,11 @@ void Iterator::IteratorImpl::Prev() {
   if (forward_)
     SeekForPrev(key());
   assert(current_ == max_heap_.top());
-  max_heap_.pop();
   current_->Prev();
   if (current_->Valid())
-    max_heap_.push(current_);
+    max_heap_.replace_top(current_);
+  else
+    max_heap_.pop();
   current_ = max_heap_.top();
 }
 
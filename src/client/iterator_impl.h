@@ -20,6 +20,7 @@
 
 #include <assert.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -51,6 +52,7 @@ typedef Heap<NodeIterator, NodeIteratorLess> MaxHeap;
 
 class Cluster;
 class ClusterImpl;
+struct Routing;
 
 class Iterator::IteratorImpl {
  public:
@@ -92,6 +94,8 @@ class Iterator::IteratorImpl {
   void ClearHeaps();
 
   ClusterImpl* db_;
+  // Keeps the nodes alive for as long as the iterator exists
+  std::shared_ptr<const Routing> routing_;
   grpc::CompletionQueue cq_;
 
   // iters_ keeps at all times a NodeIterator* for each node in the cluster
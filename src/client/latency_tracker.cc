@@ -0,0 +1,69 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/client/latency_tracker.h"
+
+#include <assert.h>
+#include <math.h>
+
+namespace crocks {
+
+namespace {
+
+// Bucket b holds latencies up to 2^((b + 1) / 4) microseconds
+int Bucket(int64_t micros, int num_buckets) {
+  int bucket = static_cast<int>(4 * log2(micros + 1));
+  return bucket < num_buckets ? bucket : num_buckets - 1;
+}
+
+int64_t UpperBound(int bucket) {
+  return static_cast<int64_t>(ceil(exp2((bucket + 1) / 4.0)));
+}
+
+}  // namespace
+
+LatencyTracker::LatencyTracker(double percentile)
+    : percentile_(percentile), count_(0), estimate_(0) {
+  assert(percentile > 0 && percentile <= 1);
+  for (auto& bucket : buckets_)
+    bucket = 0;
+}
+
+void LatencyTracker::Record(std::chrono::microseconds latency) {
+  buckets_[Bucket(latency.count(), kBuckets)]++;
+  // Only the thread that records the last sample of the window updates the
+  // estimate. Samples recorded while it does so may be lost, which is fine.
+  if (++count_ != kWindow)
+    return;
+  uint64_t total = 0;
+  for (const auto& bucket : buckets_)
+    total += bucket;
+  uint64_t target = static_cast<uint64_t>(ceil(total * percentile_));
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets_[i];
+    if (seen >= target) {
+      estimate_ = UpperBound(i);
+      break;
+    }
+  }
+  for (auto& bucket : buckets_)
+    bucket = 0;
+  count_ = 0;
+}
+
+}  // namespace crocks
@@ -0,0 +1,55 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_LATENCY_TRACKER_H
+#define CROCKS_CLIENT_LATENCY_TRACKER_H
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace crocks {
+
+// Estimates a percentile of recent latencies, without taking locks. The
+// latencies are counted in a histogram with four buckets per power of two,
+// and every kWindow samples the estimate is updated and the histogram reset.
+class LatencyTracker {
+ public:
+  explicit LatencyTracker(double percentile);
+
+  void Record(std::chrono::microseconds latency);
+
+  // Return the estimate, or zero if there have not been enough samples yet
+  std::chrono::microseconds Percentile() const {
+    return std::chrono::microseconds(estimate_.load());
+  }
+
+ private:
+  static const int kBuckets = 4 * 32;
+  static const int kWindow = 1000;
+
+  const double percentile_;
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_;
+  std::atomic<uint64_t> count_;
+  std::atomic<int64_t> estimate_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_LATENCY_TRACKER_H
@@ -0,0 +1,139 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/client/near_cache.h"
+
+#include <functional>
+#include <iterator>
+
+namespace crocks {
+
+namespace {
+
+// Rough memory overhead of an entry, besides its key and value
+const size_t kEntryOverhead = 128;
+
+size_t EntrySize(const std::string& key, const std::string& value) {
+  return key.size() + value.size() + kEntryOverhead;
+}
+
+}  // namespace
+
+NearCache::NearCache(size_t capacity, std::chrono::milliseconds ttl,
+                     int num_shards)
+    : capacity_(capacity / kPartitions),
+      ttl_(ttl),
+      generations_(new std::atomic<uint64_t>[num_shards]),
+      versions_(new std::atomic<uint64_t>[num_shards]),
+      hits_(0),
+      misses_(0),
+      invalidations_(0),
+      evictions_(0) {
+  for (int i = 0; i < num_shards; i++) {
+    generations_[i] = 0;
+    versions_[i] = 0;
+  }
+}
+
+bool NearCache::Lookup(int shard, const std::string& key,
+                       std::string* value) {
+  Partition* p = partition(key);
+  std::lock_guard<std::mutex> lock(p->mutex);
+  auto it = p->index.find(key);
+  if (it == p->index.end()) {
+    misses_++;
+    return false;
+  }
+  if (it->second->shard != shard || !Valid(*it->second)) {
+    Erase(p, it->second);
+    invalidations_++;
+    misses_++;
+    return false;
+  }
+  p->lru.splice(p->lru.begin(), p->lru, it->second);
+  *value = it->second->value;
+  hits_++;
+  return true;
+}
+
+void NearCache::Insert(int shard, const std::string& key,
+                       const std::string& value, uint64_t version,
+                       uint64_t generation) {
+  // A newer version means that the shard has changed, so the entries
+  // that were read before it are stale
+  uint64_t newest = versions_[shard].load();
+  while (version > newest &&
+         !versions_[shard].compare_exchange_weak(newest, version)) {
+  }
+  size_t size = EntrySize(key, value);
+  if (size > capacity_ || generation != generations_[shard].load() ||
+      version < versions_[shard].load())
+    return;
+
+  Partition* p = partition(key);
+  std::lock_guard<std::mutex> lock(p->mutex);
+  auto it = p->index.find(key);
+  if (it != p->index.end())
+    Erase(p, it->second);
+  auto expires = std::chrono::steady_clock::now() + ttl_;
+  p->lru.push_front(Entry{key, value, shard, version, generation, expires});
+  p->index[key] = p->lru.begin();
+  p->size += size;
+  while (p->size > capacity_) {
+    Erase(p, std::prev(p->lru.end()));
+    evictions_++;
+  }
+}
+
+void NearCache::Flush(int shard) {
+  // Entries are dropped lazily, when they are looked up or evicted. The
+  // versions seen so far are forgotten too, as the shard may have moved
+  // to a node where they are different. Values read before the flush
+  // cannot be inserted, as their generation is older.
+  generations_[shard]++;
+  versions_[shard] = 0;
+}
+
+CacheStats NearCache::stats() const {
+  CacheStats stats;
+  stats.hits = hits_.load();
+  stats.misses = misses_.load();
+  stats.invalidations = invalidations_.load();
+  stats.evictions = evictions_.load();
+  return stats;
+}
+
+// private
+NearCache::Partition* NearCache::partition(const std::string& key) {
+  // Not the hash used for sharding, so that the keys of a
+  // shard are spread over all partitions
+  return &partitions_[std::hash<std::string>()(key) % kPartitions];
+}
+
+bool NearCache::Valid(const Entry& entry) const {
+  return entry.expires > std::chrono::steady_clock::now() &&
+         entry.generation == generations_[entry.shard].load() &&
+         entry.version >= versions_[entry.shard].load();
+}
+
+void NearCache::Erase(Partition* partition, std::list<Entry>::iterator it) {
+  partition->size -= EntrySize(it->key, it->value);
+  partition->index.erase(it->key);
+  partition->lru.erase(it);
+}
+
+}  // namespace crocks
@@ -0,0 +1,113 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_NEAR_CACHE_H
+#define CROCKS_CLIENT_NEAR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <crocks/cluster.h>
+
+namespace crocks {
+
+// A bounded cache of recently read values, kept by the client to serve
+// repeated Gets of hot keys without a round trip. It is split into
+// partitions by the hash of the key, each with its own lock and LRU list.
+//
+// An entry is valid as long as it has not expired and its shard has not
+// changed since it was read. A shard has changed if it has been flushed,
+// which the client does after writing to it and after it moves to another
+// node, or if a newer version of it has been read since (see
+// Shard::version() on the server). So writes by other clients are noticed
+// on the next miss in the same shard, or at the latest when the entry
+// expires.
+class NearCache {
+ public:
+  // capacity is the total size of the entries in bytes
+  NearCache(size_t capacity, std::chrono::milliseconds ttl, int num_shards);
+
+  // If the key is cached and its entry is still valid, store its value
+  // and return true
+  bool Lookup(int shard, const std::string& key, std::string* value);
+
+  // Return the generation of the shard, which is increased by Flush(). It
+  // must be taken before reading a key and passed to Insert(), so that a
+  // value read before a flush is not inserted after it.
+  uint64_t generation(int shard) const {
+    return generations_[shard].load();
+  }
+
+  // Cache the value of the key, read when the shard was at the given
+  // version, unless the shard has been flushed since generation
+  void Insert(int shard, const std::string& key, const std::string& value,
+              uint64_t version, uint64_t generation);
+
+  // Invalidate every entry of the shard
+  void Flush(int shard);
+
+  CacheStats stats() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string value;
+    int shard;
+    uint64_t version;
+    uint64_t generation;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  struct Partition {
+    std::mutex mutex;
+    // Most recently used first
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t size = 0;
+  };
+
+  static const int kPartitions = 16;
+
+  Partition* partition(const std::string& key);
+  bool Valid(const Entry& entry) const;
+  // Requires the mutex of the partition
+  void Erase(Partition* partition, std::list<Entry>::iterator it);
+
+  // Capacity of each partition
+  const size_t capacity_;
+  const std::chrono::milliseconds ttl_;
+  std::unique_ptr<std::atomic<uint64_t>[]> generations_;
+  // The newest version of each shard that has been read since its last flush
+  std::unique_ptr<std::atomic<uint64_t>[]> versions_;
+  Partition partitions_[kPartitions];
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+  std::atomic<uint64_t> invalidations_;
+  std::atomic<uint64_t> evictions_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_NEAR_CACHE_H
@@ -17,94 +17,258 @@
 
 #include "src/client/node.h"
 
+#include <assert.h>
+
+#include <algorithm>
+
 #include <grpc++/grpc++.h>
 
 #include "src/common/util.h"
 
 namespace crocks {
 
-Node::Node(const std::string& address)
-    : stub_(pb::RPC::NewStub(
-          grpc::CreateChannel(address, grpc::InsecureChannelCredentials()))),
-      address_(address) {}
+namespace {
+
+// Same as Ensure(), but also get the routing hint of a rejected request
+grpc::Status EnsureWithHint(
+    std::function<grpc::Status(grpc::ClientContext*)> rpc,
+    const std::string& what, RoutingHint* hint,
+    std::chrono::system_clock::time_point deadline) {
+  if (hint != nullptr)
+    *hint = RoutingHint();
+  return Ensure(
+      [&](grpc::ClientContext* ctx) {
+        grpc::Status status = rpc(ctx);
+        if (hint != nullptr &&
+            status.error_code() == grpc::StatusCode::INVALID_ARGUMENT)
+          GetRoutingHint(*ctx, hint);
+        return status;
+      },
+      what, deadline);
+}
+
+}  // namespace
+
+Node::Node(const std::string& address, int num_channels)
+    : next_(0), address_(address) {
+  assert(num_channels > 0);
+  for (int i = 0; i < num_channels; i++) {
+    // Channels with identical arguments share the same connection,
+    // so each one gets a different value for an unused argument.
+    grpc::ChannelArguments args;
+    args.SetInt("crocks.channel", i);
+    stubs_.push_back(pb::RPC::NewStub(grpc::CreateCustomChannel(
+        address, grpc::InsecureChannelCredentials(), args)));
+  }
+}
 
 Status Node::Ping() {
   pb::Empty request;
   pb::Empty response;
   grpc::ClientContext context;
-  grpc::Status status = stub_->Ping(&context, request, &response);
+  grpc::Status status = stub()->Ping(&context, request, &response);
   return Status(status);
 }
 
-Status Node::Get(const std::string& key, std::string* value) {
+Status Node::Stats(pb::StatsResponse* response) {
+  pb::Empty request;
+  grpc::ClientContext context;
+  grpc::Status status = stub()->Stats(&context, request, response);
+  return Status(status);
+}
+
+Status Node::Get(const std::string& key, std::string* value,
+                 RoutingHint* hint,
+                 std::chrono::system_clock::time_point deadline,
+                 uint64_t* version) {
   pb::Key request;
   pb::Response response;
   request.set_key(key);
-  grpc::Status status = Ensure(
+  grpc::Status status = EnsureWithHint(
       [&](grpc::ClientContext* ctx) {
-        return stub_->Get(ctx, request, &response);
+        return stub()->Get(ctx, request, &response);
       },
-      "Node::Get");
+      "Node::Get", hint, deadline);
   // If status is not OK, value is an empty string
   *value = response.value();
+  if (version != nullptr)
+    *version = response.version();
   return Status(status, response.status());
 }
 
-Status Node::Put(const std::string& key, const std::string& value) {
+Status Node::Put(const std::string& key, const std::string& value,
+                 RoutingHint* hint,
+                 std::chrono::system_clock::time_point deadline) {
   pb::KeyValue request;
   pb::Response response;
   request.set_key(key);
   request.set_value(value);
-  grpc::Status status = Ensure(
+  grpc::Status status = EnsureWithHint(
       [&](grpc::ClientContext* ctx) {
-        return stub_->Put(ctx, request, &response);
+        return stub()->Put(ctx, request, &response);
       },
-      "Node::Put");
+      "Node::Put", hint, deadline);
   return Status(status, response.status());
 }
 
-Status Node::Delete(const std::string& key) {
+Status Node::Delete(const std::string& key, RoutingHint* hint,
+                    std::chrono::system_clock::time_point deadline) {
   pb::Key request;
   pb::Response response;
   request.set_key(key);
-  grpc::Status status = Ensure(
+  grpc::Status status = EnsureWithHint(
       [&](grpc::ClientContext* ctx) {
-        return stub_->Delete(ctx, request, &response);
+        return stub()->Delete(ctx, request, &response);
       },
-      "Node::Delete");
+      "Node::Delete", hint, deadline);
   return Status(status, response.status());
 }
 
-Status Node::SingleDelete(const std::string& key) {
+Status Node::SingleDelete(const std::string& key, RoutingHint* hint,
+                          std::chrono::system_clock::time_point deadline) {
   pb::Key request;
   pb::Response response;
   request.set_key(key);
-  grpc::Status status = Ensure(
+  grpc::Status status = EnsureWithHint(
       [&](grpc::ClientContext* ctx) {
-        return stub_->SingleDelete(ctx, request, &response);
+        return stub()->SingleDelete(ctx, request, &response);
       },
-      "Node::SingleDelete");
+      "Node::SingleDelete", hint, deadline);
   return Status(status, response.status());
 }
 
-Status Node::Merge(const std::string& key, const std::string& value) {
+Status Node::Merge(const std::string& key, const std::string& value,
+                   RoutingHint* hint,
+                   std::chrono::system_clock::time_point deadline) {
   pb::KeyValue request;
   pb::Response response;
   request.set_key(key);
   request.set_value(value);
+  grpc::Status status = EnsureWithHint(
+      [&](grpc::ClientContext* ctx) {
+        return stub()->Merge(ctx, request, &response);
+      },
+      "Node::Merge", hint, deadline);
+  return Status(status, response.status());
+}
+
+Status Node::BatchWrite(const pb::BatchBuffer& request,
+                        std::chrono::system_clock::time_point deadline) {
+  pb::Response response;
   grpc::Status status = Ensure(
       [&](grpc::ClientContext* ctx) {
-        return stub_->Merge(ctx, request, &response);
+        return stub()->BatchWrite(ctx, request, &response);
       },
-      "Node::Merge");
+      "Node::BatchWrite", deadline);
   return Status(status, response.status());
 }
 
+Status Node::HedgedGet(const std::string& key, std::string* value,
+                       std::chrono::microseconds delay, RoutingHint* hint,
+                       std::chrono::system_clock::time_point deadline,
+                       uint64_t* version) {
+  struct Attempt {
+    grpc::ClientContext context;
+    grpc::Status status;
+    pb::Response response;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> rpc;
+  };
+  pb::Key request;
+  request.set_key(key);
+  grpc::CompletionQueue cq;
+  // The same deadline as in Ensure()
+  auto now = std::chrono::system_clock::now();
+  deadline = std::min(deadline, now + std::chrono::seconds(1));
+  Attempt attempts[2];
+  // The hedged request goes over the channel after the one of the first,
+  // even if other threads pick channels in the meantime
+  unsigned int channel = next_++;
+  auto start = [&](Attempt* attempt) {
+    attempt->context.set_deadline(deadline);
+    pb::RPC::Stub* stub = stubs_[channel++ % stubs_.size()].get();
+    attempt->rpc = stub->AsyncGet(&attempt->context, request, &cq);
+    attempt->rpc->Finish(&attempt->response, &attempt->status, attempt);
+  };
+
+  start(&attempts[0]);
+  int started = 1;
+  int pending = 1;
+  Attempt* result = nullptr;
+  void* tag;
+  bool ok;
+  while (pending > 0) {
+    if (started == 1 && result == nullptr) {
+      auto status = cq.AsyncNext(&tag, &ok, now + delay);
+      if (status == grpc::CompletionQueue::TIMEOUT) {
+        start(&attempts[started++]);
+        pending++;
+        continue;
+      }
+    } else {
+      cq.Next(&tag, &ok);
+    }
+    pending--;
+    // Prefer a successful answer, if the other one failed
+    Attempt* attempt = static_cast<Attempt*>(tag);
+    if (result == nullptr || !result->status.ok())
+      result = attempt;
+    // The contexts must outlive the calls, so wait for the canceled one
+    if (result->status.ok())
+      for (int i = 0; i < started; i++)
+        if (&attempts[i] != result)
+          attempts[i].context.TryCancel();
+  }
+  cq.Shutdown();
+  while (cq.Next(&tag, &ok)) {
+  }
+
+  grpc::Status status = result->status;
+  if (hint != nullptr) {
+    *hint = RoutingHint();
+    if (status.error_code() == grpc::StatusCode::INVALID_ARGUMENT)
+      GetRoutingHint(result->context, hint);
+  }
+  // As in Ensure(), so that the request is retried
+  if (status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED)
+    status = grpc::Status(grpc::StatusCode::UNAVAILABLE, "Deadline exceeded");
+  // If status is not OK, value is an empty string
+  *value = result->response.value();
+  if (version != nullptr)
+    *version = result->response.version();
+  return Status(status, result->response.status());
+}
+
+// For asynchronous operations
+std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> Node::AsyncGet(
+    grpc::ClientContext* context, const pb::Key& request,
+    grpc::CompletionQueue* cq) {
+  return stub()->AsyncGet(context, request, cq);
+}
+
+std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> Node::AsyncPut(
+    grpc::ClientContext* context, const pb::KeyValue& request,
+    grpc::CompletionQueue* cq) {
+  return stub()->AsyncPut(context, request, cq);
+}
+
+std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>>
+Node::AsyncDelete(grpc::ClientContext* context, const pb::Key& request,
+                  grpc::CompletionQueue* cq) {
+  return stub()->AsyncDelete(context, request, cq);
+}
+
+std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>>
+Node::AsyncTransaction(grpc::ClientContext* context,
+                       const pb::TransactionRequest& request,
+                       grpc::CompletionQueue* cq) {
+  return stub()->AsyncTransaction(context, request, cq);
+}
+
 // For write_batch
 std::unique_ptr<grpc::ClientAsyncReaderWriter<pb::BatchBuffer, pb::Response>>
 Node::AsyncBatchStream(grpc::ClientContext* context, grpc::CompletionQueue* cq,
                        void* tag) {
-  return stub_->AsyncBatch(context, cq, tag);
+  return stub()->AsyncBatch(context, cq, tag);
 }
 
 // For iterator
@@ -112,7 +276,12 @@ std::unique_ptr<
     grpc::ClientAsyncReaderWriter<pb::IteratorRequest, pb::IteratorResponse>>
 Node::AsyncIteratorStream(grpc::ClientContext* context,
                           grpc::CompletionQueue* cq, void* tag) {
-  return stub_->AsyncIterator(context, cq, tag);
+  return stub()->AsyncIterator(context, cq, tag);
+}
+
+std::unique_ptr<grpc::ClientWriter<pb::LoadRequest>> Node::LoadStream(
+    grpc::ClientContext* context, pb::Response* response) {
+  return stub()->Load(context, response);
 }
 
 }  // namespace crocks
@@ -18,11 +18,16 @@
 #ifndef CROCKS_CLIENT_NODE_H
 #define CROCKS_CLIENT_NODE_H
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <crocks/status.h>
 #include "gen/crocks.grpc.pb.h"
+#include "src/common/routing_hint.h"
+#include "src/common/util.h"
 
 namespace crocks {
 
@@ -36,24 +41,77 @@ const int kByteSizeThreshold = 512 * 1024;  // 512KB
 
 class Node {
  public:
-  Node(const std::string& address);
+  // Open num_channels separate connections to the node. Requests
+  // and streams are spread over them in round-robin order.
+  Node(const std::string& address, int num_channels = 1);
 
   std::string address() const {
     return address_;
   }
 
   Status Ping();
-  Status Get(const std::string& key, std::string* value);
-  Status Put(const std::string& key, const std::string& value);
-  Status Delete(const std::string& key);
-  Status SingleDelete(const std::string& key);
-  Status Merge(const std::string& key, const std::string& value);
+  Status Stats(pb::StatsResponse* response);
+
+  // If hint is given and the request is rejected because the shard belongs
+  // to another node, the routing hint that the node sent is stored there.
+  // The request gives up at the deadline, or after a second if sooner.
+  // If version is given, the version of the shard sent along with the
+  // value is stored there (see Shard::version()).
+  Status Get(const std::string& key, std::string* value,
+             RoutingHint* hint = nullptr,
+             std::chrono::system_clock::time_point deadline = kNoDeadline,
+             uint64_t* version = nullptr);
+  Status Put(const std::string& key, const std::string& value,
+             RoutingHint* hint = nullptr,
+             std::chrono::system_clock::time_point deadline = kNoDeadline);
+  Status Delete(const std::string& key, RoutingHint* hint = nullptr,
+                std::chrono::system_clock::time_point deadline = kNoDeadline);
+  Status SingleDelete(
+      const std::string& key, RoutingHint* hint = nullptr,
+      std::chrono::system_clock::time_point deadline = kNoDeadline);
+  Status Merge(const std::string& key, const std::string& value,
+               RoutingHint* hint = nullptr,
+               std::chrono::system_clock::time_point deadline = kNoDeadline);
+
+  // Write a whole batch in a single request. Fails with INVALID_ARGUMENT,
+  // writing nothing, if the node does not hold one of its shards.
+  Status BatchWrite(
+      const pb::BatchBuffer& request,
+      std::chrono::system_clock::time_point deadline = kNoDeadline);
+
+  // Same as Get(), but if there is no answer within delay, send a second
+  // request over the next channel, use the first answer and cancel the
+  // other request. Unlike Get(), there are no retries.
+  Status HedgedGet(
+      const std::string& key, std::string* value,
+      std::chrono::microseconds delay, RoutingHint* hint = nullptr,
+      std::chrono::system_clock::time_point deadline = kNoDeadline,
+      uint64_t* version = nullptr);
+
+  // For asynchronous operations
+  std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> AsyncGet(
+      grpc::ClientContext* context, const pb::Key& request,
+      grpc::CompletionQueue* cq);
+  std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> AsyncPut(
+      grpc::ClientContext* context, const pb::KeyValue& request,
+      grpc::CompletionQueue* cq);
+  std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> AsyncDelete(
+      grpc::ClientContext* context, const pb::Key& request,
+      grpc::CompletionQueue* cq);
+  std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>>
+  AsyncTransaction(grpc::ClientContext* context,
+                   const pb::TransactionRequest& request,
+                   grpc::CompletionQueue* cq);
 
   // For write_batch
   std::unique_ptr<grpc::ClientAsyncReaderWriter<pb::BatchBuffer, pb::Response>>
   AsyncBatchStream(grpc::ClientContext* context, grpc::CompletionQueue* cq,
                    void* tag);
 
+  // For bulk_loader
+  std::unique_ptr<grpc::ClientWriter<pb::LoadRequest>> LoadStream(
+      grpc::ClientContext* context, pb::Response* response);
+
   // For iterator
   std::unique_ptr<
       grpc::ClientAsyncReaderWriter<pb::IteratorRequest, pb::IteratorResponse>>
@@ -61,7 +119,12 @@ class Node {
                       void* tag);
 
  private:
-  std::unique_ptr<pb::RPC::Stub> stub_;
+  pb::RPC::Stub* stub() {
+    return stubs_[next_++ % stubs_.size()].get();
+  }
+
+  std::vector<std::unique_ptr<pb::RPC::Stub>> stubs_;
+  std::atomic<unsigned int> next_;
   std::string address_;
 };
 
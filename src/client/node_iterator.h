@@ -58,7 +58,8 @@ class NodeIterator {
     return valid_;
   }
 
-  std::string key() const {
+  // Compared on every step of the merging iterator, so not copied
+  const std::string& key() const {
     assert(Valid());
     return queue_.front().key();
   }
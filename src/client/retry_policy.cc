@@ -0,0 +1,102 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/client/retry_policy.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "src/common/util.h"
+
+namespace crocks {
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate),
+      burst_(burst),
+      tokens_(burst),
+      last_(std::chrono::steady_clock::now()) {}
+
+std::chrono::microseconds TokenBucket::Take() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - last_;
+  last_ = now;
+  tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate_) - 1;
+  if (tokens_ >= 0)
+    return std::chrono::microseconds(0);
+  return std::chrono::microseconds(
+      static_cast<int64_t>(-tokens_ / rate_ * 1000000));
+}
+
+RetryPolicy::RetryPolicy(const Options& options)
+    : options_(options),
+      retries_(0),
+      backoff_micros_(0),
+      throttled_(0),
+      exhausted_(0) {}
+
+bool RetryPolicy::Backoff(int node, int retry,
+                          std::chrono::system_clock::time_point deadline) {
+  std::chrono::microseconds delay;
+  if (!Delay(node, retry, deadline, &delay))
+    return false;
+  std::this_thread::sleep_for(delay);
+  return true;
+}
+
+bool RetryPolicy::Delay(int node, int retry,
+                        std::chrono::system_clock::time_point deadline,
+                        std::chrono::microseconds* delay) {
+  if (options_.retry_budget > 0 && retry >= options_.retry_budget) {
+    exhausted_++;
+    return false;
+  }
+  retries_++;
+  *delay = BackoffDelay(retry, options_.retry_base_ms, options_.retry_max_ms);
+  if (options_.retry_rate > 0) {
+    std::chrono::microseconds wait = bucket(node)->Take();
+    if (wait > *delay) {
+      throttled_++;
+      *delay = wait;
+    }
+  }
+  auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline - std::chrono::system_clock::now());
+  *delay = std::max(std::min(*delay, left), std::chrono::microseconds(0));
+  backoff_micros_ += delay->count();
+  return true;
+}
+
+RetryStats RetryPolicy::stats() const {
+  RetryStats stats;
+  stats.retries = retries_;
+  stats.backoff_micros = backoff_micros_;
+  stats.throttled = throttled_;
+  stats.exhausted = exhausted_;
+  return stats;
+}
+
+TokenBucket* RetryPolicy::bucket(int node) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<TokenBucket>& bucket = buckets_[node];
+  if (bucket == nullptr)
+    bucket.reset(new TokenBucket(options_.retry_rate,
+                                 std::max(options_.retry_burst, 1)));
+  return bucket.get();
+}
+
+}  // namespace crocks
@@ -0,0 +1,86 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_RETRY_POLICY_H
+#define CROCKS_CLIENT_RETRY_POLICY_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <crocks/cluster.h>
+#include <crocks/options.h>
+
+namespace crocks {
+
+// Limits the rate of events, allowing short bursts
+class TokenBucket {
+ public:
+  TokenBucket(double rate, double burst);
+
+  // Take a token and return how long to wait until it is available. The
+  // token is taken even if it is not available yet, so that the next
+  // caller waits for the one after it.
+  std::chrono::microseconds Take();
+
+ private:
+  std::mutex mutex_;
+  const double rate_;
+  const double burst_;
+  double tokens_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+// Decides whether and when a failed request is retried, as configured in
+// Options. Shared by all threads of the cluster.
+class RetryPolicy {
+ public:
+  explicit RetryPolicy(const Options& options);
+
+  // Sleep before the given retry of a request to the given node, but not
+  // past the deadline, and return true. If the request has used up its
+  // retry budget, return false.
+  bool Backoff(int node, int retry,
+               std::chrono::system_clock::time_point deadline);
+
+  // Same as Backoff(), but return the delay instead of sleeping, for
+  // requests that are resent asynchronously
+  bool Delay(int node, int retry,
+             std::chrono::system_clock::time_point deadline,
+             std::chrono::microseconds* delay);
+
+  RetryStats stats() const;
+
+ private:
+  TokenBucket* bucket(int node);
+
+  const Options options_;
+  std::mutex mutex_;
+  std::unordered_map<int, std::unique_ptr<TokenBucket>> buckets_;
+  std::atomic<uint64_t> retries_;
+  std::atomic<uint64_t> backoff_micros_;
+  std::atomic<uint64_t> throttled_;
+  std::atomic<uint64_t> exhausted_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_RETRY_POLICY_H
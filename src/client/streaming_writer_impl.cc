@@ -0,0 +1,144 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#include "src/client/streaming_writer_impl.h"
+
+#include <crocks/cluster.h>
+
+namespace crocks {
+
+namespace {
+
+// The same as the defaults of WriteBatch. The nodes write a chunk per
+// message, which is a bit over threshold_low bytes.
+const int kThresholdLow = 64 * 1024;
+const int kThresholdHigh = 4 * 1024 * 1024;
+
+}  // namespace
+
+// StreamingWriterImpl wrapper
+StreamingWriter::StreamingWriter(Cluster* db, size_t checkpoint_bytes)
+    : impl_(new StreamingWriterImpl(db, checkpoint_bytes)) {}
+
+StreamingWriter::~StreamingWriter() {
+  delete impl_;
+}
+
+void StreamingWriter::Put(const std::string& key, const std::string& value) {
+  impl_->Put(key, value);
+}
+
+void StreamingWriter::Delete(const std::string& key) {
+  impl_->Delete(key);
+}
+
+void StreamingWriter::SingleDelete(const std::string& key) {
+  impl_->SingleDelete(key);
+}
+
+void StreamingWriter::Merge(const std::string& key, const std::string& value) {
+  impl_->Merge(key, value);
+}
+
+Status StreamingWriter::Checkpoint() {
+  return impl_->Checkpoint();
+}
+
+uint64_t StreamingWriter::checkpoint() const {
+  return impl_->checkpoint();
+}
+
+// Streaming writer implementation
+StreamingWriter::StreamingWriterImpl::StreamingWriterImpl(
+    Cluster* db, size_t checkpoint_bytes)
+    : db_(db), checkpoint_bytes_(checkpoint_bytes) {}
+
+void StreamingWriter::StreamingWriterImpl::Put(const std::string& key,
+                                               const std::string& value) {
+  WriteBatch::WriteBatchImpl* batch = Batch();
+  if (batch == nullptr)
+    return;
+  batch->Put(key, value);
+  Added(key.size() + value.size());
+}
+
+void StreamingWriter::StreamingWriterImpl::Delete(const std::string& key) {
+  WriteBatch::WriteBatchImpl* batch = Batch();
+  if (batch == nullptr)
+    return;
+  batch->Delete(key);
+  Added(key.size());
+}
+
+void StreamingWriter::StreamingWriterImpl::SingleDelete(
+    const std::string& key) {
+  WriteBatch::WriteBatchImpl* batch = Batch();
+  if (batch == nullptr)
+    return;
+  batch->SingleDelete(key);
+  Added(key.size());
+}
+
+void StreamingWriter::StreamingWriterImpl::Merge(const std::string& key,
+                                                 const std::string& value) {
+  WriteBatch::WriteBatchImpl* batch = Batch();
+  if (batch == nullptr)
+    return;
+  batch->Merge(key, value);
+  Added(key.size() + value.size());
+}
+
+Status StreamingWriter::StreamingWriterImpl::Checkpoint() {
+  if (!status_.ok()) {
+    Status status = status_;
+    status_ = Status();
+    return status;
+  }
+  return Write();
+}
+
+// private
+WriteBatch::WriteBatchImpl* StreamingWriter::StreamingWriterImpl::Batch() {
+  if (!status_.ok())
+    return nullptr;
+  if (!batch_)
+    batch_.reset(new WriteBatch::WriteBatchImpl(db_, kThresholdLow,
+                                                kThresholdHigh, true));
+  return batch_.get();
+}
+
+void StreamingWriter::StreamingWriterImpl::Added(size_t bytes) {
+  added_++;
+  bytes_ += bytes;
+  if (bytes_ >= checkpoint_bytes_)
+    status_ = Write();
+}
+
+Status StreamingWriter::StreamingWriterImpl::Write() {
+  if (!batch_)
+    return Status();
+  Status status = batch_->Write();
+  batch_.reset();
+  bytes_ = 0;
+  if (status.ok())
+    checkpoint_ = added_;
+  else
+    // The producer adds again the updates after the checkpoint
+    added_ = checkpoint_;
+  return status;
+}
+
+}  // namespace crocks
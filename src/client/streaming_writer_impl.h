@@ -0,0 +1,73 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef CROCKS_CLIENT_STREAMING_WRITER_IMPL_H
+#define CROCKS_CLIENT_STREAMING_WRITER_IMPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include <crocks/status.h>
+#include <crocks/streaming_writer.h>
+#include <crocks/write_batch.h>
+#include "src/client/write_batch_impl.h"
+
+namespace crocks {
+
+class Cluster;
+
+// The updates between two checkpoints are streamed by a WriteBatchImpl in
+// streaming mode. A checkpoint is its Write(), after which the writer starts
+// a new one, so the shards are not held by the calls for longer than that.
+class StreamingWriter::StreamingWriterImpl {
+ public:
+  StreamingWriterImpl(Cluster* db, size_t checkpoint_bytes);
+
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+  void SingleDelete(const std::string& key);
+  void Merge(const std::string& key, const std::string& value);
+  Status Checkpoint();
+
+  uint64_t checkpoint() const {
+    return checkpoint_;
+  }
+
+ private:
+  // Return the batch of the current checkpoint, or nullptr if a checkpoint
+  // has failed
+  WriteBatch::WriteBatchImpl* Batch();
+  // Account for an update of the given size, and checkpoint if it is due
+  void Added(size_t bytes);
+  Status Write();
+
+  Cluster* db_;
+  size_t checkpoint_bytes_;
+  std::unique_ptr<WriteBatch::WriteBatchImpl> batch_;
+  // Bytes added since the last checkpoint
+  size_t bytes_ = 0;
+  uint64_t added_ = 0;
+  uint64_t checkpoint_ = 0;
+  // The status of a failed automatic checkpoint
+  Status status_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_STREAMING_WRITER_IMPL_H
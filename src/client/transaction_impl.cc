@@ -0,0 +1,253 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/client/transaction_impl.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include <crocks/cluster.h>
+#include <crocks/options.h>
+#include "src/client/cluster_impl.h"
+#include "src/client/node.h"
+#include "src/common/hash.h"
+#include "src/common/util.h"
+
+namespace crocks {
+
+namespace {
+
+// Times to retry a commit after the routing of its keys has changed
+const int kMaxRoutingRetries = 3;
+
+// Once every node has prepared the transaction, it must be committed
+// everywhere, so the commit is retried more persistently
+const int kMaxCommitRetries = 10;
+const int kCommitBackoffMs = 10;
+const int kCommitMaxBackoffMs = 1000;
+
+}  // namespace
+
+// TransactionImpl wrapper
+Transaction::Transaction(Cluster* db) : impl_(new TransactionImpl(db)) {}
+
+Transaction::~Transaction() {
+  delete impl_;
+}
+
+Status Transaction::Get(const std::string& key, std::string* value) {
+  return impl_->Get(key, value);
+}
+
+void Transaction::Put(const std::string& key, const std::string& value) {
+  impl_->Put(key, value);
+}
+
+void Transaction::Delete(const std::string& key) {
+  impl_->Delete(key);
+}
+
+Status Transaction::Commit() {
+  return impl_->Commit();
+}
+
+void Transaction::Rollback() {
+  impl_->Rollback();
+}
+
+// Transaction implementation
+Transaction::TransactionImpl::TransactionImpl(Cluster* db) : db_(db->get()) {}
+
+Status Transaction::TransactionImpl::Get(const std::string& key,
+                                         std::string* value) {
+  auto it = writes_.find(key);
+  if (it != writes_.end()) {
+    if (it->second.op() == pb::BatchUpdate::DELETE) {
+      value->clear();
+      return Status(rocksdb::StatusCode::NOT_FOUND);
+    }
+    *value = it->second.value();
+    return Status();
+  }
+  // A cached value may be stale, and then the commit would fail
+  CallOptions options;
+  options.skip_cache = true;
+  Status status = db_->Get(options, key, value);
+  if (!status.ok() && !status.IsNotFound())
+    return status;
+  // If the key is read again, the first read is the one that counts
+  if (reads_.find(key) == reads_.end())
+    reads_[key] = Read{status.ok(), status.ok() ? Hash64(*value) : 0};
+  return status;
+}
+
+void Transaction::TransactionImpl::Put(const std::string& key,
+                                       const std::string& value) {
+  pb::BatchUpdate& update = writes_[key];
+  update.set_op(pb::BatchUpdate::PUT);
+  update.set_key(key);
+  update.set_value(value);
+}
+
+void Transaction::TransactionImpl::Delete(const std::string& key) {
+  pb::BatchUpdate& update = writes_[key];
+  update.set_op(pb::BatchUpdate::DELETE);
+  update.set_key(key);
+  update.clear_value();
+}
+
+Status Transaction::TransactionImpl::Commit() {
+  Status status = TryCommit();
+  for (int i = 0; i < kMaxRoutingRetries &&
+                  status.grpc_code() == grpc::StatusCode::INVALID_ARGUMENT;
+       i++) {
+    // Nothing was applied, so retry once we know the new masters
+    db_->Refresh();
+    status = TryCommit();
+  }
+  for (const auto& pair : writes_)
+    db_->FlushCache(db_->ShardForKey(pair.first));
+  Rollback();
+  return status;
+}
+
+void Transaction::TransactionImpl::Rollback() {
+  reads_.clear();
+  writes_.clear();
+}
+
+// private
+Status Transaction::TransactionImpl::TryCommit() {
+  // Hold the nodes until the transaction is over
+  std::shared_ptr<const Routing> routing = db_->routing();
+  std::map<int, pb::TransactionRequest> requests;
+  for (const auto& pair : reads_) {
+    pb::TransactionRead* read =
+        requests[routing->IndexForKey(pair.first)].add_reads();
+    read->set_key(pair.first);
+    read->set_found(pair.second.found);
+    read->set_digest(pair.second.digest);
+  }
+  for (const auto& pair : writes_)
+    *requests[routing->IndexForKey(pair.first)].add_writes() = pair.second;
+  if (requests.empty())
+    return Status();
+
+  uint64_t id = RandomId();
+  // A single node validates and writes in one step
+  auto phase = requests.size() == 1 ? pb::TransactionRequest::WRITE
+                                    : pb::TransactionRequest::PREPARE;
+  for (auto& pair : requests) {
+    pair.second.set_id(id);
+    pair.second.set_phase(phase);
+  }
+  Status status;
+  for (const auto& pair : Send(*routing, requests)) {
+    if (!pair.second.ok()) {
+      status = pair.second;
+      // Prefer a conflict to other errors, as it is worth retrying
+      if (status.IsBusy())
+        break;
+    }
+  }
+  if (phase == pb::TransactionRequest::WRITE)
+    return status;
+
+  for (auto& pair : requests) {
+    pair.second.clear_reads();
+    pair.second.clear_writes();
+    pair.second.set_phase(status.ok() ? pb::TransactionRequest::COMMIT
+                                      : pb::TransactionRequest::ABORT);
+  }
+  if (!status.ok()) {
+    Send(*routing, requests);
+    return status;
+  }
+
+  // Every node has prepared the transaction, so it is decided. Retry the
+  // nodes that could not be reached. A node remembers the transactions it
+  // has committed, so a retried commit succeeds if an earlier attempt has
+  // reached it after all, and fails with Aborted if the transaction has
+  // expired there, in which case it is only partly applied.
+  Status unreachable;
+  for (int retry = 0; !requests.empty() && retry < kMaxCommitRetries;
+       retry++) {
+    if (retry > 0)
+      std::this_thread::sleep_for(
+          BackoffDelay(retry, kCommitBackoffMs, kCommitMaxBackoffMs));
+    for (const auto& pair : Send(*routing, requests)) {
+      if (!pair.second.grpc_ok()) {
+        unreachable = pair.second;
+        continue;
+      }
+      if (!pair.second.ok())
+        status = pair.second;
+      requests.erase(pair.first);
+    }
+  }
+  return requests.empty() ? status : unreachable;
+}
+
+std::map<int, Status> Transaction::TransactionImpl::Send(
+    const Routing& routing,
+    const std::map<int, pb::TransactionRequest>& requests) {
+  struct Call {
+    int node;
+    grpc::ClientContext context;
+    grpc::Status status;
+    pb::Response response;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> rpc;
+  };
+  grpc::CompletionQueue cq;
+  auto deadline = std::chrono::system_clock::now() + std::chrono::seconds(1);
+  std::vector<std::unique_ptr<Call>> calls;
+  std::map<int, Status> statuses;
+  for (const auto& pair : requests) {
+    Node* node = nullptr;
+    if (pair.first < static_cast<int>(routing.nodes.size()))
+      node = routing.nodes[pair.first].get();
+    if (node == nullptr) {
+      statuses[pair.first] = Status(
+          grpc::Status(grpc::StatusCode::UNAVAILABLE, "Node was removed"));
+      continue;
+    }
+    Call* call = new Call;
+    calls.emplace_back(call);
+    call->node = pair.first;
+    call->context.set_deadline(deadline);
+    call->rpc = node->AsyncTransaction(&call->context, pair.second, &cq);
+    call->rpc->Finish(&call->response, &call->status, call);
+  }
+  void* tag;
+  bool ok;
+  for (size_t i = 0; i < calls.size(); i++) {
+    cq.Next(&tag, &ok);
+    Call* call = static_cast<Call*>(tag);
+    statuses[call->node] = Status(call->status, call->response.status());
+  }
+  cq.Shutdown();
+  while (cq.Next(&tag, &ok)) {
+  }
+  return statuses;
+}
+
+}  // namespace crocks
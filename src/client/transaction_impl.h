@@ -0,0 +1,70 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_CLIENT_TRANSACTION_IMPL_H
+#define CROCKS_CLIENT_TRANSACTION_IMPL_H
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include <crocks/status.h>
+#include <crocks/transaction.h>
+#include "gen/crocks.pb.h"
+
+namespace crocks {
+
+class Cluster;
+class ClusterImpl;
+struct Routing;
+
+class Transaction::TransactionImpl {
+ public:
+  TransactionImpl(Cluster* db);
+
+  Status Get(const std::string& key, std::string* value);
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+  Status Commit();
+  void Rollback();
+
+ private:
+  // What a key read, to check on commit that it has not changed
+  struct Read {
+    bool found;
+    uint64_t digest;
+  };
+
+  // Commit with the current routing. Returns INVALID_ARGUMENT if a node no
+  // longer holds a shard of the transaction, and then nothing is applied.
+  Status TryCommit();
+
+  // Send each request to the node it is keyed by, in parallel, and return
+  // the status of each one
+  std::map<int, Status> Send(
+      const Routing& routing,
+      const std::map<int, pb::TransactionRequest>& requests);
+
+  ClusterImpl* db_;
+  std::map<std::string, Read> reads_;
+  std::map<std::string, pb::BatchUpdate> writes_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_TRANSACTION_IMPL_H
@@ -18,8 +18,10 @@
 #include "src/client/write_batch_impl.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <utility>
@@ -32,9 +34,42 @@
 
 namespace crocks {
 
+namespace {
+
+// The format of rocksdb::WriteBatch::Data(), as defined in
+// rocksdb/db/write_batch.cc. It starts with a header of a sequence number,
+// which the node ignores, and the number of records. Each record is a tag,
+// the length-prefixed key, and the length-prefixed value if it has one.
+const size_t kHeaderSize = 12;
+const size_t kCountOffset = 8;
+
+// From rocksdb/db/dbformat.h
+const char kTypeDeletion = 0x0;
+const char kTypeValue = 0x1;
+const char kTypeMerge = 0x2;
+const char kTypeSingleDeletion = 0x7;
+
+void PutFixed32(std::string* dst, size_t offset, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    (*dst)[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+void PutLengthPrefixed(std::string* dst, const std::string& value) {
+  // Varint32 length
+  uint32_t length = value.size();
+  while (length >= 0x80) {
+    dst->push_back(static_cast<char>(length | 0x80));
+    length >>= 7;
+  }
+  dst->push_back(static_cast<char>(length));
+  dst->append(value);
+}
+
+}  // namespace
+
 // WriteBatchImpl wrapper
 WriteBatch::WriteBatch(Cluster* db)
-    : impl_(new WriteBatchImpl(db, 64 * 1024, 1024 * 1024)) {}
+    : impl_(new WriteBatchImpl(db, 64 * 1024, 4 * 1024 * 1024)) {}
 
 WriteBatch::WriteBatch(Cluster* db, int threshold_low, int threshold_high)
     : impl_(new WriteBatchImpl(db, threshold_low, threshold_high)) {}
@@ -72,148 +107,135 @@ Status WriteBatch::WriteWithLock() {
 }
 
 void Buffer::AddPut(const std::string& key, const std::string& value) {
-  pb::BatchUpdate* batch_update = buffer_.add_updates();
-  batch_update->set_op(pb::BatchUpdate::PUT);
-  batch_update->set_key(key);
-  batch_update->set_value(value);
-  // XXX: ByteSize() seems to be deprecated in favor of ByteSizeLong()
-  // which returns size_t instead of int.
-  // XXX: We keep track of the total bytes, because buffer_.ByteSize()
-  // recalculates the size and it's too expensive to do that every
-  // time StreamIfExceededThreshold() is called (i.e. at every single
-  // batch operation). In crocks.pb.cc apart from the size of each
-  // individual BatchUpdate there is this line: total_size += 1 *
-  // this->updates_size(); so we need to add at least 1 for each
-  // batch_update. However the true size seems to be bigger by 1 or
-  // 2 bytes. We add 3 to be sure and in StreamIfExceededThreshold()
-  // we assert that our estimation is no bigger than the actual size.
-  byte_size_ += batch_update->ByteSize() + 3;
+  Add(kTypeValue, key, value);
 }
 
 void Buffer::AddDelete(const std::string& key) {
-  pb::BatchUpdate* batch_update = buffer_.add_updates();
-  batch_update->set_op(pb::BatchUpdate::DELETE);
-  batch_update->set_key(key);
-  byte_size_ += batch_update->ByteSize() + 3;
+  Add(kTypeDeletion, key);
 }
 
 void Buffer::AddSingleDelete(const std::string& key) {
-  pb::BatchUpdate* batch_update = buffer_.add_updates();
-  batch_update->set_op(pb::BatchUpdate::SINGLE_DELETE);
-  batch_update->set_key(key);
-  byte_size_ += batch_update->ByteSize() + 3;
+  Add(kTypeSingleDeletion, key);
 }
 
 void Buffer::AddMerge(const std::string& key, const std::string& value) {
-  pb::BatchUpdate* batch_update = buffer_.add_updates();
-  batch_update->set_op(pb::BatchUpdate::MERGE);
-  batch_update->set_key(key);
-  batch_update->set_value(value);
-  byte_size_ += batch_update->ByteSize() + 3;
-}
-
-void Buffer::AddClear() {
-  pb::BatchUpdate* batch_update = buffer_.add_updates();
-  batch_update->set_op(pb::BatchUpdate::CLEAR);
-  byte_size_ += batch_update->ByteSize() + 3;
+  Add(kTypeMerge, key, value);
 }
 
 void Buffer::Clear() {
-  buffer_.Clear();
-  byte_size_ = 0;
+  section_.Clear();
+  count_ = 0;
 }
 
-void Buffer::Stream() {
-  call_->stream->Write(buffer_, call_);
-  call_->pending_requests++;
+void Buffer::Release(pb::BatchSection* section) {
+  section_.set_shard(shard_);
+  PutFixed32(section_.mutable_data(), kCountOffset, count_);
+  section->Swap(&section_);
+  Clear();
 }
 
-void Buffer::RestreamFirstBuffer() {
-  assert(first_);
-  assert(read_requested_);
-  assert(first_buffer_.updates_size() > 0);
-  call_->stream->Write(first_buffer_, call_);
-  call_->pending_requests++;
+void Buffer::Add(char tag, const std::string& key) {
+  std::string* data = section_.mutable_data();
+  if (data->empty())
+    data->assign(kHeaderSize, '\0');
+  data->push_back(tag);
+  PutLengthPrefixed(data, key);
+  count_++;
 }
 
-void Buffer::RequestRead() {
-  assert(first_);
-  call_->stream->Read(&response_, call_);
-  // The first time this is called we have to copy the buffer
-  if (!read_requested_) {
-    read_requested_ = true;
-    first_buffer_ = buffer_;
-  }
-  call_->pending_requests++;
+void Buffer::Add(char tag, const std::string& key, const std::string& value) {
+  Add(tag, key);
+  PutLengthPrefixed(section_.mutable_data(), value);
 }
 
 // Write batch implementation
 WriteBatch::WriteBatchImpl::WriteBatchImpl(Cluster* db, int threshold_low,
-                                           int threshold_high)
+                                           int threshold_high, bool streaming)
     : db_(db->get()),
-      // Fill buffer_ vector with db_->num_shards() nullptrs
-      buffers_(db_->num_shards()),
       threshold_low_(threshold_low),
-      threshold_high_(threshold_high) {}
+      threshold_high_(threshold_high),
+      streaming_(streaming),
+      // Fill the vectors with db_->num_shards() nullptrs
+      buffers_(db_->num_shards()),
+      streams_(db_->num_shards()) {}
 
 WriteBatch::WriteBatchImpl::~WriteBatchImpl() {
+  if (sender_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    queued_cv_.notify_one();
+    sender_.join();
+  }
   // Some items may be empty but deleting nullptr is ok
   for (auto pair : calls_)
     delete pair.second;
   for (auto buffer : buffers_)
     delete buffer;
+  for (auto stream : streams_)
+    delete stream;
 };
 
 void WriteBatch::WriteBatchImpl::Put(const std::string& key,
                                      const std::string& value) {
-  int shard = db_->ShardForKey(key);
-  Buffer* buffer = EnsureBuffer(shard);
+  Buffer* buffer = EnsureBuffer(db_->ShardForKey(key));
+  int bytes_before = buffer->ByteSize();
   buffer->AddPut(key, value);
-  StreamIfExceededThreshold(shard);
+  Added(buffer, bytes_before);
 }
 
 void WriteBatch::WriteBatchImpl::Delete(const std::string& key) {
-  int shard = db_->ShardForKey(key);
-  Buffer* buffer = EnsureBuffer(shard);
+  Buffer* buffer = EnsureBuffer(db_->ShardForKey(key));
+  int bytes_before = buffer->ByteSize();
   buffer->AddDelete(key);
-  StreamIfExceededThreshold(shard);
+  Added(buffer, bytes_before);
 }
 
 void WriteBatch::WriteBatchImpl::SingleDelete(const std::string& key) {
-  int shard = db_->ShardForKey(key);
-  Buffer* buffer = EnsureBuffer(shard);
+  Buffer* buffer = EnsureBuffer(db_->ShardForKey(key));
+  int bytes_before = buffer->ByteSize();
   buffer->AddSingleDelete(key);
-  StreamIfExceededThreshold(shard);
+  Added(buffer, bytes_before);
 }
 
 void WriteBatch::WriteBatchImpl::Merge(const std::string& key,
                                        const std::string& value) {
-  int shard = db_->ShardForKey(key);
-  Buffer* buffer = EnsureBuffer(shard);
+  Buffer* buffer = EnsureBuffer(db_->ShardForKey(key));
+  int bytes_before = buffer->ByteSize();
   buffer->AddMerge(key, value);
-  StreamIfExceededThreshold(shard);
+  Added(buffer, bytes_before);
 }
 
 void WriteBatch::WriteBatchImpl::Clear() {
-  // We clear the current buffers and add a CLEAR operation to each one of them,
-  // so that the servers clear their own batches. Since the operations are
-  // cleared, there is no way the threshold is exceeded and we don't need to
-  // call StreamIfExceededThreshold().
-  for (auto buffer : buffers_) {
-    buffer->Clear();
-    buffer->AddClear();
+  // We drop the updates that have not been handed off yet, and queue a
+  // message with the clear flag, which the sender thread sends to every
+  // node after the messages queued before it, so that the servers clear
+  // their own batches.
+  for (auto& pair : nodes_) {
+    for (Buffer* buffer : pair.second.buffers)
+      buffer->Clear();
+    pair.second.buffers.clear();
+    pair.second.bytes = 0;
   }
+  // Nothing has been sent if the sender thread has not started
+  if (!sender_.joinable())
+    return;
+  pb::BatchBuffer msg;
+  msg.set_clear(true);
+  Handoff(&msg);
 }
 
 Status WriteBatch::WriteBatchImpl::Write() {
-  DoWrite();
+  Status status;
+  if (WriteUnary(&status))
+    return status;
+  DoWrite(false);
   return GetStatus();
 }
 
 Status WriteBatch::WriteBatchImpl::WriteWithLock() {
-  db_->Lock();
-  DoWrite();
-  db_->Unlock();
+  DoWrite(true);
   return GetStatus();
 }
 
@@ -222,8 +244,8 @@ AsyncBatchCall* WriteBatch::WriteBatchImpl::EnsureBatchCall(int id) {
   AsyncBatchCall* call = calls_[id];
   if (call == nullptr) {
     call = new AsyncBatchCall;
-    Node* node = db_->NodeByIndex(id);
-    call->stream = node->AsyncBatchStream(&call->context, &cq_, call);
+    call->node = db_->NodeByIndex(id);
+    call->stream = call->node->AsyncBatchStream(&call->context, &cq_, call);
     call->pending_requests = 1;
     calls_[id] = call;
   }
@@ -235,11 +257,22 @@ Buffer* WriteBatch::WriteBatchImpl::EnsureBuffer(int shard) {
   if (buffer == nullptr) {
     buffer = new Buffer;
     buffer->set_shard(shard);
+    buffer->set_node(db_->IndexForShard(shard));
     buffers_[shard] = buffer;
   }
   return buffer;
 }
 
+ShardStream* WriteBatch::WriteBatchImpl::EnsureStream(int shard) {
+  ShardStream* stream = streams_[shard];
+  if (stream == nullptr) {
+    stream = new ShardStream;
+    stream->set_call(EnsureBatchCall(db_->IndexForShard(shard)));
+    streams_[shard] = stream;
+  }
+  return stream;
+}
+
 // Get a tag from the completion queue and decrement the number of
 // pending_requests of the related call.
 void WriteBatch::WriteBatchImpl::QueueNext() {
@@ -257,111 +290,226 @@ void WriteBatch::WriteBatchImpl::QueueNext() {
   }
 }
 
-// Similar to QueueNext() but does not block and returns true if it processed a
-// call or false if the queue was empty.
-bool WriteBatch::WriteBatchImpl::QueueAsyncNext() {
-  void* got_tag;
-  bool ok = false;
-  AsyncBatchCall* call;
-  // The deadline is normally something like
-  // std::chrono::system_clock::now() + std::chrono::milliseconds(10)
-  // Here we only pass now() so it will timeout immediately.
-  switch (cq_.AsyncNext(&got_tag, &ok, std::chrono::system_clock::now())) {
-    case grpc::CompletionQueue::GOT_EVENT:
-      call = static_cast<AsyncBatchCall*>(got_tag);
-      if (ok) {
-        call->pending_requests--;
-      } else {
-        call->shutdown = true;
-        call->pending_requests = 0;
-      }
-      return true;
-    case grpc::CompletionQueue::TIMEOUT:
-      return false;
-    // FIXME: When can a queue be shutting down and what should we do about it?
-    case grpc::CompletionQueue::SHUTDOWN:
-      exit(EXIT_FAILURE);
+void WriteBatch::WriteBatchImpl::Added(Buffer* buffer, int bytes_before) {
+  NodeBuffers* node = &nodes_[buffer->node()];
+  if (buffer->updates_size() == 1) {
+    // The first update since the buffer was last handed off
+    node->buffers.push_back(buffer);
+    bytes_before = 0;
+  }
+  node->bytes += buffer->ByteSize() - bytes_before;
+  if (node->bytes > threshold_low_)
+    HandoffNode(node);
+}
+
+void WriteBatch::WriteBatchImpl::HandoffNode(NodeBuffers* node) {
+  pb::BatchBuffer msg;
+  ReleaseNode(node, &msg);
+  Handoff(&msg);
+}
+
+void WriteBatch::WriteBatchImpl::ReleaseNode(NodeBuffers* node,
+                                             pb::BatchBuffer* msg) {
+  for (Buffer* buffer : node->buffers)
+    buffer->Release(msg->add_sections());
+  node->buffers.clear();
+  node->bytes = 0;
+}
+
+void WriteBatch::WriteBatchImpl::Handoff(pb::BatchBuffer* msg) {
+  size_t bytes = msg->ByteSize();
+  std::unique_lock<std::mutex> lock(mutex_);
+  // A single message may be larger than threshold_high_ by itself
+  sent_cv_.wait(lock, [this, bytes] {
+    return pending_bytes_ == 0 ||
+           pending_bytes_ + bytes <= static_cast<size_t>(threshold_high_);
+  });
+  pending_bytes_ += bytes;
+  queue_.emplace_back();
+  queue_.back().Swap(msg);
+  if (!sender_.joinable())
+    sender_ = std::thread(&WriteBatchImpl::Send, this);
+  lock.unlock();
+  queued_cv_.notify_one();
+}
+
+void WriteBatch::WriteBatchImpl::Drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  sent_cv_.wait(lock, [this] { return queue_.empty() && !sending_; });
+}
+
+void WriteBatch::WriteBatchImpl::Send() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_cv_.wait(lock, [this] { return !queue_.empty() || shutdown_; });
+    // The batch is being destroyed without being written
+    if (shutdown_)
+      return;
+    pb::BatchBuffer msg;
+    msg.Swap(&queue_.front());
+    queue_.pop_front();
+    size_t bytes = msg.ByteSize();
+    sending_ = true;
+    lock.unlock();
+    // Blocks while the calls of the shards have pending requests, which
+    // only delays the following messages and not the caller.
+    Stream(&msg);
+    lock.lock();
+    sending_ = false;
+    pending_bytes_ -= bytes;
+    sent_cv_.notify_all();
   }
-  // Unreachable
-  return false;
 }
 
-void WriteBatch::WriteBatchImpl::StreamIfExceededThreshold(int shard) {
-  Buffer* buffer = buffers_[shard];
-  AsyncBatchCall* call = buffer->call();
-  if (call == nullptr) {
-    int node_id = db_->IndexForShard(shard);
-    call = EnsureBatchCall(node_id);
-    buffer->set_call(call);
-  }
-  if (buffer->ByteSize() <= threshold_low_) {
-    // Below the low threshold. Do nothing.
+void WriteBatch::WriteBatchImpl::Stream(pb::BatchBuffer* msg) {
+  if (msg->clear()) {
+    // Every node drops what he has got so far
+    SettleAll();
+    for (auto pair : calls_) {
+      AsyncBatchCall* call = pair.second;
+      if (call->shutdown)
+        continue;
+      call->stream->Write(*msg, call);
+      call->pending_requests++;
+    }
     return;
-  } else if (buffer->ByteSize() <= threshold_high_) {
-    // Above the low threshold. If there are pending requests even after
-    // checking the queue, continue and try again later, else send a buffer.
-    while (call->pending_requests > 0 && QueueAsyncNext())
-      ;
-    if (call->pending_requests == 0)
-      Stream(buffer);
-  } else {
-    // Above the high threshold. We have no choice but to block.
-    Stream(buffer);
   }
-}
 
-void WriteBatch::WriteBatchImpl::Stream(Buffer* buffer) {
-  assert(buffer->updates_size() > 0);
-  assert(buffer->RealByteSize() <= buffer->ByteSize());
-  AsyncBatchCall* call = buffer->call();
   // From http://www.grpc.io/grpc/cpp/classgrpc_1_1_client_async_writer.html:
   // "Only one write may be outstanding at any given time. This means that
   // after calling Write, one must wait to receive tag from the completion
   // queue BEFORE calling Write again." So before we call Write(), we have to
   // repeatedly read from the completion queue, until there are no more
-  // pending requests for the given call.
+  // pending requests for the given call. Settling a call may move shards
+  // to other calls, so we repeat until the calls of every shard are idle.
+  bool idle;
+  do {
+    idle = true;
+    for (const auto& section : msg->sections()) {
+      AsyncBatchCall* call = EnsureStream(section.shard())->call();
+      if (!Idle(call)) {
+        Settle(call);
+        idle = false;
+      }
+    }
+  } while (!idle);
+
+  // Normally the shards of a message are all on the same node
+  std::unordered_map<AsyncBatchCall*, pb::BatchBuffer> msgs;
+  for (auto& section : *msg->mutable_sections())
+    msgs[streams_[section.shard()]->call()].add_sections()->Swap(&section);
+  for (auto& pair : msgs)
+    StreamOn(pair.first, &pair.second);
+}
+
+void WriteBatch::WriteBatchImpl::StreamOn(AsyncBatchCall* call,
+                                          pb::BatchBuffer* msg) {
+  assert(Idle(call));
+  for (const auto& section : msg->sections()) {
+    ShardStream* stream = streams_[section.shard()];
+    if (!stream->first())
+      continue;
+    if (!stream->first_sent())
+      stream->set_first_section(section);
+    call->first_shards.push_back(section.shard());
+  }
+  msg->set_streaming(streaming_);
+  call->stream->Write(*msg, call);
+  call->pending_requests++;
+  if (!call->first_shards.empty()) {
+    // Request a reply to the first sections
+    call->stream->Read(&call->ack, call);
+    call->pending_requests++;
+  }
+}
+
+bool WriteBatch::WriteBatchImpl::Idle(AsyncBatchCall* call) const {
+  return call->pending_requests == 0 && call->first_shards.empty();
+}
+
+void WriteBatch::WriteBatchImpl::Settle(AsyncBatchCall* call) {
   while (call->pending_requests > 0)
     QueueNext();
-  if (buffer->first()) {
-    if (buffer->read_requested()) {
-      if (buffer->ok() && !call->shutdown) {
-        // OK, set not first and stream normally
-        buffer->set_first(false);
-        buffer->Stream();
-        buffer->Clear();
-      } else {
-        // Not OK, update and stream the first buffer again
-        int node_id = db_->IndexForShard(buffer->shard(), true);
-        AsyncBatchCall* call = EnsureBatchCall(node_id);
-        buffer->set_call(call);
-        while (call->pending_requests > 0)
-          QueueNext();
-        buffer->RestreamFirstBuffer();
-        buffer->RequestRead();
-      }
-    } else {
-      // Stream the first buffer and request a response
-      buffer->Stream();
-      buffer->RequestRead();
-      buffer->Clear();
+  std::vector<int> shards;
+  shards.swap(call->first_shards);
+  const auto& rejected = call->ack.rejected();
+  std::unordered_map<AsyncBatchCall*, pb::BatchBuffer> msgs;
+  for (int shard : shards) {
+    ShardStream* stream = streams_[shard];
+    if (!call->shutdown &&
+        std::find(rejected.begin(), rejected.end(), shard) == rejected.end()) {
+      // OK, the next sections of the shard are streamed normally
+      stream->set_first(false);
+      continue;
     }
-  } else {
-    // Stream normally
-    buffer->Stream();
-    buffer->Clear();
+    // Not OK, update and stream the first section again
+    int node_id = db_->IndexForShard(shard, true);
+    stream->set_call(EnsureBatchCall(node_id));
+    *msgs[stream->call()].add_sections() = stream->first_section();
   }
+  call->ack.Clear();
+  for (auto& pair : msgs) {
+    while (!Idle(pair.first))
+      Settle(pair.first);
+    StreamOn(pair.first, &pair.second);
+  }
+}
+
+void WriteBatch::WriteBatchImpl::SettleAll() {
+  bool idle;
+  do {
+    idle = true;
+    // Settling may add calls
+    std::vector<AsyncBatchCall*> calls;
+    for (auto pair : calls_)
+      calls.push_back(pair.second);
+    for (AsyncBatchCall* call : calls) {
+      if (!Idle(call)) {
+        Settle(call);
+        idle = false;
+      }
+    }
+  } while (!idle);
 }
 
-void WriteBatch::WriteBatchImpl::DoWrite() {
-  // Fan-out the remaining buffers and the finish-RPC requests
-  for (Buffer* buffer : buffers_) {
-    if (buffer == nullptr)
+bool WriteBatch::WriteBatchImpl::WriteUnary(Status* status) {
+  if (sender_.joinable())
+    return false;
+  int node_id = -1;
+  for (const auto& pair : nodes_) {
+    if (pair.second.buffers.empty())
       continue;
-    assert(buffer->call() != nullptr);
-    if (buffer->updates_size() > 0)
-      Stream(buffer);
-    // assert(!buffer->first());
+    if (node_id != -1)
+      return false;
+    node_id = pair.first;
+  }
+  if (node_id == -1)
+    return false;
+  pb::BatchBuffer msg;
+  ReleaseNode(&nodes_[node_id], &msg);
+  *status = db_->NodeByIndex(node_id)->BatchWrite(msg);
+  if (status->grpc_code() == grpc::StatusCode::INVALID_ARGUMENT) {
+    Handoff(&msg);
+    return false;
   }
+  for (const auto& section : msg.sections())
+    db_->FlushCache(section.shard());
+  return true;
+}
+
+void WriteBatch::WriteBatchImpl::DoWrite(bool ordered) {
+  // Fan-out the remaining buffers and wait for the sender thread to stream
+  // them, after which we can use the calls from this thread. Then make
+  // sure that the nodes have got the first section of every shard.
+  for (auto& pair : nodes_)
+    if (!pair.second.buffers.empty())
+      HandoffNode(&pair.second);
+  Drain();
+  SettleAll();
+
+  // An ordered batch has got its status in reply to the commit
+  if (ordered)
+    Sequence();
 
   for (auto pair : calls_) {
     AsyncBatchCall* call = pair.second;
@@ -369,9 +517,12 @@ void WriteBatch::WriteBatchImpl::DoWrite() {
     while (call->pending_requests > 0)
       QueueNext();
     call->stream->WritesDone(call);
-    call->stream->Read(&call->response, call);
+    if (!ordered) {
+      call->stream->Read(&call->response, call);
+      call->pending_requests++;
+    }
     call->stream->Finish(&call->status, call);
-    call->pending_requests += 3;
+    call->pending_requests += 2;
   }
 
   // Make sure every server has responded
@@ -381,6 +532,39 @@ void WriteBatch::WriteBatchImpl::DoWrite() {
     while (call->pending_requests > 0)
       QueueNext();
   }
+
+  // The batch may have changed every shard that it has a buffer for
+  for (size_t shard = 0; shard < buffers_.size(); shard++)
+    if (buffers_[shard] != nullptr)
+      db_->FlushCache(shard);
+}
+
+void WriteBatch::WriteBatchImpl::Sequence() {
+  pb::BatchBuffer prepare;
+  prepare.set_prepare(true);
+  SendToAll(prepare);
+  uint64_t timestamp = 0;
+  for (auto pair : calls_)
+    timestamp = std::max(timestamp, pair.second->response.timestamp());
+  pb::BatchBuffer commit;
+  commit.set_timestamp(timestamp);
+  SendToAll(commit);
+}
+
+void WriteBatch::WriteBatchImpl::SendToAll(const pb::BatchBuffer& msg) {
+  for (auto pair : calls_) {
+    AsyncBatchCall* call = pair.second;
+    while (call->pending_requests > 0)
+      QueueNext();
+    if (call->shutdown)
+      continue;
+    call->stream->Write(msg, call);
+    call->stream->Read(&call->response, call);
+    call->pending_requests += 2;
+  }
+  for (auto pair : calls_)
+    while (pair.second->pending_requests > 0)
+      QueueNext();
 }
 
 Status WriteBatch::WriteBatchImpl::GetStatus() {
@@ -18,8 +18,12 @@
 #ifndef CROCKS_CLIENT_WRITE_BATCH_IMPL_H
 #define CROCKS_CLIENT_WRITE_BATCH_IMPL_H
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -27,14 +31,16 @@
 
 #include <crocks/status.h>
 #include <crocks/write_batch.h>
-#include "gen/crocks.pb.h"
+#include "gen/crocks.grpc.pb.h"
 
 namespace crocks {
 
 class Cluster;
 class ClusterImpl;
+class Node;
 
 struct AsyncBatchCall {
+  std::shared_ptr<Node> node;
   pb::Response response;
   grpc::ClientContext context;
   grpc::Status status;
@@ -42,40 +48,34 @@ struct AsyncBatchCall {
   std::unique_ptr<grpc::ClientAsyncReaderWriter<pb::BatchBuffer, pb::Response>>
       stream = nullptr;
   bool shutdown = false;
+  // Shards whose first section was in the last buffer sent on the call,
+  // and the reply of the node to it
+  std::vector<int> first_shards;
+  pb::Response ack;
 };
 
+// Updates to a single shard. They are appended to the section in the format
+// of rocksdb::WriteBatch::Data() as they come, so that streaming it does
+// not require an extra copy and the node can apply it as is.
 class Buffer {
  public:
   void AddPut(const std::string& key, const std::string& value);
   void AddDelete(const std::string& key);
   void AddSingleDelete(const std::string& key);
   void AddMerge(const std::string& key, const std::string& value);
-  void AddClear();
 
   void Clear();
 
-  void Stream();
-
-  // Resend the first buffer. The call must have been updated
-  // to the new master of the shard before calling this.
-  void RestreamFirstBuffer();
-
-  void RequestRead();
+  // Move the updates to section, ready to be streamed, and clear the buffer
+  void Release(pb::BatchSection* section);
 
   int updates_size() const {
-    return buffer_.updates_size();
+    return count_;
   }
 
+  // An upper bound of the serialized size, without serializing the section
   int ByteSize() const {
-    return byte_size_;
-  }
-
-  int RealByteSize() const {
-    return buffer_.ByteSize();
-  }
-
-  const pb::BatchBuffer& get() const {
-    return buffer_;
+    return section_.data().size() + kSectionOverhead;
   }
 
   int shard() const {
@@ -86,6 +86,36 @@ class Buffer {
     shard_ = shard;
   }
 
+  // The node that the shard was on when the buffer was created, used only
+  // to group the buffers into messages
+  int node() const {
+    return node_;
+  }
+
+  void set_node(int node) {
+    node_ = node;
+  }
+
+ private:
+  // Bytes of the section besides the data, i.e. the tags and lengths of its
+  // fields, and the shard
+  static const int kSectionOverhead = 16;
+
+  // Append a record with the given tag
+  void Add(char tag, const std::string& key);
+  void Add(char tag, const std::string& key, const std::string& value);
+
+  pb::BatchSection section_;
+  int count_ = 0;
+  int shard_;
+  int node_;
+};
+
+// The state of the stream of the sections of a single shard, which is only
+// touched by the sender thread of the batch.
+class ShardStream {
+ public:
+  // Until the node acknowledges the first section
   bool first() const {
     return first_;
   }
@@ -94,8 +124,19 @@ class Buffer {
     first_ = first;
   }
 
-  bool read_requested() const {
-    return read_requested_;
+  // We might need to send the first section again to another node
+  // if the master of the shard changed so we keep a copy of it.
+  bool first_sent() const {
+    return first_sent_;
+  }
+
+  const pb::BatchSection& first_section() const {
+    return first_section_;
+  }
+
+  void set_first_section(const pb::BatchSection& section) {
+    first_section_ = section;
+    first_sent_ = true;
   }
 
   void set_call(AsyncBatchCall* call) {
@@ -106,26 +147,30 @@ class Buffer {
     return call_;
   }
 
-  bool ok() const {
-    return response_.status() == 0;
-  }
-
  private:
-  pb::BatchBuffer buffer_;
-  // We might need to send the first buffer again to another node
-  // if the master of the shard changed so we keep a copy of it.
-  pb::BatchBuffer first_buffer_;
-  pb::Response response_;
-  int byte_size_ = 0;
-  int shard_;
+  pb::BatchSection first_section_;
   bool first_ = true;
-  bool read_requested_ = false;
+  bool first_sent_ = false;
   AsyncBatchCall* call_ = nullptr;
 };
 
+// The updates buffered for a single node
+struct NodeBuffers {
+  std::vector<Buffer*> buffers;
+  int bytes = 0;
+};
+
+// Put() and the rest only append to the buffer of the shard of the key. Once
+// the buffers of the shards of a node exceed threshold_low bytes, they are
+// handed off to a sender thread as a single message, which it streams to the
+// node. The caller blocks only while more than threshold_high bytes are
+// waiting to be streamed.
 class WriteBatch::WriteBatchImpl {
  public:
-  WriteBatchImpl(Cluster* db, int threshold_low, int threshold_high);
+  // If streaming is true, the nodes write each message as they get it, and
+  // Write() only waits for them (see StreamingWriter)
+  WriteBatchImpl(Cluster* db, int threshold_low, int threshold_high,
+                 bool streaming = false);
   ~WriteBatchImpl();
 
   void Put(const std::string& key, const std::string& value);
@@ -139,19 +184,69 @@ class WriteBatch::WriteBatchImpl {
  private:
   AsyncBatchCall* EnsureBatchCall(int id);
   Buffer* EnsureBuffer(int shard);
+  ShardStream* EnsureStream(int shard);
   void QueueNext();
-  bool QueueAsyncNext();
-  void StreamIfExceededThreshold(int shard);
-  void Stream(Buffer* buffer);
-  void DoWrite();
+  // Account for the bytes added to buffer, and hand off the buffers of its
+  // node if they exceed the low threshold
+  void Added(Buffer* buffer, int bytes_before);
+  // Queue the buffers of a node for the sender thread
+  void HandoffNode(NodeBuffers* node);
+  // Move the buffers of a node to the sections of msg
+  void ReleaseNode(NodeBuffers* node, pb::BatchBuffer* msg);
+  void Handoff(pb::BatchBuffer* msg);
+  // Wait until the sender thread has streamed every queued message
+  void Drain();
+  // Run by sender_
+  void Send();
+  void Stream(pb::BatchBuffer* msg);
+  // Write msg on call, which must be idle, requesting a reply if it has
+  // the first section of a shard
+  void StreamOn(AsyncBatchCall* call, pb::BatchBuffer* msg);
+  bool Idle(AsyncBatchCall* call) const;
+  // Wait for the pending requests of call, and handle the reply to its
+  // last buffer, sending the first sections of the shards that the node
+  // rejected to their new masters
+  void Settle(AsyncBatchCall* call);
+  void SettleAll();
+  // If nothing has been handed off yet and the buffers are all on the same
+  // node, write them with a single BatchWrite request, store its status in
+  // *status and return true. If the node does not hold one of the shards,
+  // hand them off and return false, so that the batch is streamed instead.
+  bool WriteUnary(Status* status);
+  // If ordered is true, sequence the batch before committing it
+  void DoWrite(bool ordered);
+  // Agree with the nodes of the batch on its timestamp and commit it
+  // (see src/server/sequencer.h)
+  void Sequence();
+  // Send msg on every call and request a response
+  void SendToAll(const pb::BatchBuffer& msg);
   Status GetStatus();
 
   ClusterImpl* db_;
-  grpc::CompletionQueue cq_;
-  std::unordered_map<int, AsyncBatchCall*> calls_;
-  std::vector<Buffer*> buffers_;
   int threshold_low_;
   int threshold_high_;
+  bool streaming_;
+  // Filled by the thread of the caller
+  std::vector<Buffer*> buffers_;
+  std::unordered_map<int, NodeBuffers> nodes_;
+
+  // Touched only by the sender thread, or by the thread of the caller
+  // after Drain(), while the sender thread waits for more messages.
+  grpc::CompletionQueue cq_;
+  std::unordered_map<int, AsyncBatchCall*> calls_;
+  std::vector<ShardStream*> streams_;
+
+  std::thread sender_;
+  std::mutex mutex_;
+  // Signaled when messages are queued, and when the batch is destroyed
+  std::condition_variable queued_cv_;
+  // Signaled when a queued message has been streamed
+  std::condition_variable sent_cv_;
+  std::deque<pb::BatchBuffer> queue_;
+  // Bytes of the messages that are queued or being streamed
+  size_t pending_bytes_ = 0;
+  bool sending_ = false;
+  bool shutdown_ = false;
 };
 
 }  // namespace crocks
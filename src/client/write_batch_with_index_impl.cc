@@ -0,0 +1,194 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#include "src/client/write_batch_with_index_impl.h"
+
+#include <crocks/cluster.h>
+#include "src/client/cluster_impl.h"
+
+namespace crocks {
+
+namespace {
+
+// The same as the defaults of WriteBatch
+const int kThresholdLow = 64 * 1024;
+const int kThresholdHigh = 4 * 1024 * 1024;
+
+}  // namespace
+
+// WriteBatchWithIndexImpl wrapper
+WriteBatchWithIndex::WriteBatchWithIndex(Cluster* db)
+    : impl_(new WriteBatchWithIndexImpl(db)) {}
+
+WriteBatchWithIndex::~WriteBatchWithIndex() {
+  delete impl_;
+}
+
+void WriteBatchWithIndex::Put(const std::string& key,
+                              const std::string& value) {
+  impl_->Put(key, value);
+}
+
+void WriteBatchWithIndex::Delete(const std::string& key) {
+  impl_->Delete(key);
+}
+
+void WriteBatchWithIndex::SingleDelete(const std::string& key) {
+  impl_->SingleDelete(key);
+}
+
+void WriteBatchWithIndex::Merge(const std::string& key,
+                                const std::string& value) {
+  impl_->Merge(key, value);
+}
+
+void WriteBatchWithIndex::Clear() {
+  impl_->Clear();
+}
+
+Status WriteBatchWithIndex::Write() {
+  return impl_->Write();
+}
+
+Status WriteBatchWithIndex::WriteWithLock() {
+  return impl_->WriteWithLock();
+}
+
+Status WriteBatchWithIndex::GetFromBatch(const std::string& key,
+                                         std::string* value) {
+  return impl_->GetFromBatch(key, value);
+}
+
+Status WriteBatchWithIndex::GetFromBatchAndCluster(const std::string& key,
+                                                   std::string* value) {
+  return impl_->GetFromBatchAndCluster(key, value);
+}
+
+// Write batch with index implementation
+WriteBatchWithIndex::WriteBatchWithIndexImpl::WriteBatchWithIndexImpl(
+    Cluster* db)
+    : db_(db), cluster_(db->get()), index_(cluster_->num_shards()) {}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::Put(
+    const std::string& key, const std::string& value) {
+  Batch()->Put(key, value);
+  Index(key, pb::BatchUpdate::PUT, value);
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::Delete(
+    const std::string& key) {
+  Batch()->Delete(key);
+  Index(key, pb::BatchUpdate::DELETE);
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::SingleDelete(
+    const std::string& key) {
+  Batch()->SingleDelete(key);
+  Index(key, pb::BatchUpdate::SINGLE_DELETE);
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::Merge(
+    const std::string& key, const std::string& value) {
+  Batch()->Merge(key, value);
+  Index(key, pb::BatchUpdate::MERGE, value);
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::Clear() {
+  if (batch_)
+    batch_->Clear();
+  ClearIndex();
+}
+
+Status WriteBatchWithIndex::WriteBatchWithIndexImpl::Write() {
+  Status status = Batch()->Write();
+  batch_.reset();
+  ClearIndex();
+  return status;
+}
+
+Status WriteBatchWithIndex::WriteBatchWithIndexImpl::WriteWithLock() {
+  Status status = Batch()->WriteWithLock();
+  batch_.reset();
+  ClearIndex();
+  return status;
+}
+
+Status WriteBatchWithIndex::WriteBatchWithIndexImpl::GetFromBatch(
+    const std::string& key, std::string* value) {
+  Status status;
+  if (!Lookup(key, value, &status))
+    return Status(rocksdb::NOT_FOUND);
+  return status;
+}
+
+Status WriteBatchWithIndex::WriteBatchWithIndexImpl::GetFromBatchAndCluster(
+    const std::string& key, std::string* value) {
+  Status status;
+  if (!Lookup(key, value, &status))
+    return db_->Get(key, value);
+  return status;
+}
+
+// private
+WriteBatch::WriteBatchImpl* WriteBatchWithIndex::WriteBatchWithIndexImpl::
+    Batch() {
+  if (!batch_)
+    batch_.reset(
+        new WriteBatch::WriteBatchImpl(db_, kThresholdLow, kThresholdHigh));
+  return batch_.get();
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::Index(
+    const std::string& key, pb::BatchUpdate::Operation op,
+    const std::string& value) {
+  int shard = cluster_->ShardForKey(key);
+  std::map<std::string, pb::BatchUpdate>& updates = index_[shard];
+  if (updates.empty())
+    indexed_.push_back(shard);
+  pb::BatchUpdate& update = updates[key];
+  update.set_op(op);
+  update.set_value(value);
+}
+
+bool WriteBatchWithIndex::WriteBatchWithIndexImpl::Lookup(
+    const std::string& key, std::string* value, Status* status) {
+  const std::map<std::string, pb::BatchUpdate>& updates =
+      index_[cluster_->ShardForKey(key)];
+  auto it = updates.find(key);
+  if (it == updates.end())
+    return false;
+  switch (it->second.op()) {
+    case pb::BatchUpdate::PUT:
+      *value = it->second.value();
+      *status = Status();
+      break;
+    case pb::BatchUpdate::MERGE:
+      *status = Status(rocksdb::MERGE_IN_PROGRESS);
+      break;
+    default:
+      *status = Status(rocksdb::NOT_FOUND);
+      break;
+  }
+  return true;
+}
+
+void WriteBatchWithIndex::WriteBatchWithIndexImpl::ClearIndex() {
+  for (int shard : indexed_)
+    index_[shard].clear();
+  indexed_.clear();
+}
+
+}  // namespace crocks
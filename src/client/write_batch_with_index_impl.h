@@ -0,0 +1,74 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef CROCKS_CLIENT_WRITE_BATCH_WITH_INDEX_IMPL_H
+#define CROCKS_CLIENT_WRITE_BATCH_WITH_INDEX_IMPL_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <crocks/status.h>
+#include <crocks/write_batch.h>
+#include <crocks/write_batch_with_index.h>
+#include "gen/crocks.pb.h"
+#include "src/client/write_batch_impl.h"
+
+namespace crocks {
+
+class Cluster;
+class ClusterImpl;
+
+class WriteBatchWithIndex::WriteBatchWithIndexImpl {
+ public:
+  explicit WriteBatchWithIndexImpl(Cluster* db);
+
+  void Put(const std::string& key, const std::string& value);
+  void Delete(const std::string& key);
+  void SingleDelete(const std::string& key);
+  void Merge(const std::string& key, const std::string& value);
+  void Clear();
+  Status Write();
+  Status WriteWithLock();
+  Status GetFromBatch(const std::string& key, std::string* value);
+  Status GetFromBatchAndCluster(const std::string& key, std::string* value);
+
+ private:
+  // Return the batch, starting a new one if the last one has been written
+  WriteBatch::WriteBatchImpl* Batch();
+  // Record update as the last one of key
+  void Index(const std::string& key, pb::BatchUpdate::Operation op,
+             const std::string& value = "");
+  // Look key up in the index. Return false if the batch has no update of
+  // it, else true and its status in *status.
+  bool Lookup(const std::string& key, std::string* value, Status* status);
+  void ClearIndex();
+
+  Cluster* db_;
+  ClusterImpl* cluster_;
+  // A WriteBatchImpl is not reused after Write()
+  std::unique_ptr<WriteBatch::WriteBatchImpl> batch_;
+  // The last update of each key, by shard. Only the op and the value of the
+  // updates are set.
+  std::vector<std::map<std::string, pb::BatchUpdate>> index_;
+  // The shards that have entries in index_
+  std::vector<int> indexed_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_CLIENT_WRITE_BATCH_WITH_INDEX_IMPL_H
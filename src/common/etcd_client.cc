@@ -120,7 +120,8 @@ bool EtcdClient::TxnPutIfKeyMissing(const std::string& key,
   return response.succeeded();
 }
 
-void* EtcdClient::Watch(const std::string& key, std::string* value) {
+void* EtcdClient::Watch(const std::string& key, std::string* value,
+                        int* revision) {
   WatchCall* call = new WatchCall;
   call->context =
       std::unique_ptr<grpc::ClientContext>(new grpc::ClientContext());
@@ -128,8 +129,10 @@ void* EtcdClient::Watch(const std::string& key, std::string* value) {
   // Make sure we have the latest update, and instruct etcd to
   // send updates starting from the last revision exclusive, so
   // that we don't miss any updates that took place in-between.
-  int revision = Get(key, value);
-  WatchKeyRequest(key, revision + 1, &call->request);
+  int last_revision = Get(key, value);
+  if (revision != nullptr)
+    *revision = last_revision;
+  WatchKeyRequest(key, last_revision + 1, &call->request);
   call->stream->Write(call->request);
   call->stream->Read(&call->response);
   assert(call->response.created());
@@ -137,7 +140,7 @@ void* EtcdClient::Watch(const std::string& key, std::string* value) {
   return call;
 }
 
-bool EtcdClient::WatchNext(void* _call, std::string* value) {
+bool EtcdClient::WatchNext(void* _call, std::string* value, int* revision) {
   WatchCall* call = static_cast<WatchCall*>(_call);
   if (!call->stream->Read(&call->response)) {
     grpc::Status status = call->stream->Finish();
@@ -158,6 +161,8 @@ bool EtcdClient::WatchNext(void* _call, std::string* value) {
   int size = call->response.events_size();
   const auto& event = call->response.events(size - 1);
   *value = event.kv().value();
+  if (revision != nullptr)
+    *revision = event.kv().mod_revision();
   return false;
 }
 
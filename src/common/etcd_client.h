@@ -61,11 +61,14 @@ class EtcdClient {
   // it from the next revision. Return a pointer to the WatchCall
   // instance associated with that call (cast as void*), which
   // will need to be provided for getting updates and canceling.
-  void* Watch(const std::string& key, std::string* value);
+  // If revision is given, the revision of the value is stored there.
+  void* Watch(const std::string& key, std::string* value,
+              int* revision = nullptr);
 
   // Wait for a response and return true if it responds to a cancel
-  // request. If not, store the value of the key being watched in *value.
-  bool WatchNext(void* call, std::string* value);
+  // request. If not, store the value of the key being watched in *value,
+  // and its revision in *revision if given.
+  bool WatchNext(void* call, std::string* value, int* revision = nullptr);
 
   // Send a request to cancel the watch call. After canceling,
   // WatchNext should be called until it returns true. This must happen
@@ -23,6 +23,13 @@ inline uint32_t Hash(const std::string& string) {
   return MurmurHash(string.c_str(), string.size(), 0xACABACAB);
 }
 
+// Used to tell if a value has changed, where 32 bits are too few
+inline uint64_t Hash64(const std::string& string) {
+  uint64_t high = MurmurHash(string.c_str(), string.size(), 0xACABACAB);
+  uint64_t low = MurmurHash(string.c_str(), string.size(), 0x5EED5EED);
+  return (high << 32) | low;
+}
+
 }  // namespace crocks
 
 #endif  // CROCKS_COMMON_HASH_H
@@ -67,16 +67,17 @@ Info::Info(const std::string& address) : etcd_(address) {}
 
 void Info::Get() {
   std::string info;
-  etcd_.Get(kInfoKey, &info);
-  Parse(info);
+  int revision = etcd_.Get(kInfoKey, &info);
+  Parse(info, revision);
 }
 
-void Info::Add(const std::string& address, int num_shards) {
+void Info::Add(const std::string& address, int num_shards, double weight) {
   bool succeeded;
   do {
     std::string old_info;
-    if (etcd_.Get(kInfoKey, &old_info)) {
-      Parse(old_info);
+    int revision = etcd_.Get(kInfoKey, &old_info);
+    if (revision) {
+      Parse(old_info, revision);
       int id = info_.IndexOf(address);
       if (id >= 0) {
         if (info_.IsAvailable(id)) {
@@ -87,10 +88,12 @@ void Info::Add(const std::string& address, int num_shards) {
           exit(EXIT_FAILURE);
         }
         id_ = id;
+        if (weight > 0)
+          info_.SetWeight(id, weight);
       } else if (info_.IsInit()) {
-        id_ = info_.AddNodeWithNewShards(address, num_shards);
+        id_ = info_.AddNodeWithNewShards(address, num_shards, weight);
       } else if (info_.IsRunning()) {
-        id_ = info_.AddNode(address);
+        id_ = info_.AddNode(address, weight);
       } else if (info_.IsMigrating()) {
         std::cout << "Migrating. Try again later." << std::endl;
         exit(EXIT_FAILURE);
@@ -98,7 +101,7 @@ void Info::Add(const std::string& address, int num_shards) {
       succeeded =
           etcd_.TxnPutIfValueEquals(kInfoKey, info_.Serialize(), old_info);
     } else {
-      id_ = info_.AddNodeWithNewShards(address, num_shards);
+      id_ = info_.AddNodeWithNewShards(address, num_shards, weight);
       succeeded = etcd_.TxnPutIfKeyMissing(kInfoKey, info_.Serialize());
     }
   } while (!succeeded);
@@ -136,9 +139,10 @@ void Info::Run() {
   bool succeeded;
   do {
     std::string old_info;
-    if (!etcd_.Get(kInfoKey, &old_info))
+    int revision = etcd_.Get(kInfoKey, &old_info);
+    if (!revision)
       return;
-    Parse(old_info);
+    Parse(old_info, revision);
     if (IsRunning() || !NoMigrations())
       return;
     info_.SetRunning();
@@ -151,9 +155,10 @@ void Info::Migrate() {
   bool succeeded;
   do {
     std::string old_info;
-    if (!etcd_.Get(kInfoKey, &old_info))
+    int revision = etcd_.Get(kInfoKey, &old_info);
+    if (!revision)
       return;
-    Parse(old_info);
+    Parse(old_info, revision);
     info_.RedistributeShards();
     if (info_.NoMigrations()) {
       std::cout << "There was nothing to migrate" << std::endl;
@@ -165,18 +170,47 @@ void Info::Migrate() {
   } while (!succeeded);
 }
 
+std::vector<ShardMove> Info::Rebalance(const std::vector<double>& loads,
+                                       const std::vector<uint64_t>& sizes,
+                                       int max_moves, uint64_t max_bytes,
+                                       bool dry_run) {
+  std::vector<ShardMove> moves;
+  bool succeeded;
+  do {
+    std::string old_info;
+    int revision = etcd_.Get(kInfoKey, &old_info);
+    if (!revision)
+      return moves;
+    Parse(old_info, revision);
+    if (!IsRunning() || !NoMigrations()) {
+      std::cout << "The cluster is not running" << std::endl;
+      moves.clear();
+      return moves;
+    }
+    moves = info_.RebalanceShards(loads, sizes, max_moves, max_bytes);
+    if (moves.empty() || dry_run)
+      return moves;
+    info_.SetMigrating();
+    succeeded =
+        etcd_.TxnPutIfValueEquals(kInfoKey, info_.Serialize(), old_info);
+  } while (!succeeded);
+  return moves;
+}
+
 void* Info::Watch() {
   std::string info;
-  void* call = etcd_.Watch(kInfoKey, &info);
-  Parse(info);
+  int revision;
+  void* call = etcd_.Watch(kInfoKey, &info, &revision);
+  Parse(info, revision);
   return call;
 }
 
 bool Info::WatchNext(void* call) {
   std::string info;
-  bool canceled = etcd_.WatchNext(call, &info);
+  int revision;
+  bool canceled = etcd_.WatchNext(call, &info, &revision);
   if (!canceled)
-    Parse(info);
+    Parse(info, revision);
   return canceled;
 }
 
@@ -252,6 +286,8 @@ void Info::Print() {
       continue;
     std::cout << "node " << i << ":" << std::endl;
     std::cout << "  address: " << address << std::endl;
+    if (info_.Weight(i) != 1)
+      std::cout << "  weight: " << info_.Weight(i) << std::endl;
     auto shards = info_.shards(i);
     if (shards.size() > 0)
       std::cout << "  shards: " << ListToString(shards) << " (" << shards.size()
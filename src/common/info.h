@@ -20,6 +20,8 @@
 #ifndef CROCKS_COMMON_INFO_H
 #define CROCKS_COMMON_INFO_H
 
+#include <stdint.h>
+
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -54,6 +56,14 @@ class Info {
     return map_[id];
   }
 
+  // Same as above, but also store in *revision the etcd
+  // revision of the cluster info that the answer is based on
+  int IndexForShard(int id, int* revision) {
+    read_lock lock(mutex_);
+    *revision = revision_;
+    return map_[id];
+  }
+
   int ShardForKey(const std::string& key) {
     return Hash(key) % info_.num_shards();
   }
@@ -73,6 +83,18 @@ class Info {
     return info_.Addresses();
   };
 
+  std::vector<int> map() const {
+    read_lock lock(mutex_);
+    return map_;
+  }
+
+  // The etcd revision of the cluster info, as of the last time
+  // it was read from etcd. Zero if the info was never read.
+  int revision() const {
+    read_lock lock(mutex_);
+    return revision_;
+  }
+
   std::string Address(int id) const {
     return info_.Address(id);
   };
@@ -83,9 +105,11 @@ class Info {
 
   void Get();
 
-  // Add a node with the given address and send the updated cluster
-  // info to etcd, repeating the transaction until succeeded.
-  void Add(const std::string& address, int num_shards);
+  // Add a node with the given address and weight and send the updated
+  // cluster info to etcd, repeating the transaction until succeeded. A
+  // weight of 0 keeps the weight of a node that is coming back, and
+  // counts as 1 for a new one.
+  void Add(const std::string& address, int num_shards, double weight);
 
   void Remove(int id);
 
@@ -97,6 +121,14 @@ class Info {
   // Change cluster state to MIGRATING
   void Migrate();
 
+  // Move shards between nodes to even out the given loads, as planned by
+  // InfoWrapper::RebalanceShards(), and change cluster state to MIGRATING.
+  // With dry_run set, only return the planned moves and change nothing.
+  std::vector<ShardMove> Rebalance(const std::vector<double>& loads,
+                                   const std::vector<uint64_t>& sizes,
+                                   int max_moves, uint64_t max_bytes,
+                                   bool dry_run);
+
   bool IsInit() const {
     return info_.IsInit();
   }
@@ -149,16 +181,19 @@ class Info {
   void WaitUntilHealthy();
 
  private:
-  void Parse(const std::string& str) {
+  // Parse the cluster info as read from etcd at the given revision
+  void Parse(const std::string& str, int revision) {
     write_lock lock(mutex_);
     info_.Parse(str);
     map_ = info_.map();
+    revision_ = revision;
   }
 
   mutable shared_mutex mutex_;
   EtcdClient etcd_;
   InfoWrapper info_;
   std::vector<int> map_;
+  int revision_ = 0;
   std::string address_;
   int id_ = -1;
 };
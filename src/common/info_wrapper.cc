@@ -17,6 +17,8 @@
 
 #include "src/common/info_wrapper.h"
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 namespace crocks {
@@ -32,18 +34,19 @@ bool InfoWrapper::IsHealthy() const {
   return true;
 }
 
-int InfoWrapper::AddNode(const std::string& address) {
+int InfoWrapper::AddNode(const std::string& address, double weight) {
   write_lock lock(mutex_);
   int id = info_.nodes_size();
   pb::NodeInfo* node = info_.add_nodes();
   node->set_address(address);
   node->set_id(id);
   node->set_available(true);
+  node->set_weight(weight);
   return id;
 }
 
 int InfoWrapper::AddNodeWithNewShards(const std::string& address,
-                                      int num_shards) {
+                                      int num_shards, double weight) {
   write_lock lock(mutex_);
   int id = info_.nodes_size();
   pb::NodeInfo* node = info_.add_nodes();
@@ -51,6 +54,7 @@ int InfoWrapper::AddNodeWithNewShards(const std::string& address,
   node->set_id(id);
   node->set_num_shards(num_shards);
   node->set_available(true);
+  node->set_weight(weight);
   for (int i = 0; i < num_shards; i++) {
     pb::ShardInfo* shard = info_.add_shards();
     shard->set_master(id);
@@ -66,6 +70,11 @@ void InfoWrapper::MarkRemoveNode(int id) {
   node->set_remove(true);
 }
 
+void InfoWrapper::SetWeight(int id, double weight) {
+  write_lock lock(mutex_);
+  info_.mutable_nodes(id)->set_weight(weight);
+}
+
 void InfoWrapper::RemoveNode(int id) {
   write_lock lock(mutex_);
   info_.mutable_nodes(id)->Clear();
@@ -73,22 +82,23 @@ void InfoWrapper::RemoveNode(int id) {
 
 void InfoWrapper::RedistributeShards() {
   write_lock lock(mutex_);
-  int num_nodes = 0;
+  double total_weight = 0;
   for (const auto& node : info_.nodes())
     if (!node.remove() && !node.address().empty())
-      num_nodes++;
+      total_weight += NodeWeight(node);
   int num_shards = info_.shards_size();
 
   // Calculate diffs
   // Positive diff: the node has diff shards to give
   // Negative diff: the node has -diff shards to get
   std::unordered_map<int, int> diffs;
-  // Removed nodes get 0 shards. For the rest, each pair must have the same
-  // number of shards, or a difference of one shard. Let s be the number of
-  // shards and n the number of nodes. Each node will be assigned either s/n
-  // or s/n+1 shards and all shards will have to add up to s. We achieve
-  // that by giving the first s%n nodes s/n+1 shards and the rest just s/n.
-  int i = 0;
+  // Removed nodes get 0 shards. For the rest, let s be the number of shards
+  // and w/W the share of the total weight of a node. Each node is assigned
+  // the integer part of s*w/W, and the shards that are left go to the nodes
+  // with the largest fractional parts. Ties are broken in favor of the nodes
+  // that have the most shards above their target, so fewer shards move.
+  std::vector<std::pair<double, int>> remainders;
+  int assigned = 0;
   for (const auto& node : info_.nodes()) {
     if (node.address().empty())
       continue;
@@ -96,32 +106,136 @@ void InfoWrapper::RedistributeShards() {
       diffs[node.id()] = node.num_shards();
       continue;
     }
-    int target = num_shards / num_nodes;
-    if (i < num_shards % num_nodes)
-      target++;
+    double share = num_shards * NodeWeight(node) / total_weight;
+    int target = static_cast<int>(share);
     diffs[node.id()] = node.num_shards() - target;
-    i++;
+    assigned += target;
+    remainders.emplace_back(share - target, node.id());
   }
+  std::sort(remainders.begin(), remainders.end(),
+            [&](const std::pair<double, int>& a,
+                const std::pair<double, int>& b) {
+              if (a.first != b.first)
+                return a.first > b.first;
+              if (diffs[a.second] != diffs[b.second])
+                return diffs[a.second] > diffs[b.second];
+              return a.second < b.second;
+            });
+  for (int i = 0; i < num_shards - assigned; i++)
+    diffs[remainders[i].second]--;
 
-  i = 0;
-  for (const auto& node : info_.nodes()) {
-    int id = node.id();
-    while (diffs[id] < 0) {
-      pb::ShardInfo* shard = info_.mutable_shards(i);
-      if (diffs[shard->master()] > 0) {
-        shard->set_migrating(true);
-        shard->set_from(shard->master());
-        shard->set_to(id);
-        diffs[id]++;
-        diffs[shard->master()]--;
-      }
-      i++;
-    }
+  // Only the shards above the target of each node are moved. Each of them
+  // goes to the node that lacks the most shards at the time, so that the
+  // nodes that receive shards import them from as many nodes as possible.
+  for (auto& shard : *info_.mutable_shards()) {
+    int from = shard.master();
+    if (diffs[from] <= 0)
+      continue;
+    int to = -1;
+    for (const auto& pair : diffs)
+      if (pair.second < 0 &&
+          (to < 0 || pair.second < diffs[to] ||
+           (pair.second == diffs[to] && pair.first < to)))
+        to = pair.first;
+    assert(to >= 0);
+    shard.set_migrating(true);
+    shard.set_from(from);
+    shard.set_to(to);
+    diffs[to]++;
+    diffs[from]--;
   }
   for (auto pair : diffs)
     assert(pair.second == 0);
 }
 
+// Moves that bring two nodes closer by less than this fraction of the
+// average node load are not worth the data that they have to move.
+const double kMinImprovement = 0.05;
+
+std::vector<ShardMove> InfoWrapper::RebalanceShards(
+    const std::vector<double>& loads, const std::vector<uint64_t>& sizes,
+    int max_moves, uint64_t max_bytes) {
+  write_lock lock(mutex_);
+  assert(loads.size() == static_cast<size_t>(info_.shards_size()));
+  assert(sizes.size() == loads.size());
+  std::vector<ShardMove> moves;
+
+  // Shards are only moved between nodes that are not being removed
+  std::unordered_map<int, double> node_loads;
+  std::unordered_map<int, double> weights;
+  double total_weight = 0;
+  for (const auto& node : info_.nodes()) {
+    if (!node.remove() && !node.address().empty()) {
+      node_loads[node.id()] = 0;
+      weights[node.id()] = NodeWeight(node);
+      total_weight += NodeWeight(node);
+    }
+  }
+  if (node_loads.size() < 2)
+    return moves;
+  double total = 0;
+  for (int i = 0; i < info_.shards_size(); i++) {
+    auto it = node_loads.find(info_.shards(i).master());
+    if (it == node_loads.end())
+      continue;
+    it->second += loads[i];
+    total += loads[i];
+  }
+  // Loads are compared relative to the weights of the nodes
+  auto relative = [&](int id) { return node_loads[id] / weights[id]; };
+  double threshold = kMinImprovement * total / total_weight;
+
+  uint64_t bytes = 0;
+  while (static_cast<int>(moves.size()) < max_moves) {
+    int hot = node_loads.begin()->first;
+    int cold = hot;
+    for (const auto& pair : node_loads) {
+      if (relative(pair.first) > relative(hot))
+        hot = pair.first;
+      if (relative(pair.first) < relative(cold))
+        cold = pair.first;
+    }
+    double gap = relative(hot) - relative(cold);
+    double factor = 1 / weights[hot] + 1 / weights[cold];
+
+    // Moving a shard with load l from the hottest to the coldest node turns
+    // the gap between them into |gap - l * (1/w_hot + 1/w_cold)|. Of the
+    // shards that improve it the most, move the one with the least data.
+    std::vector<bool> eligible(info_.shards_size(), false);
+    std::vector<double> improvements(info_.shards_size(), 0);
+    double best = 0;
+    for (int i = 0; i < info_.shards_size(); i++) {
+      const pb::ShardInfo& shard = info_.shards(i);
+      if (shard.master() != hot || shard.migrating())
+        continue;
+      if (max_bytes > 0 && bytes + sizes[i] > max_bytes)
+        continue;
+      eligible[i] = true;
+      improvements[i] = gap - std::abs(gap - factor * loads[i]);
+      best = std::max(best, improvements[i]);
+    }
+    // With no load at all, the threshold is 0 too
+    if (best <= 0 || best < threshold)
+      break;
+    int chosen = -1;
+    for (int i = 0; i < info_.shards_size(); i++)
+      if (eligible[i] && improvements[i] >= best / 2 &&
+          (chosen < 0 || sizes[i] < sizes[chosen]))
+        chosen = i;
+    assert(chosen >= 0);
+
+    pb::ShardInfo* shard = info_.mutable_shards(chosen);
+    shard->set_migrating(true);
+    shard->set_from(hot);
+    shard->set_to(cold);
+    node_loads[hot] -= loads[chosen];
+    node_loads[cold] += loads[chosen];
+    bytes += sizes[chosen];
+    moves.push_back(ShardMove{chosen, hot, cold});
+  }
+  return moves;
+}
+
 std::unordered_map<int, std::vector<int>> InfoWrapper::Tasks(int id) const {
   read_lock lock(mutex_);
   std::unordered_map<int, std::vector<int>> tasks;
@@ -22,6 +22,7 @@
 #define CROCKS_COMMON_INFO_WRAPPER_H
 
 #include <assert.h>
+#include <stdint.h>
 
 #include <string>
 #include <unordered_map>
@@ -32,6 +33,13 @@
 
 namespace crocks {
 
+// A shard to be moved from one node to another
+struct ShardMove {
+  int shard;
+  int from;
+  int to;
+};
+
 class InfoWrapper {
  public:
   int num_shards() const {
@@ -163,16 +171,34 @@ class InfoWrapper {
     info_.set_state(pb::ClusterInfo::MIGRATING);
   }
 
-  int AddNode(const std::string& address);
+  int AddNode(const std::string& address, double weight);
+
+  int AddNodeWithNewShards(const std::string& address, int num_shards,
+                           double weight);
 
-  int AddNodeWithNewShards(const std::string& address, int num_shards);
+  void SetWeight(int id, double weight);
+
+  double Weight(int id) const {
+    read_lock lock(mutex_);
+    return NodeWeight(info_.nodes(id));
+  }
 
   void MarkRemoveNode(int id);
 
   void RemoveNode(int id);
 
+  // Assign shards to nodes in proportion to their weights,
+  // and mark the ones that have to be moved as migrating.
   void RedistributeShards();
 
+  // Mark shards as migrating from the most to the least loaded nodes, until
+  // the load is even or the limits are reached, and return the moves. The
+  // load of each shard is given by loads and the data that moving it takes
+  // by sizes. A max_bytes of 0 means that the data moved is not limited.
+  std::vector<ShardMove> RebalanceShards(const std::vector<double>& loads,
+                                         const std::vector<uint64_t>& sizes,
+                                         int max_moves, uint64_t max_bytes);
+
   std::unordered_map<int, std::vector<int>> Tasks(int id) const;
 
   void GiveShard(int id, int shard);
@@ -182,6 +208,10 @@ class InfoWrapper {
   void SetAvailable(int id, bool available);
 
  private:
+  static double NodeWeight(const pb::NodeInfo& node) {
+    return node.weight() > 0 ? node.weight() : 1;
+  }
+
   pb::ClusterInfo info_;
   mutable shared_mutex mutex_;
 };
@@ -0,0 +1,47 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/common/routing_hint.h"
+
+#include <map>
+
+namespace crocks {
+
+void SetRoutingHint(grpc::ServerContext* context, const RoutingHint& hint) {
+  context->AddTrailingMetadata(kHintMasterKey, std::to_string(hint.master));
+  context->AddTrailingMetadata(kHintAddressKey, hint.address);
+  context->AddTrailingMetadata(kHintRevisionKey,
+                               std::to_string(hint.revision));
+}
+
+void GetRoutingHint(const grpc::ClientContext& context, RoutingHint* hint) {
+  *hint = RoutingHint();
+  const auto& metadata = context.GetServerTrailingMetadata();
+  auto master = metadata.find(kHintMasterKey);
+  auto address = metadata.find(kHintAddressKey);
+  auto revision = metadata.find(kHintRevisionKey);
+  if (master == metadata.end() || address == metadata.end() ||
+      revision == metadata.end())
+    return;
+  hint->address.assign(address->second.data(), address->second.size());
+  hint->revision = std::stoi(
+      std::string(revision->second.data(), revision->second.size()));
+  hint->master =
+      std::stoi(std::string(master->second.data(), master->second.size()));
+}
+
+}  // namespace crocks
@@ -0,0 +1,56 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// When a node rejects a request for a shard that he does not serve, he
+// attaches to the trailing metadata the node that the shard belongs to
+// according to his latest cluster info, and the etcd revision of that info.
+// This lets the client retry right away, without asking etcd.
+
+#ifndef CROCKS_COMMON_ROUTING_HINT_H
+#define CROCKS_COMMON_ROUTING_HINT_H
+
+#include <string>
+
+#include <grpc++/grpc++.h>
+
+namespace crocks {
+
+const std::string kHintMasterKey = "crocks-master";
+const std::string kHintAddressKey = "crocks-address";
+const std::string kHintRevisionKey = "crocks-revision";
+
+struct RoutingHint {
+  bool valid() const {
+    return master >= 0;
+  }
+
+  int master = -1;
+  std::string address;
+  int revision = 0;
+};
+
+// Attach the hint to the trailing metadata of the call. Must
+// be called before the call is finished.
+void SetRoutingHint(grpc::ServerContext* context, const RoutingHint& hint);
+
+// Store in *hint the hint that the node attached to the finished call.
+// If there was none, hint->valid() returns false.
+void GetRoutingHint(const grpc::ClientContext& context, RoutingHint* hint);
+
+}  // namespace crocks
+
+#endif  // CROCKS_COMMON_ROUTING_HINT_H
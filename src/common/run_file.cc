@@ -0,0 +1,128 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/common/run_file.h"
+
+namespace crocks {
+
+RunWriter::RunWriter(const std::string& filename)
+    : out_(filename, std::ofstream::binary) {}
+
+void RunWriter::Add(uint32_t tag, char type, const char* key,
+                    size_t key_size, const char* value, size_t value_size) {
+  PutFixed32(tag);
+  out_.put(type);
+  PutFixed32(key_size);
+  out_.write(key, key_size);
+  PutFixed32(value_size);
+  out_.write(value, value_size);
+}
+
+bool RunWriter::Close() {
+  out_.close();
+  return !out_.fail();
+}
+
+void RunWriter::PutFixed32(uint32_t value) {
+  char buf[4];
+  for (int i = 0; i < 4; i++)
+    buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  out_.write(buf, sizeof(buf));
+}
+
+RunReader::RunReader(const std::string& filename)
+    : in_(filename, std::ifstream::binary) {
+  ok_ = in_.is_open();
+  if (ok_)
+    Next();
+}
+
+void RunReader::Next() {
+  valid_ = GetFixed32(&tag);
+  if (!valid_) {
+    // A run ends after a whole record
+    if (!in_.eof() || in_.gcount() != 0)
+      ok_ = false;
+    return;
+  }
+  valid_ = in_.get(type) && GetLengthPrefixed(&key) &&
+           GetLengthPrefixed(&value);
+  if (!valid_)
+    ok_ = false;
+}
+
+bool RunReader::GetFixed32(uint32_t* value) {
+  unsigned char buf[4];
+  if (!in_.read(reinterpret_cast<char*>(buf), sizeof(buf)))
+    return false;
+  *value = buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+           (static_cast<uint32_t>(buf[3]) << 24);
+  return true;
+}
+
+bool RunReader::GetLengthPrefixed(std::string* str) {
+  uint32_t size;
+  if (!GetFixed32(&size))
+    return false;
+  str->resize(size);
+  return size == 0 || in_.read(&(*str)[0], size);
+}
+
+RunMerger::RunMerger(const std::vector<std::string>& runs)
+    : heap_(After{this}) {
+  for (const auto& run : runs)
+    readers_.emplace_back(new RunReader(run));
+  for (size_t i = 0; i < readers_.size(); i++)
+    Push(i);
+}
+
+void RunMerger::Next() {
+  // Skip the records of earlier runs with the same tag and key
+  std::vector<int> done{heap_.top()};
+  heap_.pop();
+  const RunReader* current = readers_[done[0]].get();
+  while (!heap_.empty()) {
+    const RunReader* reader = readers_[heap_.top()].get();
+    if (reader->tag != current->tag || reader->key != current->key)
+      break;
+    done.push_back(heap_.top());
+    heap_.pop();
+  }
+  for (int i : done) {
+    readers_[i]->Next();
+    Push(i);
+  }
+}
+
+bool RunMerger::After::operator()(int a, int b) const {
+  const RunReader* x = merger->readers_[a].get();
+  const RunReader* y = merger->readers_[b].get();
+  if (x->tag != y->tag)
+    return x->tag > y->tag;
+  int cmp = x->key.compare(y->key);
+  return cmp != 0 ? cmp > 0 : a < b;
+}
+
+// private
+void RunMerger::Push(int i) {
+  if (readers_[i]->Valid())
+    heap_.push(i);
+  else if (!readers_[i]->ok())
+    ok_ = false;
+}
+
+}  // namespace crocks
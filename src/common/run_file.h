@@ -0,0 +1,122 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_COMMON_RUN_FILE_H
+#define CROCKS_COMMON_RUN_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace crocks {
+
+// Temporary files of sorted records, for sorting more data than fits in
+// memory. Used by BulkBatch on the nodes and BulkLoader on the clients.
+// Each record is a 32-bit tag, e.g. a shard or a column family id, a
+// type, and the length-prefixed key and value. Records are sorted by tag
+// and key.
+class RunWriter {
+ public:
+  explicit RunWriter(const std::string& filename);
+
+  void Add(uint32_t tag, char type, const char* key, size_t key_size,
+           const char* value, size_t value_size);
+
+  // Return false if the file could not be written
+  bool Close();
+
+ private:
+  void PutFixed32(uint32_t value);
+
+  std::ofstream out_;
+};
+
+class RunReader {
+ public:
+  explicit RunReader(const std::string& filename);
+
+  bool Valid() const {
+    return valid_;
+  }
+
+  // False if the file could not be read or ends in the middle of a record
+  bool ok() const {
+    return ok_;
+  }
+
+  void Next();
+
+  uint32_t tag;
+  char type;
+  std::string key;
+  std::string value;
+
+ private:
+  bool GetFixed32(uint32_t* value);
+  bool GetLengthPrefixed(std::string* str);
+
+  std::ifstream in_;
+  bool valid_ = false;
+  bool ok_ = true;
+};
+
+// Reads the records of many runs in order. Of the records with the same
+// tag and key, only the one of the last run is read.
+class RunMerger {
+ public:
+  explicit RunMerger(const std::vector<std::string>& runs);
+
+  bool Valid() const {
+    return !heap_.empty();
+  }
+
+  bool ok() const {
+    return ok_;
+  }
+
+  // The current record
+  const RunReader& record() const {
+    return *readers_[heap_.top()];
+  }
+
+  void Next();
+
+ private:
+  // Whether the current record of reader a comes after that of reader b
+  struct After {
+    const RunMerger* merger;
+    bool operator()(int a, int b) const;
+  };
+
+  // Add reader i to the heap if it has a record
+  void Push(int i);
+
+  std::vector<std::unique_ptr<RunReader>> readers_;
+  // Readers by their current record, and among those with the same tag and
+  // key, by latest run
+  std::priority_queue<int, std::vector<int>, After> heap_;
+  bool ok_ = true;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_COMMON_RUN_FILE_H
@@ -19,37 +19,75 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <random>
+#include <thread>
 
 namespace crocks {
 
+namespace {
+
+// Ensure() makes at most kEnsureRetries retries, backing
+// off from kEnsureBackoffMs up to kEnsureMaxBackoffMs
+const int kEnsureRetries = 3;
+const int kEnsureBackoffMs = 10;
+const int kEnsureMaxBackoffMs = 100;
+
+// Seeded with 256 bits, as a single random_device value has only 32
+// and ids of different clients would collide too often
+std::mt19937_64 NewGenerator() {
+  std::random_device device;
+  std::seed_seq seed{device(), device(), device(), device(),
+                     device(), device(), device(), device()};
+  return std::mt19937_64(seed);
+}
+
+std::mt19937_64& Generator() {
+  thread_local std::mt19937_64 generator = NewGenerator();
+  return generator;
+}
+
+}  // namespace
+
 grpc::Status Ensure(std::function<grpc::Status(grpc::ClientContext*)> rpc,
-                    const std::string& what) {
-  std::chrono::system_clock::time_point deadline =
-      std::chrono::system_clock::now() + std::chrono::seconds(1);
-  grpc::ClientContext context;
-  context.set_deadline(deadline);
-  grpc::Status status = rpc(&context);
-  int tries = 0;
-  while (status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
-    grpc::ClientContext retry_context;
-    retry_context.set_deadline(deadline);
-    status = rpc(&retry_context);
-    if (tries++ == 10)
-      status = grpc::Status(grpc::StatusCode::UNAVAILABLE, "Deadline exceeded");
-  }
-  if (status.error_code() == grpc::StatusCode::UNAVAILABLE) {
-    std::cerr << what << " failed. Retrying..." << std::endl;
-    grpc::ClientContext retry_context;
-    retry_context.set_deadline(deadline);
-    grpc::Status retry_status = rpc(&retry_context);
-    if (retry_status.error_code() != grpc::StatusCode::DEADLINE_EXCEEDED)
-      status = retry_status;
+                    const std::string& what,
+                    std::chrono::system_clock::time_point deadline) {
+  // The deadline is shared by all tries
+  deadline = std::min(deadline, std::chrono::system_clock::now() +
+                                    std::chrono::seconds(1));
+  grpc::Status status;
+  for (int attempt = 0;; attempt++) {
+    grpc::ClientContext context;
+    context.set_deadline(deadline);
+    status = rpc(&context);
+    if (status.error_code() != grpc::StatusCode::UNAVAILABLE ||
+        attempt == kEnsureRetries)
+      break;
+    if (attempt == 0)
+      std::cerr << what << " failed. Retrying..." << std::endl;
+    std::this_thread::sleep_for(
+        BackoffDelay(attempt, kEnsureBackoffMs, kEnsureMaxBackoffMs));
   }
+  if (status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED)
+    status = grpc::Status(grpc::StatusCode::UNAVAILABLE, "Deadline exceeded");
   return status;
 }
 
+std::chrono::microseconds BackoffDelay(int attempt, int base_ms, int max_ms) {
+  std::mt19937_64& generator = Generator();
+  // Avoid overflowing the shift
+  int64_t limit = static_cast<int64_t>(base_ms) << std::min(attempt, 30);
+  limit = std::min<int64_t>(limit, max_ms) * 1000;
+  std::uniform_int_distribution<int64_t> distribution(0, limit);
+  return std::chrono::microseconds(distribution(generator));
+}
+
+uint64_t RandomId() {
+  return Generator()();
+}
+
 bool GetEnv(const char* name, std::string* value) {
   char* tmp = secure_getenv(name);
   if (tmp == NULL)
@@ -18,6 +18,9 @@
 #ifndef CROCKS_COMMON_UTIL_H
 #define CROCKS_COMMON_UTIL_H
 
+#include <stdint.h>
+
+#include <chrono>
 #include <functional>
 #include <string>
 
@@ -25,9 +28,24 @@
 
 namespace crocks {
 
-// Make RPC and if it fails with status UNAVAILABLE, retry once
+const std::chrono::system_clock::time_point kNoDeadline =
+    std::chrono::system_clock::time_point::max();
+
+// Make RPC with a deadline of one second, or the given deadline if it is
+// sooner, and if it fails with status UNAVAILABLE, retry a few times with
+// backoff until the deadline. DEADLINE_EXCEEDED is returned as UNAVAILABLE.
 grpc::Status Ensure(std::function<grpc::Status(grpc::ClientContext*)> rpc,
-                    const std::string& what);
+                    const std::string& what,
+                    std::chrono::system_clock::time_point deadline =
+                        kNoDeadline);
+
+// Return a random delay between zero and base_ms * 2^attempt milliseconds,
+// capped at max_ms. Randomizing the whole delay ("full jitter") keeps
+// clients that failed at the same time from retrying in lockstep.
+std::chrono::microseconds BackoffDelay(int attempt, int base_ms, int max_ms);
+
+// Return a random number, e.g. to tell requests of different clients apart
+uint64_t RandomId();
 
 // Get environment variable, and return whether it was set
 bool GetEnv(const char* name, std::string* value);
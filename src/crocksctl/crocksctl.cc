@@ -16,10 +16,14 @@
 // along with crocks.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <getopt.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <crocks/cluster.h>
 #include <crocks/iterator.h>
@@ -47,11 +51,19 @@ const std::string usage_message(
     "  dump               Print every key-value pair.\n"
     "  clear              Delete all keys.\n"
     "  remove <id>        Remove node from the cluster.\n"
+    "  rebalance          Move shards to even out the load of the nodes.\n"
     "  info               Print cluster info.\n"
     "\n"
     "Options:\n"
-    "  -e, --etcd <address>  Etcd address [default: localhost:2379].\n"
-    "  -h, --help            Show this help message and exit.\n");
+    "  -e, --etcd <address>     Etcd address [default: localhost:2379].\n"
+    "  -i, --interval <sec>     Time to measure the load for [default: 10].\n"
+    "  -m, --max-moves <num>    Shards to move at most [default: 4].\n"
+    "  -b, --max-bytes <bytes>  Data to move at most [default: no limit].\n"
+    "  -n, --dry-run            Print the rebalancing plan and exit.\n"
+    "  -a, --auto <sec>         Keep rebalancing, sec seconds after the moves\n"
+    "                           of the last time are over. The limits apply\n"
+    "                           to each time separately.\n"
+    "  -h, --help               Show this help message and exit.\n");
 
 void EnsureArguments(bool expected) {
   if (!expected) {
@@ -65,7 +77,7 @@ void Get(const std::string& address, const std::string& key) {
   std::cout << "shard:\t" << db->ShardForKey(key) << std::endl;
   std::cout << "node:\t" << db->IndexForKey(key) << std::endl;
   std::string value;
-  crocks::Status status = db->Get(key, &value);
+  crocks::Status status = db->Get(crocks::CallOptions(), key, &value);
   EnsureRpc(status);
   std::cout << "value:\t" << value << std::endl;
   std::cout << "status:\t" << status.rocksdb_code() << " ("
@@ -78,7 +90,7 @@ void Put(const std::string& address, const std::string& key,
   crocks::ClusterImpl* db = new crocks::ClusterImpl(crocks::Options(), address);
   std::cout << "shard:\t" << db->ShardForKey(key) << std::endl;
   std::cout << "node:\t" << db->IndexForKey(key) << std::endl;
-  crocks::Status status = db->Put(key, value);
+  crocks::Status status = db->Put(crocks::CallOptions(), key, value);
   EnsureRpc(status);
   std::cout << "status:\t" << status.rocksdb_code() << " ("
             << status.error_message() << ")" << std::endl;
@@ -89,7 +101,7 @@ void Delete(const std::string& address, const std::string& key) {
   crocks::ClusterImpl* db = new crocks::ClusterImpl(crocks::Options(), address);
   std::cout << "shard:\t" << db->ShardForKey(key) << std::endl;
   std::cout << "node:\t" << db->IndexForKey(key) << std::endl;
-  crocks::Status status = db->Delete(key);
+  crocks::Status status = db->Delete(crocks::CallOptions(), key);
   EnsureRpc(status);
   std::cout << "status:\t" << status.rocksdb_code() << " ("
             << status.error_message() << ")" << std::endl;
@@ -165,6 +177,108 @@ void Remove(const std::string& etcd_address, int id) {
   info.Remove(id);
 }
 
+// Put the stats of every shard, as reported by its master, in *stats.
+// Return false if a node did not answer, e.g. because it is restarting.
+bool CollectStats(crocks::Info& info,
+                  std::vector<crocks::pb::ShardStats>* stats) {
+  stats->assign(info.num_shards(), crocks::pb::ShardStats());
+  for (int i = 0; i < info.num_nodes(); i++) {
+    std::string address = info.Address(i);
+    if (address.empty())
+      continue;
+    crocks::Node* node = new crocks::Node(address);
+    crocks::pb::StatsResponse response;
+    crocks::Status status = node->Stats(&response);
+    delete node;
+    if (!status.ok()) {
+      std::cerr << "Node " << i << " did not send its stats (status "
+                << status.grpc_code() << ": " << status.error_message()
+                << ")" << std::endl;
+      return false;
+    }
+    for (const auto& shard_stats : response.shards())
+      (*stats)[shard_stats.shard()] = shard_stats;
+  }
+  return true;
+}
+
+// Return false if the load could not be measured
+bool Rebalance(const std::string& address, int interval, int max_moves,
+               uint64_t max_bytes, bool dry_run) {
+  crocks::Info info(address);
+  info.Get();
+  int num_shards = info.num_shards();
+
+  // The counters are sampled twice, to get the load during the interval
+  std::vector<crocks::pb::ShardStats> before, after;
+  std::cout << "Measuring load for " << interval << " seconds..." << std::endl;
+  if (!CollectStats(info, &before))
+    return false;
+  std::this_thread::sleep_for(std::chrono::seconds(interval));
+  if (!CollectStats(info, &after))
+    return false;
+
+  // The load of a shard is its share of the requests, plus its share
+  // of the bytes read and written, plus its share of the data.
+  std::vector<double> requests(num_shards), bytes(num_shards);
+  std::vector<uint64_t> sizes(num_shards);
+  double total_requests = 0, total_bytes = 0, total_size = 0;
+  for (int i = 0; i < num_shards; i++) {
+    requests[i] = after[i].reads() + after[i].writes();
+    bytes[i] = after[i].bytes();
+    // The counters are reset if the node restarts
+    if (after[i].reads() >= before[i].reads() &&
+        after[i].writes() >= before[i].writes() &&
+        after[i].bytes() >= before[i].bytes()) {
+      requests[i] -= before[i].reads() + before[i].writes();
+      bytes[i] -= before[i].bytes();
+    }
+    sizes[i] = after[i].size();
+    total_requests += requests[i];
+    total_bytes += bytes[i];
+    total_size += sizes[i];
+  }
+  std::vector<double> loads(num_shards, 0);
+  for (int i = 0; i < num_shards; i++) {
+    if (total_requests > 0)
+      loads[i] += requests[i] / total_requests;
+    if (total_bytes > 0)
+      loads[i] += bytes[i] / total_bytes;
+    if (total_size > 0)
+      loads[i] += sizes[i] / total_size;
+  }
+
+  auto moves = info.Rebalance(loads, sizes, max_moves, max_bytes, dry_run);
+  if (moves.empty()) {
+    std::cout << "There was nothing to rebalance" << std::endl;
+    return true;
+  }
+  for (const auto& move : moves)
+    std::cout << "shard " << move.shard << ": node " << move.from
+              << " -> node " << move.to << " ("
+              << requests[move.shard] / interval << " requests/s, "
+              << sizes[move.shard] << " bytes)" << std::endl;
+  if (dry_run)
+    std::cout << "Dry run, no shard was moved" << std::endl;
+  return true;
+}
+
+// Rebalance every period seconds, after the moves of the last time are over
+void AutoRebalance(const std::string& address, int period, int interval,
+                   int max_moves, uint64_t max_bytes, bool dry_run) {
+  crocks::Info info(address);
+  while (true) {
+    // A node may be down for a while, so try again the next time
+    if (!Rebalance(address, interval, max_moves, max_bytes, dry_run))
+      std::cerr << "Skipping this time" << std::endl;
+    do {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      info.Get();
+    } while (info.IsMigrating());
+    std::this_thread::sleep_for(std::chrono::seconds(period));
+  }
+}
+
 void Info(const std::string& address) {
   crocks::Info info(address);
   info.Get();
@@ -173,9 +287,19 @@ void Info(const std::string& address) {
 
 int main(int argc, char** argv) {
   std::string etcd_address = crocks::GetEtcdEndpoint();
-  const char* optstring = "e:h";
+  int interval = 10;
+  int max_moves = 4;
+  uint64_t max_bytes = 0;
+  bool dry_run = false;
+  int period = 0;
+  const char* optstring = "e:i:m:b:na:h";
   static struct option longopts[] = {
       {"etcd", required_argument, 0, 'e'},
+      {"interval", required_argument, 0, 'i'},
+      {"max-moves", required_argument, 0, 'm'},
+      {"max-bytes", required_argument, 0, 'b'},
+      {"dry-run", no_argument, 0, 'n'},
+      {"auto", required_argument, 0, 'a'},
       {"help", no_argument, 0, 'h'},
       {0, 0, 0, 0},
   };
@@ -187,6 +311,21 @@ int main(int argc, char** argv) {
       case 'e':
         etcd_address = optarg;
         break;
+      case 'i':
+        interval = std::stoi(optarg);
+        break;
+      case 'm':
+        max_moves = std::stoi(optarg);
+        break;
+      case 'b':
+        max_bytes = std::stoull(optarg);
+        break;
+      case 'n':
+        dry_run = true;
+        break;
+      case 'a':
+        period = std::stoi(optarg);
+        break;
       case 'h':
         std::cout << usage_message;
         exit(EXIT_SUCCESS);
@@ -241,6 +380,15 @@ int main(int argc, char** argv) {
     EnsureArguments(argc - optind == 1);
     Remove(etcd_address, std::stoi(argv[optind]));
 
+  } else if (command == "rebalance") {
+    EnsureArguments(argc == optind);
+    if (period > 0)
+      AutoRebalance(etcd_address, period, interval, max_moves, max_bytes,
+                    dry_run);
+    else if (!Rebalance(etcd_address, interval, max_moves, max_bytes,
+                        dry_run))
+      exit(EXIT_FAILURE);
+
   } else if (command == "info") {
     EnsureArguments(argc == optind);
     Info(etcd_address);
@@ -18,28 +18,40 @@
 #include "src/server/async_server.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <grpc++/grpc++.h>
 #include <rocksdb/db.h>
 #include <rocksdb/env.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
 #include <rocksdb/status.h>
 #include <rocksdb/utilities/options_util.h>
 #include <rocksdb/write_batch.h>
 
 #include <crocks/status.h>
 #include "gen/crocks.pb.h"
+#include "src/common/routing_hint.h"
+#include "src/common/util.h"
+#include "src/server/bulk_batch.h"
 #include "src/server/iterator.h"
 #include "src/server/migrate_util.h"
+#include "src/server/sequencer.h"
 #include "src/server/shards.h"
+#include "src/server/transactions.h"
 #include "src/server/util.h"
 
 std::atomic<bool> shutdown(false);
@@ -50,6 +62,26 @@ namespace crocks {
 const grpc::Status invalid_status(grpc::StatusCode::INVALID_ARGUMENT,
                                   "Not responsible for this shard");
 
+// gRPC status of calls that are dropped because the client has given up
+const grpc::Status expired_status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                                  "Deadline exceeded before processing");
+
+// Return true if the deadline of the call has passed. Then the client has
+// given up on it, and doing the work would only slow down the calls that
+// are still waiting, so it is dropped instead.
+bool Expired(const grpc::ServerContext& ctx) {
+  return ctx.deadline() <= std::chrono::system_clock::now();
+}
+
+// Let the client know which node the shard belongs to, so
+// that he can retry there without asking etcd first
+void AddRoutingHint(grpc::ServerContext* ctx, Info* info, int shard) {
+  RoutingHint hint;
+  hint.master = info->IndexForShard(shard, &hint.revision);
+  hint.address = info->Address(hint.master);
+  SetRoutingHint(ctx, hint);
+}
+
 // Simple POD struct used as an argument wrapper for calls
 struct CallData {
   pb::RPC::AsyncService* service;
@@ -57,6 +89,8 @@ struct CallData {
   rocksdb::DB* db;
   Info* info;
   Shards* shards;
+  Sequencer* sequencer;
+  Transactions* transactions;
 };
 
 // Base class used to cast the void* tags we get from
@@ -125,6 +159,73 @@ class PingCall final : public Call {
   bool on_done_called_ = false;
 };
 
+class StatsCall final : public Call {
+ public:
+  explicit StatsCall(CallData* data)
+      : data_(data), responder_(&ctx_), status_(REQUEST) {
+    on_done = [&](bool ok) { OnDone(ok); };
+    proceed = [&](bool ok) { Proceed(ok); };
+    ctx_.AsyncNotifyWhenDone(&on_done);
+    data_->service->RequestStats(&ctx_, &request_, &responder_, data_->cq,
+                                 data_->cq, &proceed);
+  }
+
+  void Proceed(bool ok) {
+    switch (status_) {
+      case REQUEST:
+        if (!ok) {
+          delete this;
+          break;
+        }
+        new StatsCall(data_);
+        for (int shard_id : data_->shards->ids()) {
+          std::shared_ptr<Shard> shard = data_->shards->at(shard_id);
+          // Importing shards are reported by their current master
+          if (!shard || shard->importing())
+            continue;
+          pb::ShardStats* stats = response_.add_shards();
+          stats->set_shard(shard_id);
+          stats->set_reads(shard->reads());
+          stats->set_writes(shard->writes());
+          stats->set_bytes(shard->bytes());
+          stats->set_size(shard->Size());
+        }
+        responder_.Finish(response_, grpc::Status::OK, &proceed);
+        status_ = FINISH;
+        break;
+
+      case FINISH:
+        finish_called_ = true;
+        if (on_done_called_)
+          delete this;
+        break;
+    }
+  }
+
+  void OnDone(bool ok) {
+    assert(ok);
+    on_done_called_ = true;
+    if (finish_called_)
+      delete this;
+    else
+      status_ = FINISH;
+  }
+
+  std::function<void(bool)> proceed;
+  std::function<void(bool)> on_done;
+
+ private:
+  CallData* data_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncResponseWriter<pb::StatsResponse> responder_;
+  pb::Empty request_;
+  pb::StatsResponse response_;
+  enum CallStatus { REQUEST, FINISH };
+  CallStatus status_;
+  bool finish_called_ = false;
+  bool on_done_called_ = false;
+};
+
 class GetCall final : public Call {
  public:
   explicit GetCall(CallData* data)
@@ -139,8 +240,8 @@ class GetCall final : public Call {
   void Proceed(bool ok) {
     rocksdb::Status s;
     std::string value;
+    uint64_t version;
     int shard_id;
-    bool ask;
 
     switch (status_) {
       case REQUEST:
@@ -149,68 +250,31 @@ class GetCall final : public Call {
           break;
         }
         new GetCall(data_);
+        if (Expired(ctx_)) {
+          responder_.FinishWithError(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
         shard_id = data_->info->ShardForKey(request_.key());
-        if (data_->info->WrongShard(shard_id) && !request_.force()) {
+        if (data_->info->WrongShard(shard_id)) {
+          AddRoutingHint(&ctx_, data_->info, shard_id);
           responder_.FinishWithError(invalid_status, &proceed);
           status_ = FINISH;
           break;
         }
         shard_ = data_->shards->at(shard_id);
-        if (!shard_) {
+        if (!shard_ || shard_->importing()) {
+          AddRoutingHint(&ctx_, data_->info, shard_id);
           responder_.FinishWithError(invalid_status, &proceed);
           status_ = FINISH;
           break;
         }
-        s = shard_->Get(request_.key(), &value, &ask);
-        if (ask) {
-          std::cerr << data_->info->id() << ": Asking the former master"
-                    << std::endl;
-          std::unique_ptr<pb::RPC::Stub> stub(
-              pb::RPC::NewStub(grpc::CreateChannel(
-                  shard_->old_address(), grpc::InsecureChannelCredentials())));
-          request_.set_force(true);
-          std::unique_ptr<grpc::ClientAsyncResponseReader<pb::Response>> rpc(
-              stub->AsyncGet(&force_get_context_, request_, data_->cq));
-          rpc->Finish(&response_, &force_get_status_, &proceed);
-          status_ = GET;
-          break;
-        }
+        // Read the version first, so that it is never newer than the value
+        version = shard_->version();
+        s = shard_->Get(request_.key(), &value);
         response_.set_status(RocksdbStatusCodeToInt(s.code()));
         response_.set_value(value);
-        responder_.Finish(response_, grpc::Status::OK, &proceed);
-        status_ = FINISH;
-        break;
-
-      case GET:
-        // If gRPC failed with status UNAVAILABLE, but the
-        // node is still in the info, he must have crashed.
-        if (force_get_status_.error_code() == grpc::StatusCode::UNAVAILABLE) {
-          auto addresses = data_->info->Addresses();
-          if (std::find(addresses.begin(), addresses.end(),
-                        shard_->old_address()) != addresses.end()) {
-            std::cerr << data_->info->id() << ": The former master crashed"
-                      << std::endl;
-            responder_.FinishWithError(
-                grpc::Status(grpc::StatusCode::UNAVAILABLE,
-                             "The former master has crashed"),
-                &proceed);
-            status_ = FINISH;
-            break;
-          }
-        }
-        // If gRPC failed, the server must have shut down and if
-        // RocksDB status is INVALID_ARGUMENT, he has deleted
-        // the shard. Either way, we must have ingested by now.
-        if (!force_get_status_.ok() ||
-            response_.status() == rocksdb::StatusCode::INVALID_ARGUMENT) {
-          std::cerr << data_->info->id() << ": Meanwhile importing finished"
-                    << std::endl;
-          s = shard_->Get(request_.key(), &value, &ask);
-          assert(!ask);
-          response_.set_status(RocksdbStatusCodeToInt(s.code()));
-          response_.set_value(value);
-        }
-        // If he responded successfully we just forward his response
+        response_.set_version(version);
         responder_.Finish(response_, grpc::Status::OK, &proceed);
         status_ = FINISH;
         break;
@@ -245,9 +309,7 @@ class GetCall final : public Call {
   // lifetime of GetCall to make sure that the shard
   // doesn't get deleted while a get rpc is in progress.
   std::shared_ptr<Shard> shard_;
-  grpc::ClientContext force_get_context_;
-  grpc::Status force_get_status_;
-  enum CallStatus { REQUEST, GET, FINISH };
+  enum CallStatus { REQUEST, FINISH };
   CallStatus status_;
   bool finish_called_ = false;
   bool on_done_called_ = false;
@@ -279,9 +341,15 @@ class PutCall final : public Call {
           break;
         }
         new PutCall(data_);
+        if (Expired(ctx_)) {
+          responder_.FinishWithError(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
         shard_id = data_->info->ShardForKey(request_.key());
         shard = data_->shards->at(shard_id);
         if (!shard || !shard->Ref()) {
+          AddRoutingHint(&ctx_, data_->info, shard_id);
           responder_.FinishWithError(invalid_status, &proceed);
         } else {
           s = shard->Put(request_.key(), request_.value());
@@ -347,9 +415,15 @@ class DeleteCall final : public Call {
           break;
         }
         new DeleteCall(data_);
+        if (Expired(ctx_)) {
+          responder_.FinishWithError(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
         shard_id = data_->info->ShardForKey(request_.key());
         shard = data_->shards->at(shard_id);
         if (!shard || !shard->Ref()) {
+          AddRoutingHint(&ctx_, data_->info, shard_id);
           responder_.FinishWithError(invalid_status, &proceed);
         } else {
           s = shard->Delete(request_.key());
@@ -392,8 +466,237 @@ class DeleteCall final : public Call {
   bool on_done_called_ = false;
 };
 
+class TransactionCall final : public Call {
+ public:
+  explicit TransactionCall(CallData* data)
+      : data_(data), responder_(&ctx_), status_(REQUEST) {
+    on_done = [&](bool ok) { OnDone(ok); };
+    proceed = [&](bool ok) { Proceed(ok); };
+    ctx_.AsyncNotifyWhenDone(&on_done);
+    data_->service->RequestTransaction(&ctx_, &request_, &responder_,
+                                       data_->cq, data_->cq, &proceed);
+  }
+
+  void Proceed(bool ok) {
+    rocksdb::Status s;
+
+    switch (status_) {
+      case REQUEST:
+        if (!ok) {
+          delete this;
+          break;
+        }
+        new TransactionCall(data_);
+        if (Expired(ctx_)) {
+          responder_.FinishWithError(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
+        switch (request_.phase()) {
+          case pb::TransactionRequest::COMMIT:
+            s = data_->transactions->Commit(request_.id());
+            break;
+          case pb::TransactionRequest::ABORT:
+            data_->transactions->Abort(request_.id());
+            break;
+          default:
+            if (!Prepare()) {
+              responder_.FinishWithError(invalid_status, &proceed);
+              status_ = FINISH;
+              return;
+            }
+            s = data_->transactions->Prepare(
+                request_.id(), &part_,
+                request_.phase() == pb::TransactionRequest::WRITE);
+        }
+        response_.set_status(RocksdbStatusCodeToInt(s.code()));
+        responder_.Finish(response_, grpc::Status::OK, &proceed);
+        status_ = FINISH;
+        break;
+
+      case FINISH:
+        finish_called_ = true;
+        if (on_done_called_)
+          delete this;
+        break;
+    }
+  }
+
+  void OnDone(bool ok) {
+    assert(ok);
+    on_done_called_ = true;
+    if (finish_called_)
+      delete this;
+    else
+      status_ = FINISH;
+  }
+
+  std::function<void(bool)> proceed;
+  std::function<void(bool)> on_done;
+
+ private:
+  // Reference the shards of the keys of the transaction and fill in
+  // part_. If one of them is not served by this node, unreference the
+  // rest, add a routing hint for it and return false.
+  bool Prepare() {
+    std::unordered_map<int, Shard*> shards;
+    auto cf = [&](const std::string& key) -> rocksdb::ColumnFamilyHandle* {
+      int shard_id = data_->info->ShardForKey(key);
+      auto it = shards.find(shard_id);
+      if (it != shards.end())
+        return it->second->cf();
+      std::shared_ptr<Shard> shard = data_->shards->at(shard_id);
+      if (!shard || !shard->Ref()) {
+        AddRoutingHint(&ctx_, data_->info, shard_id);
+        return nullptr;
+      }
+      part_.shards.push_back(shard);
+      shards[shard_id] = shard.get();
+      return shard->cf();
+    };
+    for (const pb::TransactionRead& read : request_.reads()) {
+      rocksdb::ColumnFamilyHandle* handle = cf(read.key());
+      if (handle == nullptr)
+        return Unref();
+      part_.reads.push_back(
+          TransactionRead{handle, read.key(), read.found(), read.digest()});
+      part_.keys.push_back(read.key());
+    }
+    for (const pb::BatchUpdate& write : request_.writes()) {
+      rocksdb::ColumnFamilyHandle* handle = cf(write.key());
+      if (handle == nullptr)
+        return Unref();
+      ApplyBatchUpdate(&part_.writes, handle, write);
+      part_.keys.push_back(write.key());
+    }
+    return true;
+  }
+
+  bool Unref() {
+    for (const auto& shard : part_.shards)
+      shard->Unref();
+    return false;
+  }
+
+  CallData* data_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncResponseWriter<pb::Response> responder_;
+  pb::TransactionRequest request_;
+  pb::Response response_;
+  TransactionPart part_;
+  enum CallStatus { REQUEST, FINISH };
+  CallStatus status_;
+  bool finish_called_ = false;
+  bool on_done_called_ = false;
+};
+
 // TODO: Add SingleDelete() and Merge()
 
+class BatchWriteCall final : public Call {
+ public:
+  explicit BatchWriteCall(CallData* data)
+      : data_(data), responder_(&ctx_), status_(REQUEST) {
+    on_done = [&](bool ok) { OnDone(ok); };
+    proceed = [&](bool ok) { Proceed(ok); };
+    ctx_.AsyncNotifyWhenDone(&on_done);
+    data_->service->RequestBatchWrite(&ctx_, &request_, &responder_,
+                                      data_->cq, data_->cq, &proceed);
+  }
+
+  void Proceed(bool ok) {
+    switch (status_) {
+      case REQUEST:
+        if (!ok) {
+          delete this;
+          break;
+        }
+        new BatchWriteCall(data_);
+        if (Expired(ctx_)) {
+          responder_.FinishWithError(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
+        if (!Ref()) {
+          // Nothing is written, the client streams the batch instead
+          responder_.FinishWithError(invalid_status, &proceed);
+        } else {
+          rocksdb::Status s = Write();
+          for (const auto& shard : shards_)
+            shard->Unref();
+          response_.set_status(RocksdbStatusCodeToInt(s.code()));
+          responder_.Finish(response_, grpc::Status::OK, &proceed);
+        }
+        status_ = FINISH;
+        break;
+
+      case FINISH:
+        finish_called_ = true;
+        if (on_done_called_)
+          delete this;
+        break;
+    }
+  }
+
+  void OnDone(bool ok) {
+    assert(ok);
+    on_done_called_ = true;
+    if (finish_called_)
+      delete this;
+    else
+      status_ = FINISH;
+  }
+
+  std::function<void(bool)> proceed;
+  std::function<void(bool)> on_done;
+
+ private:
+  // Reference the shard of every section. If one of them is not
+  // served by this node, unreference the rest and return false.
+  bool Ref() {
+    for (const pb::BatchSection& section : request_.sections()) {
+      std::shared_ptr<Shard> shard = data_->shards->at(section.shard());
+      if (!shard || !shard->Ref()) {
+        for (const auto& shard : shards_)
+          shard->Unref();
+        return false;
+      }
+      shards_.push_back(shard);
+    }
+    return true;
+  }
+
+  rocksdb::Status Write() {
+    rocksdb::WriteBatch batch;
+    for (int i = 0; i < request_.sections_size(); i++) {
+      uint64_t count = 0;
+      uint64_t bytes = 0;
+      rocksdb::Status s =
+          ApplyBatchData(&batch, shards_[i]->cf(),
+                         request_.mutable_sections(i)->mutable_data(), &count,
+                         &bytes);
+      if (!s.ok())
+        return s;
+      shards_[i]->CountWrite(bytes, count);
+    }
+    rocksdb::Status s = data_->db->Write(rocksdb::WriteOptions(), &batch);
+    for (const auto& shard : shards_)
+      shard->Changed();
+    return s;
+  }
+
+  CallData* data_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncResponseWriter<pb::Response> responder_;
+  pb::BatchBuffer request_;
+  pb::Response response_;
+  // The shards of the sections, in the same order
+  std::vector<std::shared_ptr<Shard>> shards_;
+  enum CallStatus { REQUEST, FINISH };
+  CallStatus status_;
+  bool finish_called_ = false;
+  bool on_done_called_ = false;
+};
+
 class BatchCall final : public Call {
  public:
   explicit BatchCall(CallData* data)
@@ -417,44 +720,105 @@ class BatchCall final : public Call {
         new BatchCall(data_);
         stream_.Read(&request_, &proceed);
         status_ = READ;
-        assert(request_.updates_size() == 0);
+        assert(request_.sections_size() == 0);
         break;
 
       case READ:
-        if (ok) {
-          int shard_id = data_->info->ShardForKey(request_.updates(0).key());
-          std::shared_ptr<Shard> shard = data_->shards->at(shard_id);
-          if (!got_ref_[shard_id]) {
-            // We got the first buffer
-            if (!shard || !shard->Ref()) {
-              auto code = rocksdb::Status::Code::kInvalidArgument;
-              response_.set_status(RocksdbStatusCodeToInt(code));
-              stream_.Write(response_, &proceed);
-              status_ = WRITE;
-              // break early to avoid applying the buffer
-              break;
-            } else {
+        // Once prepared, an ordered batch may have been applied by other
+        // nodes, so it is not dropped
+        if (!prepared_ && Expired(ctx_)) {
+          // Nothing has been written yet, unless the batch is streaming, so
+          // the batch is dropped as a whole
+          stream_.Finish(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
+        if (ok && request_.prepare()) {
+          proposal_ = data_->sequencer->Prepare();
+          prepared_ = true;
+          auto code = rocksdb::Status::Code::kOk;
+          response_.set_status(RocksdbStatusCodeToInt(code));
+          response_.set_timestamp(proposal_);
+          stream_.Write(response_, &proceed);
+          status_ = WRITE;
+        } else if (ok && request_.timestamp() > 0) {
+          assert(prepared_);
+          // Wait for the ordered batches that come before this one. No
+          // operation is in flight until Write() is called.
+          status_ = SEQUENCE;
+          if (!data_->sequencer->Commit(proposal_, request_.timestamp(),
+                                        [this] { WriteOrdered(); })) {
+            // It took too long, and later batches have gone ahead of it
+            stream_.Finish(grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                                        "Ordered batch expired"),
+                           &proceed);
+            status_ = FINISH;
+          }
+        } else if (ok) {
+          if (request_.clear()) {
+            batch_.Clear();
+            if (bulk_)
+              bulk_->Clear();
+          }
+          response_.Clear();
+          // Whether the buffer has the first section of a shard, in which
+          // case the client waits for a reply
+          bool first = false;
+          for (auto& section : *request_.mutable_sections()) {
+            int shard_id = section.shard();
+            std::shared_ptr<Shard> shard = data_->shards->at(shard_id);
+            if (!got_ref_[shard_id]) {
+              first = true;
+              if (!shard || !shard->Ref()) {
+                // Skip the section, the client sends it to the new master
+                response_.add_rejected(shard_id);
+                continue;
+              }
               got_ref_[shard_id] = true;
-              auto code = rocksdb::Status::Code::kOk;
-              response_.set_status(RocksdbStatusCodeToInt(code));
-              stream_.Write(response_, &proceed);
-              status_ = WRITE;
             }
+            uint64_t count = 0;
+            uint64_t bytes = 0;
+            s = ApplyBatchData(&batch_, shard->cf(), section.mutable_data(),
+                               &count, &bytes);
+            shard->CountWrite(bytes, count);
+            // Remember the first corrupted section, and fail the whole batch
+            if (!s.ok() && batch_status_.ok())
+              batch_status_ = s;
+          }
+          if (request_.streaming())
+            WriteChunk();
+          else if (spill_ && batch_.GetDataSize() > kSpillThreshold)
+            Spill();
+          if (first) {
+            auto code = response_.rejected_size() > 0
+                            ? rocksdb::Status::Code::kInvalidArgument
+                            : rocksdb::Status::Code::kOk;
+            response_.set_status(RocksdbStatusCodeToInt(code));
+            stream_.Write(response_, &proceed);
+            status_ = WRITE;
           } else {
             stream_.Read(&request_, &proceed);
-            assert(status_ == READ);
           }
-          for (const pb::BatchUpdate& batch_update : request_.updates())
-            ApplyBatchUpdate(&batch_, shard->cf(), batch_update);
+        } else if (prepared_) {
+          // The client has got the reply to the commit
+          if (committed_)
+            stream_.Finish(grpc::Status::OK, &proceed);
+          else
+            stream_.Finish(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                        "Ordered batch was not committed"),
+                           &proceed);
+          status_ = FINISH;
         } else {
-          s = data_->db->Write(rocksdb::WriteOptions(), &batch_);
-          response_.set_status(RocksdbStatusCodeToInt(s.code()));
-          stream_.Write(response_, &proceed);
-          status_ = WRITE;
+          Write();
           finish_ = true;
         }
         break;
 
+      case SEQUENCE:
+        // Unreachable, nothing is in flight
+        assert(false);
+        break;
+
       case WRITE:
         // assert(ok);
         if (!finish_ && ok) {
@@ -467,6 +831,9 @@ class BatchCall final : public Call {
         break;
 
       case FINISH:
+        // Unblock the ordered batches that come after this one
+        if (prepared_)
+          data_->sequencer->Abort(proposal_);
         // Unreference every referenced shard
         for (auto pair : got_ref_)
           if (pair.second)
@@ -483,6 +850,17 @@ class BatchCall final : public Call {
     if (ctx_.IsCancelled())
       std::cerr << data_->info->id() << ": Batch call cancelled" << std::endl;
     on_done_called_ = true;
+    // A batch that waits for its turn has nothing in flight that would
+    // complete and finish the call, so finish it here, unless it is
+    // being applied already
+    bool waiting = status_ == SEQUENCE;
+    if (prepared_ && data_->sequencer->Abort(proposal_) && waiting) {
+      stream_.Finish(grpc::Status(grpc::StatusCode::CANCELLED,
+                                  "Batch call cancelled"),
+                     &proceed);
+      status_ = FINISH;
+      return;
+    }
     if (finish_called_)
       delete this;
     else
@@ -493,6 +871,104 @@ class BatchCall final : public Call {
   std::function<void(bool)> on_done;
 
  private:
+  // Apply an ordered batch, once the batches before it have been applied
+  void WriteOrdered() {
+    committed_ = true;
+    Write();
+  }
+
+  // Move the updates received so far to a new run of bulk_, to keep the
+  // memory of the batch bounded
+  void Spill() {
+    // The batch has failed, so the rest of its updates are dropped
+    if (!batch_status_.ok()) {
+      batch_.Clear();
+      return;
+    }
+    // A migrating shard gets the batch through the WAL instead (see
+    // Shard::BeginIngest())
+    for (auto pair : got_ref_) {
+      if (!pair.second || !data_->shards->at(pair.first)->exporting())
+        continue;
+      if (bulk_ && bulk_->spilled()) {
+        // What was spilled can no longer be ingested, so the batch fails
+        batch_status_ = rocksdb::Status::TryAgain("Shard is being migrated");
+        batch_.Clear();
+        bulk_->Clear();
+      } else {
+        spill_ = false;
+      }
+      return;
+    }
+    if (!bulk_)
+      bulk_.reset(new BulkBatch(data_->db));
+    rocksdb::Status s = bulk_->Spill(&batch_);
+    if (s.IsNotSupported() && !bulk_->spilled()) {
+      // The batch has merges, so keep all of it in memory
+      spill_ = false;
+    } else if (!s.ok()) {
+      // The batch has merges after some updates have been spilled, or the
+      // run could not be written, so it fails
+      if (batch_status_.ok())
+        batch_status_ = s;
+      spill_ = false;
+    }
+  }
+
+  // Write the sections of a streaming buffer at once. After a failure the
+  // rest are dropped, and the client gets the status on the commit.
+  void WriteChunk() {
+    if (batch_status_.ok()) {
+      rocksdb::Status s = data_->db->Write(rocksdb::WriteOptions(), &batch_);
+      if (!s.ok())
+        batch_status_ = s;
+    }
+    batch_.Clear();
+    for (const auto& section : request_.sections())
+      if (got_ref_[section.shard()])
+        data_->shards->at(section.shard())->Changed();
+  }
+
+  // Commit the spilled batch, unless one of its shards has started being
+  // migrated since it was spilled, in which case it fails with TryAgain
+  rocksdb::Status Ingest(const std::vector<std::shared_ptr<Shard>>& shards) {
+    std::vector<rocksdb::ColumnFamilyHandle*> cfs;
+    rocksdb::Status s;
+    for (const auto& shard : shards) {
+      if (!shard->BeginIngest()) {
+        s = rocksdb::Status::TryAgain("Shard is being migrated");
+        break;
+      }
+      cfs.push_back(shard->cf());
+    }
+    if (s.ok())
+      s = bulk_->Commit(&batch_, cfs);
+    for (size_t i = 0; i < cfs.size(); i++)
+      shards[i]->EndIngest();
+    return s;
+  }
+
+  // Write the batch and send its status to the client
+  void Write() {
+    rocksdb::Status s = batch_status_;
+    if (s.ok() && bulk_ && bulk_->spilled()) {
+      std::vector<std::shared_ptr<Shard>> shards;
+      for (auto pair : got_ref_)
+        if (pair.second)
+          shards.push_back(data_->shards->at(pair.first));
+      s = Ingest(shards);
+    } else if (s.ok()) {
+      s = data_->db->Write(rocksdb::WriteOptions(), &batch_);
+    }
+    response_.Clear();
+    for (auto pair : got_ref_)
+      if (pair.second)
+        data_->shards->at(pair.first)->Changed();
+    response_.set_status(RocksdbStatusCodeToInt(s.code()));
+    stream_.Write(response_, &proceed);
+    status_ = WRITE;
+  }
+
   CallData* data_;
   grpc::ServerContext ctx_;
   grpc::ServerAsyncReaderWriter<pb::Response, pb::BatchBuffer> stream_;
@@ -500,9 +976,198 @@ class BatchCall final : public Call {
   pb::Response response_;
   std::unordered_map<int, bool> got_ref_;
   bool finish_ = false;
-  enum CallStatus { REQUEST, READ, WRITE, FINISH };
-  CallStatus status_;
+  // SEQUENCE: an ordered batch waits for the ones before it to be applied
+  enum CallStatus { REQUEST, READ, WRITE, SEQUENCE, FINISH };
+  std::atomic<CallStatus> status_;
   rocksdb::WriteBatch batch_;
+  // Not OK if a buffer could not be decoded
+  rocksdb::Status batch_status_;
+  // Created once the batch gets too big to keep in memory
+  std::unique_ptr<BulkBatch> bulk_;
+  // False if the batch cannot be spilled
+  bool spill_ = true;
+  // Set for ordered batches
+  bool prepared_ = false;
+  bool committed_ = false;
+  uint64_t proposal_ = 0;
+  bool finish_called_ = false;
+  bool on_done_called_ = false;
+};
+
+class LoadCall final : public Call {
+ public:
+  explicit LoadCall(CallData* data)
+      : data_(data), reader_(&ctx_), status_(REQUEST) {
+    on_done = [&](bool ok) { OnDone(ok); };
+    proceed = [&](bool ok) { Proceed(ok); };
+    ctx_.AsyncNotifyWhenDone(&on_done);
+    data_->service->RequestLoad(&ctx_, &reader_, data_->cq, data_->cq,
+                                &proceed);
+  }
+
+  ~LoadCall() {
+    // Remove the files that were not ingested
+    for (const auto& file : files_)
+      remove(file.c_str());
+    for (const auto& shard : shards_)
+      shard->Unref();
+  }
+
+  void Proceed(bool ok) {
+    rocksdb::Status s;
+
+    switch (status_) {
+      case REQUEST:
+        if (!ok) {
+          delete this;
+          break;
+        }
+        new LoadCall(data_);
+        prefix_ = data_->db->GetName() + "/load_" + std::to_string(RandomId());
+        reader_.Read(&request_, &proceed);
+        status_ = READ;
+        break;
+
+      case READ:
+        if (ok && request_.commit()) {
+          int rejected;
+          if (!Ingest(&s, &rejected)) {
+            AddRoutingHint(&ctx_, data_->info, rejected);
+            reader_.FinishWithError(invalid_status, &proceed);
+          } else {
+            response_.set_status(RocksdbStatusCodeToInt(s.code()));
+            reader_.Finish(response_, grpc::Status::OK, &proceed);
+          }
+          status_ = FINISH;
+        } else if (ok) {
+          if (!Add(&s)) {
+            AddRoutingHint(&ctx_, data_->info, request_.shard());
+            reader_.FinishWithError(invalid_status, &proceed);
+            status_ = FINISH;
+          } else if (!s.ok()) {
+            response_.set_status(RocksdbStatusCodeToInt(s.code()));
+            reader_.Finish(response_, grpc::Status::OK, &proceed);
+            status_ = FINISH;
+          } else {
+            reader_.Read(&request_, &proceed);
+          }
+        } else {
+          // The client gave up on the load, so nothing is ingested
+          reader_.Finish(response_, grpc::Status::CANCELLED, &proceed);
+          status_ = FINISH;
+        }
+        break;
+
+      case FINISH:
+        finish_called_ = true;
+        if (on_done_called_)
+          delete this;
+        break;
+    }
+  }
+
+  void OnDone(bool ok) {
+    assert(ok);
+    if (ctx_.IsCancelled())
+      std::cerr << data_->info->id() << ": Load call cancelled" << std::endl;
+    on_done_called_ = true;
+    if (finish_called_)
+      delete this;
+    else
+      status_ = FINISH;
+  }
+
+  std::function<void(bool)> proceed;
+  std::function<void(bool)> on_done;
+
+ private:
+  // Append the key-values of request_ to the SST of their shard, starting
+  // a new one if the shard has changed. Return false if the node does not
+  // hold the shard, or if it is being migrated. Else *s is not OK if the SST
+  // could not be written, e.g. because the keys are not sorted.
+  bool Add(rocksdb::Status* s) {
+    int shard_id = request_.shard();
+    if (shard_id != shard_id_) {
+      if (writer_ && !(*s = writer_->Finish()).ok())
+        return true;
+      if (std::find(loaded_.begin(), loaded_.end(), shard_id) !=
+          loaded_.end()) {
+        *s = rocksdb::Status::InvalidArgument("Shard sent twice");
+        return true;
+      }
+      std::shared_ptr<Shard> shard = data_->shards->at(shard_id);
+      // The new master will get the shard soon, so load it there instead
+      if (!shard || shard->exporting() || !shard->Ref())
+        return false;
+      shards_.push_back(shard);
+      loaded_.push_back(shard_id);
+      shard_id_ = shard_id;
+      rocksdb::Options options(data_->db->GetOptions(shard->cf()));
+      writer_.reset(new rocksdb::SstFileWriter(rocksdb::EnvOptions(), options,
+                                               shard->cf()));
+      files_.push_back(Filename(prefix_, shard_id, 0));
+      if (!(*s = writer_->Open(files_.back())).ok())
+        return true;
+    }
+    uint64_t bytes = 0;
+    for (const pb::KeyValue& kv : request_.kvs()) {
+      if (!(*s = writer_->Put(kv.key(), kv.value())).ok())
+        return true;
+      bytes += kv.key().size() + kv.value().size();
+    }
+    shards_.back()->CountWrite(bytes, request_.kvs_size());
+    return true;
+  }
+
+  // Finish the last SST and ingest every SST at once, with its status in
+  // *s. Return false, and the shard in *rejected, if one of the shards has
+  // started being migrated since it was loaded, and then nothing is
+  // ingested (see Shard::BeginIngest()).
+  bool Ingest(rocksdb::Status* s, int* rejected) {
+    if (!writer_)
+      return true;
+    if (!(*s = writer_->Finish()).ok())
+      return true;
+    size_t begun = 0;
+    for (; begun < shards_.size(); begun++)
+      if (!shards_[begun]->BeginIngest())
+        break;
+    bool ok = begun == shards_.size();
+    if (ok) {
+      std::vector<rocksdb::IngestExternalFileArg> args(files_.size());
+      for (size_t i = 0; i < files_.size(); i++) {
+        args[i].column_family = shards_[i]->cf();
+        args[i].external_files.push_back(files_[i]);
+        args[i].options.move_files = true;
+      }
+      *s = data_->db->IngestExternalFiles(args);
+      for (const auto& shard : shards_)
+        shard->Changed();
+    } else {
+      *rejected = loaded_[begun];
+    }
+    for (size_t i = 0; i < begun; i++)
+      shards_[i]->EndIngest();
+    return ok;
+  }
+
+  CallData* data_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncReader<pb::Response, pb::LoadRequest> reader_;
+  pb::LoadRequest request_;
+  pb::Response response_;
+  // Prefix of the SST files, unique to this call
+  std::string prefix_;
+  // The SST of the current shard
+  std::unique_ptr<rocksdb::SstFileWriter> writer_;
+  int shard_id_ = -1;
+  // The shards loaded so far, their ids and their SST files in the same
+  // order
+  std::vector<std::shared_ptr<Shard>> shards_;
+  std::vector<int> loaded_;
+  std::vector<std::string> files_;
+  enum CallStatus { REQUEST, READ, FINISH };
+  CallStatus status_;
   bool finish_called_ = false;
   bool on_done_called_ = false;
 };
@@ -533,6 +1198,11 @@ class IteratorCall final : public Call {
         break;
 
       case READ:
+        if (Expired(ctx_)) {
+          stream_.Finish(expired_status, &proceed);
+          status_ = FINISH;
+          break;
+        }
         if (ok) {
           response_.Clear();
           ApplyIteratorRequest(it_.get(), request_, &response_);
@@ -603,11 +1273,7 @@ class MigrateCall final : public Call {
   }
 
   void Proceed(bool ok) {
-    rocksdb::Status s;
-    pb::MigrateResponse response;
-    bool retval;
     int shard_id;
-    std::shared_ptr<Shard> shard;
 
     switch (status_) {
       case REQUEST:
@@ -624,51 +1290,44 @@ class MigrateCall final : public Call {
         shard_id = request_.shard();
         std::cerr << data_->info->id() << ": Migrating shard " << shard_id
                   << std::endl;
-        shard = data_->shards->at(shard_id);
-        if (!shard) {
-          std::cerr << data_->info->id() << ": Already given and deleted"
-                    << std::endl;
+        shard_ = data_->shards->at(shard_id);
+        if (!shard_ || data_->info->WrongShard(shard_id)) {
+          std::cerr << data_->info->id() << ": Already given" << std::endl;
           stream_.Finish(invalid_status, &proceed);
           status_ = FINISH;
           break;
         }
-        retval = shard->Unref(true);
-        if (!retval)
+        if (request_.start_from() > 0 || request_.offset() > 0 ||
+            request_.sequence() > 0)
           std::cerr << data_->info->id() << ": Resuming from SST "
-                    << request_.start_from() << std::endl;
-        // From now on requests for the shard are rejected
-        data_->info->GiveShard(shard_id);
-        // Inform the new node that he may proceed
-        stream_.Write(response, &proceed);
+                    << request_.start_from() << " at offset "
+                    << request_.offset() << " and sequence "
+                    << request_.sequence() << std::endl;
+        migrator_ = std::unique_ptr<ShardMigrator>(new ShardMigrator(
+            data_->db, shard_id, request_.start_from(), request_.offset(),
+            request_.sequence(), request_.snapshot()));
+        // Files ingested after the snapshot would not be in the WAL
+        shard_->StartExport();
+        // DumpShard() takes a snapshot of the shard, while we keep serving
+        // requests for it. Whatever is written after the snapshot will be
+        // read from the WAL and sent after the SSTs, so we only have to
+        // wait for the references once the new master has caught up.
+        migrator_->DumpShard(shard_->cf());
+        // Inform the new node that he may proceed, and of the snapshot
+        response_.set_snapshot(migrator_->snapshot());
+        stream_.Write(response_, &proceed);
         status_ = WRITE;
-        migrator_ = std::unique_ptr<ShardMigrator>(
-            new ShardMigrator(data_->db, shard_id, request_.start_from()));
-        // DumpShard() creates SST files by iterating on the shard. We can't
-        // modify the database after the iterator snapshot is taken, and
-        // there may be some unfinished requests. So we have to wait for
-        // the reference counter to reach 0 before calling DumpShard().
-        // If we took into account batches, we would have do to that even
-        // before calling GiveShard(). This is necessary, because the batch is
-        // committed on the server that referenced the shard and any writes
-        // that happen from the moment the shard is given until the commit,
-        // will appear to have happened after the commit. However waiting for
-        // the references before giving the shard might cause a deadlock.
-        if (retval)
-          shard->WaitRefs();
-        migrator_->DumpShard(shard->cf());
         break;
 
       case WRITE:
-        if (migrator_->ReadChunk(&response)) {
-          stream_.Write(response, &proceed);
-          status_ = WRITE;
-        } else {
-          stream_.Read(&request_, &proceed);
-          status_ = DONE;
-        }
+        NextResponse();
         break;
 
       case DONE:
+        // The new master has caught up, so from now
+        // on requests for the shard are sent there.
+        if (ok)
+          data_->info->GiveShard(request_.shard());
         stream_.Finish(grpc::Status::OK, &proceed);
         status_ = FINISH;
         break;
@@ -681,6 +1340,29 @@ class MigrateCall final : public Call {
     }
   }
 
+  // Write the next SST chunk or batch of updates. Once the new master
+  // has caught up, stop accepting writes for the shard, send the last
+  // updates and then wait for the new master to confirm.
+  void NextResponse() {
+    pb::MigrateResponse response;
+    bool more = migrator_->ReadChunk(&response);
+    if (!more && !migrator_->frozen()) {
+      // Wait for any write that is in progress to reach the WAL. The
+      // shard has already been unreferenced if we are resuming.
+      if (shard_->Unref(true))
+        shard_->WaitRefs();
+      migrator_->Freeze();
+      more = migrator_->ReadChunk(&response);
+    }
+    if (more) {
+      stream_.Write(response, &proceed);
+      status_ = WRITE;
+    } else {
+      stream_.Read(&request_, &proceed);
+      status_ = DONE;
+    }
+  }
+
   void OnDone(bool ok) {
     assert(ok);
     on_done_called_ = true;
@@ -693,7 +1375,9 @@ class MigrateCall final : public Call {
       std::cerr << data_->info->id() << ": Setting node " << node_id
                 << " as unavailable" << std::endl;
       data_->info->SetAvailable(node_id, false);
-    } else {
+    }
+    // If the shard has not been given, the migration will be resumed
+    if (data_->info->WrongShard(request_.shard())) {
       data_->shards->Remove(request_.shard());
       if (migrator_)
         migrator_->ClearState();
@@ -718,6 +1402,8 @@ class MigrateCall final : public Call {
       stream_;
   pb::MigrateRequest request_;
   pb::MigrateResponse response_;
+  // Referenced by the call, so that it is kept around until it is sent
+  std::shared_ptr<Shard> shard_;
   enum CallStatus { REQUEST, READ, WRITE, DONE, FINISH };
   CallStatus status_;
   std::unique_ptr<ShardMigrator> migrator_;
@@ -759,6 +1445,8 @@ AsyncServer::~AsyncServer() {
   info_.WatchCancel(call_);
   watcher_.join();
   info_.WatchEnd(call_);
+  // Prepared transactions hold references to shards
+  transactions_.reset();
   delete shards_;
   delete default_cf_;
   delete db_;
@@ -766,7 +1454,8 @@ AsyncServer::~AsyncServer() {
 }
 
 void AsyncServer::Init(const std::string& listening_address,
-                       const std::string& hostname, int num_shards) {
+                       const std::string& hostname, int num_shards,
+                       double weight) {
   // Initialize gRPC
   grpc::ServerBuilder builder;
   int selected_port;
@@ -787,7 +1476,7 @@ void AsyncServer::Init(const std::string& listening_address,
   std::string node_address = hostname + ":" + port;
   // TODO: This knows if we are resuming. We could return a relevant
   // bool, and if resuming check that we have the right column families.
-  info_.Add(node_address, num_shards);
+  info_.Add(node_address, num_shards, weight);
 
   // Open RocksDB database
   std::vector<std::string> column_families;
@@ -833,17 +1522,19 @@ void AsyncServer::Init(const std::string& listening_address,
   for (const auto& task : info_.Tasks()) {
     for (int shard_id : task.second) {
       Shard* shard = shards_->at(shard_id).get();
-      if (shard) {
+      if (shard)
         shard->set_importing(true);
-        std::string key = Key(shard_id, "largest_key");
-        std::string value;
-        rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &value);
-        if (s.ok())
-          shard->set_largest_key(value);
-      }
     }
   }
 
+  // A migration that is resumed reuses the snapshot it took before the
+  // crash, so nothing may be ingested into the shard until it is over
+  for (int shard_id : shards_->ids()) {
+    Shard* shard = shards_->at(shard_id).get();
+    if (shard && !shard->importing() && info_.IsMigrating(shard_id))
+      shard->StartExport();
+  }
+
   // Create a thread that watches the "info" key and repeatedly
   // reads for updates. Gets cleaned up by the destructor.
   watcher_ = std::thread(&AsyncServer::WatchThread, this);
@@ -852,17 +1543,25 @@ void AsyncServer::Init(const std::string& listening_address,
 
 void AsyncServer::Run() {
   std::vector<std::thread> threads;
+  sequencer_.reset(new Sequencer(info_.id()));
+  transactions_.reset(new Transactions(db_));
   for (int i = 0; i < num_threads_; i++) {
-    CallData data{&service_, cqs_[i].get(), db_, &info_, shards_};
+    CallData data{&service_, cqs_[i].get(), db_, &info_, shards_,
+                  sequencer_.get(), transactions_.get()};
     new PingCall(&data);
     new GetCall(&data);
     new PutCall(&data);
     new DeleteCall(&data);
     new BatchCall(&data);
+    new BatchWriteCall(&data);
+    new LoadCall(&data);
+    new TransactionCall(&data);
     new IteratorCall(&data);
+    new StatsCall(&data);
     threads.emplace_back(std::thread(&AsyncServer::ServeThread, this, i));
   }
-  CallData migrate_data{&service_, migrate_cq_.get(), db_, &info_, shards_};
+  CallData migrate_data{&service_, migrate_cq_.get(), db_, &info_, shards_,
+                        sequencer_.get(), transactions_.get()};
   new MigrateCall(&migrate_data);
   info_.SetAvailable(info_.id(), true);
   void* tag;
@@ -897,7 +1596,8 @@ void AsyncServer::WatchThread() {
     for (const auto& task : info_.Tasks()) {
       int node_id = task.first;
       std::string address = info_.Address(node_id);
-      for (int shard_id : task.second) {
+      for (size_t i = 0; i < task.second.size(); i++) {
+        int shard_id = task.second[i];
         if (!info_.IsAvailable(node_id)) {
           std::cerr << info_.id() << ": Node " << node_id
                     << " is unavailable. Skipping request for shard "
@@ -912,7 +1612,7 @@ void AsyncServer::WatchThread() {
         if (info_.IndexForShard(shard_id) != info_.id()) {
           if (!shards_->at(shard_id))
             // We don't have it so create it
-            shard = shards_->Add(shard_id, address).get();
+            shard = shards_->Add(shard_id).get();
           else
             // We managed to create it before crashing. We
             // should ensure that it is empty as it should.
@@ -926,7 +1626,7 @@ void AsyncServer::WatchThread() {
         // that we didn't manage to ingest. Try to do that. If
         // there isn't such a file, Ingest() will silently fail.
         if (!importer.filename().empty())
-          shard->Ingest(importer.filename(), importer.largest_key());
+          shard->Ingest(importer.filename());
 
         pb::MigrateRequest request;
         pb::MigrateResponse response;
@@ -938,6 +1638,9 @@ void AsyncServer::WatchThread() {
         // Send a request for the shard
         request.set_shard(shard_id);
         request.set_start_from(importer.num());
+        request.set_offset(importer.offset());
+        request.set_sequence(importer.sequence());
+        request.set_snapshot(importer.snapshot());
         auto stream = stub->Migrate(&context);
         if (!stream->Write(request)) {
           std::cerr << info_.id() << ": Error on first write" << std::endl;
@@ -946,33 +1649,35 @@ void AsyncServer::WatchThread() {
           continue;
         }
 
-        // Once the old master gets the request, he is supposed to
-        // pass ownership to us by informing etcd and then send
-        // an empty response as a confirmation. We wait for these
-        // events in reverse order to avoid a deadlock, and start
-        // serving requests for that shard as soon as possible.
+        // Once the old master gets the request, he takes a snapshot
+        // of the shard and sends an empty response as a confirmation.
+        // He keeps serving requests for the shard until we catch up.
         if (!stream->Read(&response)) {
-          std::cerr << info_.id() << ": Error on second read" << std::endl;
+          std::cerr << info_.id() << ": Error on first read" << std::endl;
           grpc::Status status = stream->Finish();
           if (status.error_code() == grpc::StatusCode::INVALID_ARGUMENT) {
             std::cerr << "Migration was already finished but didn't manage to "
                          "announce it before crashing"
                       << std::endl;
+            shard->set_importing(false);
             MigrationOver(importer, shard_id);
           } else {
             HandleError(status, node_id);
           }
           continue;
         }
-        while (info_.IndexForShard(shard_id) != info_.id()) {
-          bool ret = info_.WatchNext(call_);
-          assert(!ret);
+
+        // If he no longer has the snapshot we have been importing, he
+        // sends a new one, and we drop what we have imported from the old
+        if (response.snapshot() != importer.snapshot()) {
+          if (importer.snapshot() != 0)
+            shard->Clear();
+          importer.Restart(response.snapshot());
         }
-        // From now on requests for the shard are accepted
 
         // The second read should be ok. Even if the shard is empty,
         // one message will be sent. So if it is not ok, it means he
-        // crashed. We cannot know if he managed to give the shard.
+        // crashed, and the migration will be resumed.
         if (!stream->Read(&response)) {
           std::cerr << info_.id() << ": Error on second read" << std::endl;
           grpc::Status status = stream->Finish();
@@ -980,14 +1685,40 @@ void AsyncServer::WatchThread() {
           continue;
         }
 
+        // First come the SSTs of the snapshot and then the
+        // updates that were written to the shard after it.
+        bool corrupt = false;
         do {
           if (response.finished())
             break;
-          // If true an SST is ready to be imported
-          if (importer.WriteChunk(response))
-            shard->Ingest(importer.filename(), importer.largest_key());
+          bool complete;
+          if (response.restart()) {
+            // The updates since the snapshot are gone, so he sends a new one
+            shard->Clear();
+            importer.Restart(response.snapshot());
+          } else if (response.updates_size() > 0) {
+            importer.ApplyUpdates(shard->cf(), response);
+          } else if (!importer.WriteChunk(response, &complete)) {
+            corrupt = true;
+            break;
+          } else if (complete) {
+            // An SST is ready to be imported
+            shard->Ingest(importer.filename());
+          }
         } while (stream->Read(&response));
 
+        if (corrupt) {
+          // Drop the stream and request the shard again, which resumes
+          // from the last chunk that was saved, as after a broken connection
+          context.TryCancel();
+          stream->Finish();
+          std::cerr << info_.id() << ": Requesting shard " << shard_id
+                    << " again after a corrupt chunk" << std::endl;
+          i--;
+          continue;
+        }
+
+        // Confirm that we have caught up, so that he gives us the shard
         stream->Write(request);
         grpc::Status status = stream->Finish();
         if (!status.ok()) {
@@ -996,8 +1727,9 @@ void AsyncServer::WatchThread() {
           continue;
         }
 
-        MigrationOver(importer, shard_id);
+        // From now on requests for the shard are accepted
         shard->set_importing(false);
+        MigrationOver(importer, shard_id);
         std::cerr << info_.id() << ": Imported shard " << shard_id << std::endl;
       }
     }
@@ -41,8 +41,10 @@ class DB;
 
 namespace crocks {
 
+class Sequencer;
 class Shards;
 class ShardImporter;
+class Transactions;
 
 class AsyncServer final {
  public:
@@ -53,7 +55,7 @@ class AsyncServer final {
   // Start listening for incoming client connections, announce server to
   // etcd, open RocksDB database, and start watching etcd for changes
   void Init(const std::string& listening_address, const std::string& hostname,
-            int num_shards);
+            int num_shards, double weight);
 
   void Run();
 
@@ -73,6 +75,8 @@ class AsyncServer final {
   rocksdb::ColumnFamilyHandle* default_cf_ = nullptr;
   Info info_;
   Shards* shards_;
+  std::unique_ptr<Sequencer> sequencer_;
+  std::unique_ptr<Transactions> transactions_;
   void* call_ = nullptr;
   std::thread watcher_;
   int num_threads_;
@@ -0,0 +1,197 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/server/bulk_batch.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/write_batch.h>
+
+#include "src/common/run_file.h"
+#include "src/common/util.h"
+
+namespace crocks {
+
+namespace {
+
+// The types of the records of a run (see src/common/run_file.h). A single
+// deletion becomes a deletion.
+const char kTypePut = 0;
+const char kTypeDelete = 1;
+
+struct Update {
+  uint32_t cf;
+  char type;
+  rocksdb::Slice key;
+  rocksdb::Slice value;
+};
+
+// Collects the updates of a batch, pointing into its data
+class Collector : public rocksdb::WriteBatch::Handler {
+ public:
+  rocksdb::Status PutCF(uint32_t cf, const rocksdb::Slice& key,
+                        const rocksdb::Slice& value) override {
+    updates.push_back(Update{cf, kTypePut, key, value});
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status DeleteCF(uint32_t cf, const rocksdb::Slice& key) override {
+    updates.push_back(Update{cf, kTypeDelete, key, rocksdb::Slice()});
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status SingleDeleteCF(uint32_t cf,
+                                 const rocksdb::Slice& key) override {
+    return DeleteCF(cf, key);
+  }
+
+  rocksdb::Status MergeCF(uint32_t /* cf */, const rocksdb::Slice& /* key */,
+                          const rocksdb::Slice& /* value */) override {
+    return rocksdb::Status::NotSupported("Cannot spill merges");
+  }
+
+  std::vector<Update> updates;
+};
+
+bool Before(const Update& a, const Update& b) {
+  if (a.cf != b.cf)
+    return a.cf < b.cf;
+  return a.key.compare(b.key) < 0;
+}
+
+}  // namespace
+
+BulkBatch::BulkBatch(rocksdb::DB* db)
+    : db_(db),
+      prefix_(db->GetName() + "/batch_" + std::to_string(RandomId())) {}
+
+BulkBatch::~BulkBatch() {
+  Clear();
+  // Moved into the database if they were ingested
+  for (const auto& sst : ssts_)
+    remove(sst.c_str());
+}
+
+rocksdb::Status BulkBatch::Spill(rocksdb::WriteBatch* batch) {
+  Collector collector;
+  rocksdb::Status s = batch->Iterate(&collector);
+  if (!s.ok())
+    return s;
+  std::vector<Update>& updates = collector.updates;
+  if (updates.empty())
+    return s;
+  // Updates of the same key stay in the order they were added
+  std::stable_sort(updates.begin(), updates.end(), Before);
+
+  std::string filename = Filename("run", runs_.size());
+  RunWriter writer(filename);
+  for (size_t i = 0; i < updates.size(); i++) {
+    // Skip the updates that are overridden by the next one
+    if (i + 1 < updates.size() && !Before(updates[i], updates[i + 1]))
+      continue;
+    const Update& update = updates[i];
+    writer.Add(update.cf, update.type, update.key.data(), update.key.size(),
+               update.value.data(), update.value.size());
+  }
+  runs_.push_back(filename);
+  if (!writer.Close())
+    return rocksdb::Status::IOError("Cannot write " + filename);
+  batch->Clear();
+  return s;
+}
+
+void BulkBatch::Clear() {
+  for (const auto& run : runs_)
+    remove(run.c_str());
+  runs_.clear();
+}
+
+rocksdb::Status BulkBatch::Commit(
+    rocksdb::WriteBatch* batch,
+    const std::vector<rocksdb::ColumnFamilyHandle*>& cfs) {
+  rocksdb::Status s = Spill(batch);
+  if (!s.ok())
+    return s;
+  std::unordered_map<uint32_t, rocksdb::ColumnFamilyHandle*> handles;
+  for (const auto cf : cfs)
+    handles[cf->GetID()] = cf;
+  std::vector<std::pair<uint32_t, std::string>> files;
+  s = Merge(handles, &files);
+  Clear();
+  if (!s.ok())
+    return s;
+
+  // One file per column family, so that they are all ingested or none
+  std::vector<rocksdb::IngestExternalFileArg> args(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    args[i].column_family = handles[files[i].first];
+    args[i].external_files.push_back(files[i].second);
+    args[i].options.move_files = true;
+  }
+  return db_->IngestExternalFiles(args);
+}
+
+// private
+std::string BulkBatch::Filename(const std::string& kind, int num) const {
+  return prefix_ + "_" + std::to_string(num) + "." + kind;
+}
+
+rocksdb::Status BulkBatch::Merge(
+    const std::unordered_map<uint32_t, rocksdb::ColumnFamilyHandle*>& cfs,
+    std::vector<std::pair<uint32_t, std::string>>* files) {
+  rocksdb::Status s;
+  std::unique_ptr<rocksdb::SstFileWriter> writer;
+  uint32_t cf = 0;
+  RunMerger merger(runs_);
+  for (; merger.Valid(); merger.Next()) {
+    const RunReader& update = merger.record();
+    if (writer == nullptr || update.tag != cf) {
+      if (writer != nullptr && !(s = writer->Finish()).ok())
+        return s;
+      cf = update.tag;
+      auto handle = cfs.find(cf);
+      if (handle == cfs.end())
+        return rocksdb::Status::InvalidArgument("Unknown column family");
+      rocksdb::Options options(db_->GetOptions(handle->second));
+      writer.reset(new rocksdb::SstFileWriter(rocksdb::EnvOptions(), options,
+                                              handle->second));
+      ssts_.push_back(Filename("sst", ssts_.size()));
+      files->emplace_back(cf, ssts_.back());
+      if (!(s = writer->Open(ssts_.back())).ok())
+        return s;
+    }
+    if (update.type == kTypePut)
+      s = writer->Put(update.key, update.value);
+    else
+      s = writer->Delete(update.key);
+    if (!s.ok())
+      return s;
+  }
+  if (!merger.ok())
+    return rocksdb::Status::Corruption("Cannot read run");
+  if (writer != nullptr)
+    s = writer->Finish();
+  return s;
+}
+
+}  // namespace crocks
@@ -0,0 +1,98 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_SERVER_BULK_BATCH_H
+#define CROCKS_SERVER_BULK_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <rocksdb/status.h>
+
+namespace rocksdb {
+class ColumnFamilyHandle;
+class DB;
+class WriteBatch;
+}  // namespace rocksdb
+
+namespace crocks {
+
+// A batch call spills its updates once they take up more than this
+const size_t kSpillThreshold = 64 * 1024 * 1024;  // 64MB
+
+// Keeps the memory of a huge batch bounded. Every time the updates that the
+// batch call has received take up more than kSpillThreshold, they are
+// sorted and written to a temporary run file, and the batch is cleared. On
+// commit, the runs are merged into an SST file per column family, which are
+// all ingested at once. So the updates are neither written to the WAL nor
+// to the memtables, and the SST files are not compacted any further if they
+// do not overlap with existing data.
+//
+// Within a run, only the last update of each key is kept, and a later run
+// overrides an earlier one. Merges cannot be collapsed like this without
+// the merge operator, so batches that contain them are not spilled.
+class BulkBatch {
+ public:
+  // The temporary files are created in the directory of db
+  explicit BulkBatch(rocksdb::DB* db);
+  // Remove the files that are left
+  ~BulkBatch();
+
+  // Write the updates of batch to a new run and clear batch. Fails with
+  // status NotSupported, and leaves batch as is, if it contains a merge.
+  rocksdb::Status Spill(rocksdb::WriteBatch* batch);
+
+  // Whether any updates have been spilled
+  bool spilled() const {
+    return !runs_.empty();
+  }
+
+  // Drop the updates spilled so far
+  void Clear();
+
+  // Spill what is left in batch, merge the runs into SST files and ingest
+  // them atomically. cfs are the column families of the updates.
+  rocksdb::Status Commit(rocksdb::WriteBatch* batch,
+                         const std::vector<rocksdb::ColumnFamilyHandle*>& cfs);
+
+ private:
+  std::string Filename(const std::string& kind, int num) const;
+
+  // Merge the runs into an SST file per column family, and add them to
+  // *files along with the id of their column family
+  rocksdb::Status Merge(
+      const std::unordered_map<uint32_t, rocksdb::ColumnFamilyHandle*>& cfs,
+      std::vector<std::pair<uint32_t, std::string>>* files);
+
+  rocksdb::DB* db_;
+  // Prefix of the temporary files, unique to this batch
+  std::string prefix_;
+  std::vector<std::string> runs_;
+  std::vector<std::string> ssts_;
+  // No copying allowed
+  BulkBatch(const BulkBatch&) = delete;
+  void operator=(const BulkBatch&) = delete;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_SERVER_BULK_BATCH_H
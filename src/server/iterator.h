@@ -51,7 +51,7 @@ class RocksdbIteratorGreater {
   const rocksdb::Comparator* comparator_;
 };
 
-// Used for the min heap (forward iteration)
+// Used for the max heap (reverse iteration)
 class RocksdbIteratorLess {
  public:
   RocksdbIteratorLess() : comparator_(rocksdb::BytewiseComparator()) {}
@@ -144,10 +144,11 @@ class MultiIterator {
     if (!forward_)
       Seek(key());
     assert(current_ == min_heap_.top());
-    min_heap_.pop();
     current_->Next();
     if (current_->Valid())
-      min_heap_.push(current_);
+      min_heap_.replace_top(current_);
+    else
+      min_heap_.pop();
     current_ = min_heap_.top();
   }
 
@@ -156,10 +157,11 @@ class MultiIterator {
     if (forward_)
       SeekForPrev(key());
     assert(current_ == max_heap_.top());
-    max_heap_.pop();
     current_->Prev();
     if (current_->Valid())
-      max_heap_.push(current_);
+      max_heap_.replace_top(current_);
+    else
+      max_heap_.pop();
     current_ = max_heap_.top();
   }
 
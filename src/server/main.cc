@@ -16,14 +16,17 @@
 // along with crocks.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <getopt.h>
 #include <ifaddrs.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/socket.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 
+#include <cmath>
 #include <iostream>
 #include <string>
 
@@ -44,10 +47,43 @@ const std::string usage_message(
     "  -e, --etcd <address>   Etcd address [default: localhost:2379].\n"
     "  -t, --threads <int>    Number of serving threads [default: 2].\n"
     "  -s, --shards <int>     Number of initial shards [default: 10].\n"
+    "  -w, --weight <weight>  Positive relative capacity of the node, or\n"
+    "                         \"auto\" for the size of the disk in TB\n"
+    "                         [default: the weight it had before, or 1].\n"
     "  -d, --daemon           Daemonize process.\n"
     "  -v, --version          Show version and exit.\n"
     "  -h, --help             Show this help message and exit.\n");
 
+// Return the size of the filesystem that contains path in TB. The database
+// may not exist yet, so it falls back to the closest existing parent.
+double DiskSize(std::string path) {
+  struct statvfs buf;
+  while (statvfs(path.c_str(), &buf) < 0) {
+    if (errno != ENOENT || path == ".") {
+      perror("statvfs");
+      exit(EXIT_FAILURE);
+    }
+    size_t end = path.find_last_not_of('/');
+    size_t pos = end == std::string::npos ? end : path.find_last_of('/', end);
+    if (pos == std::string::npos)
+      path = ".";
+    else
+      path = pos == 0 ? "/" : path.substr(0, pos);
+  }
+  return static_cast<double>(buf.f_blocks) * buf.f_frsize / 1e12;
+}
+
+// Parse a weight, which must be a positive number, or 0 on error
+double ParseWeight(const char* str) {
+  char* end = nullptr;
+  errno = 0;
+  double weight = strtod(str, &end);
+  if (errno != 0 || end == str || *end != '\0' || !std::isfinite(weight) ||
+      !(weight > 0))
+    return 0;
+  return weight;
+}
+
 std::string GetIP() {
   struct ifaddrs* head = nullptr;
   struct ifaddrs* ifa = nullptr;
@@ -78,8 +114,11 @@ int main(int argc, char** argv) {
   std::string etcd_address = crocks::GetEtcdEndpoint();
   int num_threads = 2;
   int num_shards = 10;
+  bool auto_weight = false;
+  // Zero keeps the weight that the node had before it restarted
+  double weight = 0;
 
-  const char* optstring = "p:o:H:P:e:t:s:dvh";
+  const char* optstring = "p:o:H:P:e:t:s:w:dvh";
   static struct option longopts[] = {
       // clang-format off
       {"path",    required_argument, 0, 'p'},
@@ -89,6 +128,7 @@ int main(int argc, char** argv) {
       {"etcd",    required_argument, 0, 'e'},
       {"threads", required_argument, 0, 't'},
       {"shards",  required_argument, 0, 's'},
+      {"weight",  required_argument, 0, 'w'},
       {"daemon",  no_argument,       0, 'd'},
       {"version", no_argument,       0, 'v'},
       {"help",    no_argument,       0, 'h'},
@@ -121,6 +161,13 @@ int main(int argc, char** argv) {
       case 's':
         num_shards = std::stoi(optarg);
         break;
+      case 'w':
+        auto_weight = std::string(optarg) == "auto";
+        if (!auto_weight && (weight = ParseWeight(optarg)) == 0) {
+          std::cout << usage_message;
+          exit(EXIT_FAILURE);
+        }
+        break;
       case 'd':
         if (daemon(0, 0) < 0) {
           perror("daemon");
@@ -149,10 +196,12 @@ int main(int argc, char** argv) {
   }
 
   std::string listening_address = "0.0.0.0:" + port;
+  if (auto_weight)
+    weight = DiskSize(dbpath);
 
   // Start server
   crocks::AsyncServer server(etcd_address, dbpath, options_path, num_threads);
-  server.Init(listening_address, hostname, num_shards);
+  server.Init(listening_address, hostname, num_shards, weight);
   server.Run();
 
   return 0;
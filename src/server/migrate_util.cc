@@ -20,6 +20,10 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
 
 #include <rocksdb/db.h>
 #include <rocksdb/env.h>
@@ -28,9 +32,11 @@
 #include <rocksdb/slice.h>
 #include <rocksdb/sst_file_writer.h>
 #include <rocksdb/status.h>
+#include <rocksdb/transaction_log.h>
 #include <rocksdb/write_batch.h>
 
 #include "gen/crocks.pb.h"
+#include "src/common/hash.h"
 #include "src/server/util.h"
 
 // First try. For each shard, write as many
@@ -46,78 +52,120 @@ std::string Filename(const std::string& path, int shard, int num) {
   return path + "/shard_" + std::to_string(shard) + "_" + std::to_string(num);
 }
 
-ShardMigrator::ShardMigrator(rocksdb::DB* db, int shard, int start_from)
-    : db_(db),
-      total_(0),
-      num_(start_from),
-      shard_(shard),
-      done_(false),
-      finished_(false) {}
+namespace {
 
-void ShardMigrator::DumpShard(rocksdb::ColumnFamilyHandle* cf) {
-  if (RestoreState())
-    return;
+const int kBufSize = 1 << 20;  // 1MB
 
-  rocksdb::Status s;
-  rocksdb::Options options(db_->GetOptions());
-  rocksdb::ExternalSstFileInfo file_info;
-  rocksdb::Iterator* it = db_->NewIterator(rocksdb::ReadOptions(), cf);
-  rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options,
-                                options.comparator);
-  int num = 0;
-  bool open = false;
-  it->SeekToFirst();
-  if (!it->Valid()) {
-    done_ = true;
-    delete it;
-    return;
+// Checksums of consecutive chunks are chained through the seed
+uint32_t Checksum(const std::string& chunk, uint32_t seed) {
+  return MurmurHash(chunk.data(), chunk.size(), seed);
+}
+
+// Collects the updates of a single column family into a MigrateResponse
+class UpdateCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  UpdateCollector(uint32_t cf_id, pb::MigrateResponse* response)
+      : cf_id_(cf_id), response_(response), size_(0) {}
+
+  rocksdb::Status PutCF(uint32_t cf_id, const rocksdb::Slice& key,
+                        const rocksdb::Slice& value) override {
+    if (cf_id == cf_id_)
+      Add(pb::BatchUpdate::PUT, key, value);
+    return rocksdb::Status::OK();
   }
 
-  while (it->Valid()) {
-    if (!open) {
-      // `num` starts from 0, and when the loop is over,
-      // it contains the number of SST files written.
-      s = writer.Open(Filename(db_->GetName(), shard_, num++));
-      EnsureRocksdb("SstFileWriter::Open", s);
-      open = true;
-    }
-    s = writer.Put(it->key(), it->value());
-    EnsureRocksdb("SstFileWriter::Add", s);
-    if (writer.FileSize() > options.target_file_size_base) {
-      s = writer.Finish(&file_info);
-      EnsureRocksdb("SstFileWriter::Finish", s);
-      largest_keys_.push_back(file_info.largest_key);
-      open = false;
-    }
-    it->Next();
+  rocksdb::Status DeleteCF(uint32_t cf_id,
+                           const rocksdb::Slice& key) override {
+    if (cf_id == cf_id_)
+      Add(pb::BatchUpdate::DELETE, key, rocksdb::Slice());
+    return rocksdb::Status::OK();
   }
 
-  if (open) {
-    s = writer.Finish(&file_info);
-    largest_keys_.push_back(file_info.largest_key);
-    EnsureRocksdb("SstFileWriter::Finish", s);
+  rocksdb::Status SingleDeleteCF(uint32_t cf_id,
+                                 const rocksdb::Slice& key) override {
+    if (cf_id == cf_id_)
+      Add(pb::BatchUpdate::SINGLE_DELETE, key, rocksdb::Slice());
+    return rocksdb::Status::OK();
   }
 
-  EnsureRocksdb("Iterator", it->status());
-  delete it;
+  rocksdb::Status MergeCF(uint32_t cf_id, const rocksdb::Slice& key,
+                          const rocksdb::Slice& value) override {
+    if (cf_id == cf_id_)
+      Add(pb::BatchUpdate::MERGE, key, value);
+    return rocksdb::Status::OK();
+  }
 
-  total_ = num;
-  assert(largest_keys_.size() == total_);
+  rocksdb::Status DeleteRangeCF(uint32_t cf_id,
+                                const rocksdb::Slice& begin_key,
+                                const rocksdb::Slice& end_key) override {
+    if (cf_id == cf_id_)
+      Add(pb::BatchUpdate::DELETE_RANGE, begin_key, end_key);
+    return rocksdb::Status::OK();
+  }
 
-  if (num_ >= total_)
-    done_ = true;
+  int size() const {
+    return size_;
+  }
 
-  SaveState();
+ private:
+  void Add(pb::BatchUpdate::Operation op, const rocksdb::Slice& key,
+           const rocksdb::Slice& value) {
+    pb::BatchUpdate* update = response_->add_updates();
+    update->set_op(op);
+    update->set_key(key.data(), key.size());
+    update->set_value(value.data(), value.size());
+    size_ += key.size() + value.size();
+  }
+
+  uint32_t cf_id_;
+  pb::MigrateResponse* response_;
+  int size_;
+};
+
+}  // namespace
+
+ShardMigrator::ShardMigrator(rocksdb::DB* db, int shard, int start_from,
+                             uint64_t offset, uint64_t sequence,
+                             uint64_t snapshot)
+    : db_(db),
+      cf_(nullptr),
+      total_(0),
+      num_(start_from),
+      offset_(offset),
+      snapshot_(0),
+      sequence_(sequence),
+      imported_(snapshot),
+      shard_(shard),
+      restart_(false),
+      done_(false),
+      caught_up_(false),
+      frozen_(false),
+      finished_(false) {}
+
+void ShardMigrator::DumpShard(rocksdb::ColumnFamilyHandle* cf) {
+  cf_ = cf;
+  if (RestoreState() && imported_ == snapshot_) {
+    assert(num_ <= total_);
+    if (num_ == total_)
+      done_ = true;
+    if (sequence_ <= snapshot_)
+      sequence_ = snapshot_ + 1;
+    return;
+  }
+  // The new master has been importing another snapshot, which he drops
+  // once he sees the one of the first response, so start from scratch.
+  // Some of its SSTs may have been deleted already.
+  num_ = 0;
+  offset_ = 0;
+  sequence_ = 0;
+  Dump();
 }
 
 void ShardMigrator::SaveState() {
   rocksdb::WriteBatch batch;
   batch.Put(Key(shard_, "dumped"), "true");
   batch.Put(Key(shard_, "total"), std::to_string(total_));
-  for (unsigned int i = 0; i < total_; i++) {
-    std::string key = std::to_string(i) + "_largest_key";
-    batch.Put(Key(shard_, key), largest_keys_[i]);
-  }
+  batch.Put(Key(shard_, "snapshot"), std::to_string(snapshot_));
   rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
   EnsureRocksdb("Write(migrator_state)", s);
 }
@@ -134,15 +182,9 @@ bool ShardMigrator::RestoreState() {
     s = db_->Get(options, Key(shard_, "total"), &value);
     EnsureRocksdb("Get(total)", s);
     total_ = std::stoi(value);
-    for (unsigned int i = 0; i < total_; i++) {
-      std::string key = std::to_string(i) + "_largest_key";
-      s = db_->Get(options, Key(shard_, key), &value);
-      EnsureRocksdb("Get(largest_key)", s);
-      largest_keys_.push_back(value);
-    }
-    assert(num_ <= total_);
-    if (num_ == total_)
-      done_ = true;
+    s = db_->Get(options, Key(shard_, "snapshot"), &value);
+    EnsureRocksdb("Get(snapshot)", s);
+    snapshot_ = std::stoull(value);
     return true;
   }
   return false;
@@ -152,10 +194,7 @@ void ShardMigrator::ClearState() {
   rocksdb::WriteBatch batch;
   batch.Delete(Key(shard_, "dumped"));
   batch.Delete(Key(shard_, "total"));
-  for (unsigned int i = 0; i < total_; i++) {
-    std::string key = std::to_string(i) + "_largest_key";
-    batch.Delete(Key(shard_, key));
-  }
+  batch.Delete(Key(shard_, "snapshot"));
   rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
   EnsureRocksdb("Write(migrator_state)", s);
   // Delete the last file
@@ -165,12 +204,32 @@ void ShardMigrator::ClearState() {
 }
 
 bool ShardMigrator::ReadChunk(pb::MigrateResponse* response) {
-  // When the last chunk is sent, we set done = true.
-  // The next message will have finished = true and will be the last.
   if (finished_)
     return false;
 
+  if (restart_) {
+    // The new master drops the shard before the SSTs of the new snapshot
+    restart_ = false;
+    response->set_restart(true);
+    response->set_snapshot(snapshot_);
+    return true;
+  }
+
   if (done_) {
+    // Every SST has been sent, so send whatever was written since the
+    // snapshot. Once the shard is frozen and there is nothing left,
+    // the next message will have finished = true and will be the last.
+    if (caught_up_ && !frozen_)
+      return false;
+    if (!ReadUpdates(response)) {
+      response->Clear();
+      Restart();
+      return ReadChunk(response);
+    }
+    if (response->updates_size() > 0)
+      return true;
+    if (!frozen_)
+      return false;
     response->set_finished(true);
     finished_ = true;
     return true;
@@ -187,66 +246,268 @@ bool ShardMigrator::ReadChunk(pb::MigrateResponse* response) {
       perror(filename_.c_str());
       exit(EXIT_FAILURE);
     }
+    // Skip whatever the new master already has
+    if (offset_ > 0) {
+      in_.seekg(offset_);
+      offset_ = 0;
+    }
   }
 
-  const int kBufSize = 1 << 20;  // 1MB
   char buf[kBufSize];
   in_.read(buf, kBufSize);
   response->set_eof(false);
-  response->set_largest_key("");
   response->set_chunk(buf, in_.gcount());
+  response->set_checksum(Checksum(response->chunk(), 0));
 
   if (in_.eof()) {
     response->set_eof(true);
-    response->set_largest_key(largest_keys_[num_++]);
+    num_++;
     in_.close();
     // We cannot delete the file here because we may have to send it again
   }
 
-  // On the last message set done_ = true, so that the
-  // next time ReadChunk is called, it will return false;
+  // After the last chunk set done_ = true, so that the
+  // next time ReadChunk is called, it will read updates.
   if (num_ == total_ && !in_.is_open())
     done_ = true;
 
   return true;
 }
 
+// private
+void ShardMigrator::Dump() {
+  rocksdb::Status s;
+  rocksdb::Options options(db_->GetOptions());
+  rocksdb::ExternalSstFileInfo file_info;
+  // Everything written after the snapshot will be read from the WAL
+  const rocksdb::Snapshot* snapshot = db_->GetSnapshot();
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  rocksdb::Iterator* it = db_->NewIterator(read_options, cf_);
+  rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options,
+                                options.comparator);
+  int num = 0;
+  bool open = false;
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    if (!open) {
+      // `num` starts from 0, and when the loop is over,
+      // it contains the number of SST files written.
+      s = writer.Open(Filename(db_->GetName(), shard_, num++));
+      EnsureRocksdb("SstFileWriter::Open", s);
+      open = true;
+    }
+    s = writer.Put(it->key(), it->value());
+    EnsureRocksdb("SstFileWriter::Add", s);
+    if (writer.FileSize() > options.target_file_size_base) {
+      s = writer.Finish(&file_info);
+      EnsureRocksdb("SstFileWriter::Finish", s);
+      open = false;
+    }
+  }
+
+  if (open) {
+    s = writer.Finish(&file_info);
+    EnsureRocksdb("SstFileWriter::Finish", s);
+  }
+
+  EnsureRocksdb("Iterator", it->status());
+  delete it;
+  snapshot_ = snapshot->GetSequenceNumber();
+  db_->ReleaseSnapshot(snapshot);
+
+  total_ = num;
+  if (num_ >= total_)
+    done_ = true;
+  if (sequence_ <= snapshot_)
+    sequence_ = snapshot_ + 1;
+
+  SaveState();
+}
+
+void ShardMigrator::Restart() {
+  std::cerr << "Updates of shard " << shard_
+            << " are no longer in the WAL, sending a new snapshot"
+            << std::endl;
+  // The new snapshot overwrites the rest of the SSTs
+  if (!filename_.empty())
+    if (remove(filename_.c_str()) < 0)
+      perror(filename_.c_str());
+  filename_.clear();
+  num_ = 0;
+  offset_ = 0;
+  sequence_ = 0;
+  done_ = false;
+  caught_up_ = false;
+  restart_ = true;
+  Dump();
+}
+
+bool ShardMigrator::ReadUpdates(pb::MigrateResponse* response) {
+  caught_up_ = true;
+  if (sequence_ > db_->GetLatestSequenceNumber())
+    return true;
+
+  std::unique_ptr<rocksdb::TransactionLogIterator> iter;
+  rocksdb::Status s = db_->GetUpdatesSince(sequence_, &iter);
+  // The oldest WAL files are deleted past WAL_size_limit_MB
+  if (s.IsNotFound())
+    return false;
+  EnsureRocksdb("GetUpdatesSince", s);
+  UpdateCollector collector(cf_->GetID(), response);
+  for (; iter->Valid(); iter->Next()) {
+    rocksdb::BatchResult result = iter->GetBatch();
+    // The first batch may have already been sent
+    if (result.sequence < sequence_)
+      continue;
+    // The oldest WAL file left starts after the next update
+    if (result.sequence > sequence_)
+      return false;
+    s = result.writeBatchPtr->Iterate(&collector);
+    EnsureRocksdb("WriteBatch::Iterate", s);
+    sequence_ = result.sequence + result.writeBatchPtr->Count();
+    if (collector.size() > kBufSize) {
+      caught_up_ = false;
+      break;
+    }
+  }
+  // TryAgain only means that we have reached the end of the log, while
+  // NotFound means that there is a gap in it
+  s = iter->status();
+  if (caught_up_ && s.IsNotFound())
+    return false;
+  if (caught_up_ && !s.IsTryAgain())
+    EnsureRocksdb("TransactionLogIterator", s);
+  response->set_sequence(sequence_);
+  return true;
+}
+
 ShardImporter::ShardImporter(rocksdb::DB* db, int shard)
-    : db_(db), num_(0), shard_(shard) {
+    : db_(db),
+      num_(0),
+      offset_(0),
+      checksum_(0),
+      sequence_(0),
+      snapshot_(0),
+      shard_(shard) {
   RestoreState();
+  if (offset_ > 0 && !VerifyFile()) {
+    std::cerr << "Restarting SST " << num_ << " of shard " << shard_
+              << std::endl;
+    offset_ = 0;
+    checksum_ = 0;
+  }
 }
 
-bool ShardImporter::WriteChunk(const pb::MigrateResponse& response) {
+bool ShardImporter::WriteChunk(const pb::MigrateResponse& response,
+                               bool* complete) {
+  std::string filename = Filename(db_->GetName(), shard_, num_);
+  std::string chunk = response.chunk();
+  *complete = false;
+  if (Checksum(chunk, 0) != response.checksum()) {
+    std::cerr << filename << ": Checksum mismatch at offset " << offset_
+              << std::endl;
+    return false;
+  }
+
   if (!out_.is_open()) {
-    // Open next file
-    filename_ = Filename(db_->GetName(), shard_, num_++);
-    out_.open(filename_, std::ofstream::binary);
+    // Open next file, or continue the one we were writing
+    if (offset_ > 0)
+      out_.open(filename, std::ofstream::binary | std::ofstream::app);
+    else
+      out_.open(filename, std::ofstream::binary);
     if (!out_) {
-      perror(filename_.c_str());
+      perror(filename.c_str());
       exit(EXIT_FAILURE);
     }
   }
 
   // Append chunk
-  std::string chunk = response.chunk();
   out_.write(chunk.c_str(), chunk.size());
   // Close file if it was the last chunk for the sst
   if (response.eof()) {
-    largest_key_ = response.largest_key();
     out_.close();
     out_.flush();
     out_.rdbuf()->pubsync();
+    filename_ = filename;
+    num_++;
+    offset_ = 0;
+    checksum_ = 0;
     SaveState();
+    *complete = true;
     return true;
   }
-  return false;
+  out_.flush();
+  out_.rdbuf()->pubsync();
+  offset_ += chunk.size();
+  checksum_ = Checksum(chunk, checksum_);
+  SaveState();
+  return true;
+}
+
+bool ShardImporter::VerifyFile() {
+  std::string filename = Filename(db_->GetName(), shard_, num_);
+  std::ifstream in(filename, std::ifstream::binary);
+  if (!in)
+    return false;
+  // Every chunk but the last one of a file has the same size,
+  // so the checksum can be computed again in the same steps.
+  std::string chunk(kBufSize, '\0');
+  uint64_t offset = 0;
+  uint32_t checksum = 0;
+  while (offset < offset_) {
+    in.read(&chunk[0], kBufSize);
+    if (in.gcount() != kBufSize)
+      return false;
+    offset += kBufSize;
+    checksum = Checksum(chunk, checksum);
+  }
+  in.close();
+  if (offset != offset_ || checksum != checksum_)
+    return false;
+  // Drop anything that was written after the last saved chunk
+  if (truncate(filename.c_str(), offset_) < 0) {
+    perror(filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+void ShardImporter::ApplyUpdates(rocksdb::ColumnFamilyHandle* cf,
+                                 const pb::MigrateResponse& response) {
+  rocksdb::WriteBatch batch;
+  for (const pb::BatchUpdate& update : response.updates())
+    ApplyBatchUpdate(&batch, cf, update);
+  sequence_ = response.sequence();
+  // Saved in the same batch, so that no update is applied twice
+  batch.Put(Key(shard_, "sequence"), std::to_string(sequence_));
+  rocksdb::WriteOptions options;
+  options.sync = true;
+  rocksdb::Status s = db_->Write(options, &batch);
+  EnsureRocksdb("Write(updates)", s);
+}
+
+void ShardImporter::Restart(uint64_t snapshot) {
+  if (out_.is_open())
+    out_.close();
+  filename_.clear();
+  num_ = 0;
+  offset_ = 0;
+  checksum_ = 0;
+  sequence_ = 0;
+  snapshot_ = snapshot;
+  rocksdb::Status s =
+      db_->Delete(rocksdb::WriteOptions(), Key(shard_, "sequence"));
+  EnsureRocksdb("Delete(sequence)", s);
+  SaveState();
 }
 
 void ShardImporter::SaveState() {
   rocksdb::WriteBatch batch;
   batch.Put(Key(shard_, "next_num"), std::to_string(num_));
-  batch.Put(Key(shard_, "largest_key"), largest_key_);
   batch.Put(Key(shard_, "filename"), filename_);
+  batch.Put(Key(shard_, "offset"), std::to_string(offset_));
+  batch.Put(Key(shard_, "checksum"), std::to_string(checksum_));
+  batch.Put(Key(shard_, "imported"), std::to_string(snapshot_));
   rocksdb::WriteOptions options;
   options.sync = true;
   rocksdb::Status s = db_->Write(options, &batch);
@@ -256,23 +517,40 @@ void ShardImporter::SaveState() {
 void ShardImporter::RestoreState() {
   rocksdb::Status s;
   rocksdb::ReadOptions options;
-  s = db_->Get(options, Key(shard_, "largest_key"), &largest_key_);
+  std::string value;
+  s = db_->Get(options, Key(shard_, "sequence"), &value);
+  if (!s.IsNotFound()) {
+    EnsureRocksdb("Get(sequence)", s);
+    sequence_ = std::stoull(value);
+  }
+  s = db_->Get(options, Key(shard_, "imported"), &value);
+  if (!s.IsNotFound()) {
+    EnsureRocksdb("Get(imported)", s);
+    snapshot_ = std::stoull(value);
+  }
+  s = db_->Get(options, Key(shard_, "next_num"), &value);
   if (s.IsNotFound())
     return;
-  EnsureRocksdb("Get(largest_key)", s);
+  EnsureRocksdb("Get(next_num)", s);
+  num_ = std::stoi(value);
   s = db_->Get(options, Key(shard_, "filename"), &filename_);
   EnsureRocksdb("Get(filename)", s);
-  std::string next_num;
-  s = db_->Get(options, Key(shard_, "next_num"), &next_num);
-  EnsureRocksdb("Get(next_num)", s);
-  num_ = std::stoi(next_num);
+  s = db_->Get(options, Key(shard_, "offset"), &value);
+  EnsureRocksdb("Get(offset)", s);
+  offset_ = std::stoull(value);
+  s = db_->Get(options, Key(shard_, "checksum"), &value);
+  EnsureRocksdb("Get(checksum)", s);
+  checksum_ = std::stoul(value);
 }
 
 void ShardImporter::ClearState() {
   rocksdb::WriteBatch batch;
   batch.Delete(Key(shard_, "next_num"));
-  batch.Delete(Key(shard_, "largest_key"));
   batch.Delete(Key(shard_, "filename"));
+  batch.Delete(Key(shard_, "offset"));
+  batch.Delete(Key(shard_, "checksum"));
+  batch.Delete(Key(shard_, "sequence"));
+  batch.Delete(Key(shard_, "imported"));
   rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
   EnsureRocksdb("Write(importer_state)", s);
 }
@@ -18,9 +18,10 @@
 #ifndef CROCKS_SERVER_MIGRATE_UTIL_H
 #define CROCKS_SERVER_MIGRATE_UTIL_H
 
+#include <stdint.h>
+
 #include <fstream>
 #include <string>
-#include <vector>
 
 namespace rocksdb {
 class DB;
@@ -38,13 +39,23 @@ std::string Filename(const std::string& path, int shard, int num);
 
 class ShardMigrator {
  public:
-  ShardMigrator(rocksdb::DB* db, int shard, int start_from);
-
+  // The new master has imported start_from SSTs and offset bytes of the
+  // next one, of the snapshot with sequence number snapshot, and the
+  // updates up to sequence
+  ShardMigrator(rocksdb::DB* db, int shard, int start_from, uint64_t offset,
+                uint64_t sequence, uint64_t snapshot);
+
+  // Take a snapshot of the shard and write it in as many SSTs as needed,
+  // unless the one the new master has been importing is still around
   void DumpShard(rocksdb::ColumnFamilyHandle* cf);
 
-  // Save the state (whether the shard has been dumped,
-  // the total number of SSTs and the largest key of each
-  // SST), in order to be able to recover from crashes.
+  uint64_t snapshot() const {
+    return snapshot_;
+  }
+
+  // Save the state (whether the shard has been dumped, the total
+  // number of SSTs and the sequence number of the snapshot),
+  // in order to be able to recover from crashes.
   void SaveState();
 
   // Return whether the shard has already been dumped,
@@ -53,21 +64,55 @@ class ShardMigrator {
 
   void ClearState();
 
-  // Read the next chunk, and put it in the given response.
-  // Return whether there are more chunks to read.
+  // Read the next chunk, and put it in the given response. Once every SST
+  // has been read, read the updates written to the shard after the snapshot
+  // instead. If they are no longer in the WAL, take a new snapshot and ask
+  // the new master to restart. Return false if every update has been read
+  // and the shard must be frozen before reading the rest, or if there is
+  // nothing left to read.
   bool ReadChunk(pb::MigrateResponse* response);
 
+  // Mark the shard as not accepting any more writes, so that
+  // after the last updates a finishing message can be sent.
+  void Freeze() {
+    frozen_ = true;
+  }
+
+  bool frozen() const {
+    return frozen_;
+  }
+
  private:
+  // Take a snapshot of the shard and write it in SSTs
+  void Dump();
+
+  // Take a new snapshot, and have the new master drop what he has imported
+  // and import the shard again from the start
+  void Restart();
+
+  // Read updates from the WAL, starting from sequence_. Return false if
+  // some of them are missing, e.g. because the WAL files were deleted.
+  bool ReadUpdates(pb::MigrateResponse* response);
+
   rocksdb::DB* db_;
-  std::vector<std::string> largest_keys_;
+  rocksdb::ColumnFamilyHandle* cf_;
   std::ifstream in_;
   unsigned int total_;
   unsigned int num_;
+  // Offset to start from in the first SST
+  uint64_t offset_;
+  uint64_t snapshot_;
+  // Sequence number of the next update to read
+  uint64_t sequence_;
+  // Snapshot the new master has been importing
+  uint64_t imported_;
   int shard_;
-  bool empty_;
 
   std::string filename_;
+  bool restart_;
   bool done_;
+  bool caught_up_;
+  bool frozen_;
   bool finished_;
 };
 
@@ -75,20 +120,41 @@ class ShardImporter {
  public:
   ShardImporter(rocksdb::DB* db, int shard);
 
-  bool WriteChunk(const pb::MigrateResponse& response);
+  // Append the chunk to the current SST, and save the state so that an
+  // interrupted migration continues after it. Set *complete to whether
+  // the SST is ready to be ingested. If the chunk does not match its
+  // checksum, write nothing and return false.
+  bool WriteChunk(const pb::MigrateResponse& response, bool* complete);
+
+  // Apply the updates carried by the response to the given column
+  // family, and save the sequence number of the next update atomically.
+  void ApplyUpdates(rocksdb::ColumnFamilyHandle* cf,
+                    const pb::MigrateResponse& response);
+
+  // Start importing the snapshot with the given sequence number. What has
+  // been imported from another snapshot must have been dropped already.
+  void Restart(uint64_t snapshot);
 
   std::string filename() const {
     return filename_;
   }
 
-  std::string largest_key() const {
-    return largest_key_;
-  }
-
   int num() const {
     return num_;
   }
 
+  uint64_t offset() const {
+    return offset_;
+  }
+
+  uint64_t sequence() const {
+    return sequence_;
+  }
+
+  uint64_t snapshot() const {
+    return snapshot_;
+  }
+
   void SaveState();
   void RestoreState();
   void ClearState();
@@ -96,10 +162,18 @@ class ShardImporter {
  private:
   rocksdb::DB* db_;
   std::string filename_;
-  std::string largest_key_;
   std::ofstream out_;
   int num_;
+  // Bytes of the current SST that have been written, and their checksum
+  uint64_t offset_;
+  uint32_t checksum_;
+  uint64_t sequence_;
+  uint64_t snapshot_;
   int shard_;
+
+  // Return whether the current SST is intact up to offset_,
+  // and drop whatever has been written after it.
+  bool VerifyFile();
 };
 
 }  // namespace crocks
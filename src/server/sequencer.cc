@@ -0,0 +1,132 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/server/sequencer.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace crocks {
+
+namespace {
+
+// Bits of the timestamps that hold the node id
+const int kNodeBits = 10;
+
+// A batch is committed right after the client gets every proposal, so
+// one that takes longer than this is not coming
+const std::chrono::seconds kPreparedTimeout(10);
+
+}  // namespace
+
+Sequencer::Sequencer(int node)
+    : node_(node), expirer_(&Sequencer::ExpireThread, this) {
+  assert(node >= 0 && node < (1 << kNodeBits));
+}
+
+Sequencer::~Sequencer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  expirer_.join();
+}
+
+uint64_t Sequencer::Prepare() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  Expire(now);
+  uint64_t proposal = (++clock_ << kNodeBits) | node_;
+  pending_.insert(proposal);
+  bool wake = expires_.empty();
+  expires_.emplace_back(now + kPreparedTimeout, proposal);
+  if (wake)
+    cv_.notify_one();
+  return proposal;
+}
+
+bool Sequencer::Commit(uint64_t proposal, uint64_t timestamp,
+                       const std::function<void()>& apply) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  assert(timestamp >= proposal);
+  Expire(std::chrono::steady_clock::now());
+  if (pending_.erase(proposal) == 0)
+    return false;
+  // Later proposals must be higher than this timestamp
+  clock_ = std::max(clock_, timestamp >> kNodeBits);
+  committed_[timestamp] = Batch{proposal, apply};
+  timestamps_[proposal] = timestamp;
+  Deliver();
+  return true;
+}
+
+bool Sequencer::Abort(uint64_t proposal) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.erase(proposal) > 0) {
+    Deliver();
+    return true;
+  }
+  auto it = timestamps_.find(proposal);
+  if (it == timestamps_.end())
+    return false;
+  committed_.erase(it->second);
+  timestamps_.erase(it);
+  return true;
+}
+
+// private
+void Sequencer::ExpireThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    Expire(std::chrono::steady_clock::now());
+    if (expires_.empty())
+      cv_.wait(lock);
+    else
+      cv_.wait_until(lock, expires_.front().first);
+  }
+}
+
+void Sequencer::Expire(std::chrono::steady_clock::time_point now) {
+  bool expired = false;
+  for (; !expires_.empty() && expires_.front().first <= now;
+       expires_.pop_front()) {
+    // The batch may have been committed or aborted already
+    if (pending_.erase(expires_.front().second) > 0)
+      expired = true;
+  }
+  if (expired)
+    Deliver();
+}
+
+void Sequencer::Deliver() {
+  while (!committed_.empty()) {
+    auto next = committed_.begin();
+    // A pending batch will get a timestamp at least as high as its
+    // proposal, which may be lower than that of the committed one
+    if (!pending_.empty() && *pending_.begin() < next->first)
+      return;
+    std::function<void()> apply = std::move(next->second.apply);
+    timestamps_.erase(next->second.proposal);
+    committed_.erase(next);
+    apply();
+  }
+}
+
+}  // namespace crocks
@@ -0,0 +1,109 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_SERVER_SEQUENCER_H
+#define CROCKS_SERVER_SEQUENCER_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace crocks {
+
+// Orders the batches written with WriteBatch::WriteWithLock(), so that
+// every node applies them in the same order, without a global lock. This
+// is Skeen's algorithm for total order multicast:
+//
+//   1. The client sends the updates of the batch to each of its nodes.
+//   2. Each node proposes a timestamp for the batch, higher than any it
+//      has proposed or seen committed so far. The batch is now pending.
+//   3. The client commits the batch with the highest of the proposals.
+//   4. Each node applies the committed batches in timestamp order, as soon
+//      as no pending batch can end up with a lower timestamp than them.
+//
+// Timestamps are unique, as the id of the node is in their lowest bits.
+//
+// A pending batch blocks every batch committed after it, so a batch that
+// is not committed in time, e.g. because its client hangs, is aborted by a
+// background thread.
+class Sequencer {
+ public:
+  explicit Sequencer(int node);
+  ~Sequencer();
+
+  // Register a batch that is about to commit and return its proposal,
+  // which identifies it in the calls that follow
+  uint64_t Prepare();
+
+  // Set the timestamp of the pending batch with the given proposal. apply
+  // is run once every batch that may get a lower timestamp has been
+  // applied, possibly by this thread, and with no other apply running.
+  // Returns false, without running apply, if the batch is no longer
+  // pending, because it has expired or been aborted.
+  bool Commit(uint64_t proposal, uint64_t timestamp,
+              const std::function<void()>& apply);
+
+  // Forget a batch that will not be applied, e.g. because its client
+  // went away. Returns true if it was pending or waiting to be applied.
+  bool Abort(uint64_t proposal);
+
+ private:
+  using Deadline = std::pair<std::chrono::steady_clock::time_point, uint64_t>;
+
+  // Abort the pending batches that have expired
+  void ExpireThread();
+
+  // Requires mutex_
+  void Expire(std::chrono::steady_clock::time_point now);
+
+  // Apply the committed batches that are no longer blocked by pending
+  // ones. Requires mutex_.
+  void Deliver();
+
+  const uint64_t node_;
+  std::mutex mutex_;
+  // The highest timestamp proposed or committed, without the node id
+  uint64_t clock_ = 0;
+  // Proposals of the batches that have not been committed yet
+  std::set<uint64_t> pending_;
+  struct Batch {
+    uint64_t proposal;
+    std::function<void()> apply;
+  };
+  // Committed batches that wait for earlier ones, by timestamp
+  std::map<uint64_t, Batch> committed_;
+  // The timestamp of each of them, by proposal
+  std::map<uint64_t, uint64_t> timestamps_;
+  // When each pending batch expires, in order, as every batch gets the
+  // same timeout
+  std::deque<Deadline> expires_;
+  bool stop_ = false;
+  std::condition_variable cv_;
+  std::thread expirer_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_SERVER_SEQUENCER_H
@@ -19,6 +19,7 @@
 
 #include <assert.h>
 
+#include <chrono>
 #include <utility>
 
 #include <rocksdb/db.h>
@@ -28,15 +29,35 @@
 
 namespace crocks {
 
+namespace {
+
+uint64_t NowMicros() {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+}  // namespace
+
 Shard::Shard(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf, int shard)
-    : db_(db), cf_(cf), importing_(false), migrating_(false), refs_(1) {}
+    : db_(db),
+      cf_(cf),
+      importing_(false),
+      migrating_(false),
+      refs_(1),
+      reads_(0),
+      writes_(0),
+      bytes_(0),
+      version_(NowMicros()) {}
 
-Shard::Shard(rocksdb::DB* db, int shard, const std::string& old_address)
+Shard::Shard(rocksdb::DB* db, int shard)
     : db_(db),
       importing_(true),
       migrating_(false),
       refs_(1),
-      old_address_(old_address) {
+      reads_(0),
+      writes_(0),
+      bytes_(0),
+      version_(NowMicros()) {
   std::string name = std::to_string(shard);
   rocksdb::Status s =
       db_->CreateColumnFamily(DefaultColumnFamilyOptions(), name, &cf_);
@@ -48,35 +69,29 @@ Shard::~Shard() {
   delete cf_;
 }
 
-rocksdb::Status Shard::Get(const std::string& key, std::string* value,
-                           bool* ask) {
-  rocksdb::Status s;
-  bool not_ingested_up_to_key;
-  {
-    read_lock lock(largest_key_mutex_);
-    not_ingested_up_to_key = key > largest_key_;
-  }
-  // The get must take place after not_ingested_up_to_key
-  // is set. Otherwise there is a race: the get can
-  // happen before the ingestion and the check after.
-  s = db_->Get(rocksdb::ReadOptions(), cf_, key, value);
-  // If we are importing and have not yet ingested the SST with the
-  // key range that contains the given key and there is not a more
-  // recent value, we have no choice but to ask the former master.
-  *ask = importing_.load() && not_ingested_up_to_key && s.IsNotFound();
+rocksdb::Status Shard::Get(const std::string& key, std::string* value) {
+  reads_++;
+  bytes_ += key.size();
+  rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), cf_, key, value);
+  bytes_ += value->size();
   return s;
 }
 
 rocksdb::Status Shard::Put(const std::string& key, const std::string& value) {
-  return db_->Put(rocksdb::WriteOptions(), cf_, key, value);
+  CountWrite(key.size() + value.size());
+  rocksdb::Status s = db_->Put(rocksdb::WriteOptions(), cf_, key, value);
+  Changed();
+  return s;
 }
 
 rocksdb::Status Shard::Delete(const std::string& key) {
-  return db_->Delete(rocksdb::WriteOptions(), cf_, key);
+  CountWrite(key.size());
+  rocksdb::Status s = db_->Delete(rocksdb::WriteOptions(), cf_, key);
+  Changed();
+  return s;
 }
 
-void Shard::Ingest(const std::string& filename,
-                   const std::string& largest_key) {
+void Shard::Ingest(const std::string& filename) {
   std::vector<std::string> files{filename};
   rocksdb::IngestExternalFileOptions ifo;
   ifo.move_files = true;
@@ -87,15 +102,28 @@ void Shard::Ingest(const std::string& filename,
   // Skip IOError. We may have ingested the file before crashing.
   if (!s.IsIOError())
     EnsureRocksdb("IngestExternalFile", s);
-  {
-    write_lock lock(largest_key_mutex_);
-    largest_key_ = largest_key;
-  }
+}
+
+void Shard::Clear() {
+  assert(importing_.load());
+  std::string name = cf_->GetName();
+  rocksdb::Status s = db_->DropColumnFamily(cf_);
+  EnsureRocksdb("DropColumnFamily", s);
+  delete cf_;
+  s = db_->CreateColumnFamily(DefaultColumnFamilyOptions(), name, &cf_);
+  EnsureRocksdb("CreateColumnFamily", s);
+}
+
+uint64_t Shard::Size() const {
+  uint64_t size = 0;
+  if (!db_->GetIntProperty(cf_, "rocksdb.total-sst-files-size", &size))
+    return 0;
+  return size;
 }
 
 bool Shard::Ref() {
   std::lock_guard<std::mutex> lock(ref_mutex_);
-  if (migrating_)
+  if (migrating_ || importing_.load())
     return false;
   // Using an atomic integer for the reference counter and remove the
   // lock would be nice but would cause a race condition. It would be
@@ -124,6 +152,28 @@ void Shard::WaitRefs() {
   f.wait();
 }
 
+bool Shard::BeginIngest() {
+  std::lock_guard<std::mutex> lock(ref_mutex_);
+  if (exporting_)
+    return false;
+  ingests_++;
+  return true;
+}
+
+void Shard::EndIngest() {
+  {
+    std::lock_guard<std::mutex> lock(ref_mutex_);
+    ingests_--;
+  }
+  ingests_cv_.notify_all();
+}
+
+void Shard::StartExport() {
+  std::unique_lock<std::mutex> lock(ref_mutex_);
+  exporting_ = true;
+  ingests_cv_.wait(lock, [this] { return ingests_ == 0; });
+}
+
 Shards::Shards(rocksdb::DB* db, const std::vector<int>& shards) : db_(db) {
   std::vector<std::string> names;
   for (int shard : shards)
@@ -151,13 +201,21 @@ Shards::Shards(rocksdb::DB* db,
   }
 }
 
-std::shared_ptr<Shard> Shards::Add(int id, const std::string& old_address) {
+std::shared_ptr<Shard> Shards::Add(int id) {
   write_lock lock(mutex_);
-  auto shard = std::make_shared<Shard>(db_, id, old_address);
+  auto shard = std::make_shared<Shard>(db_, id);
   shards_[id] = shard;
   return shard;
 }
 
+std::vector<int> Shards::ids() const {
+  read_lock lock(mutex_);
+  std::vector<int> ids;
+  for (const auto& pair : shards_)
+    ids.push_back(pair.first);
+  return ids;
+}
+
 void Shards::Remove(int id) {
   write_lock lock(mutex_);
   shards_.erase(id);
@@ -169,7 +227,8 @@ std::vector<rocksdb::ColumnFamilyHandle*> Shards::ColumnFamilies() const {
   for (const auto& pair : shards_) {
     Shard* shard = pair.second.get();
     assert(shard != nullptr);
-    column_families.push_back(shard->cf());
+    if (!shard->importing())
+      column_families.push_back(shard->cf());
   }
   return column_families;
 }
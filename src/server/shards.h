@@ -18,7 +18,10 @@
 #ifndef CROCKS_SERVER_SHARDS_H
 #define CROCKS_SERVER_SHARDS_H
 
+#include <stdint.h>
+
 #include <atomic>
+#include <condition_variable>
 #include <future>
 #include <memory>
 #include <mutex>
@@ -40,13 +43,15 @@ namespace crocks {
 class Shard {
  public:
   Shard(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf, int shard);
-  Shard(rocksdb::DB* db, int shard, const std::string& old_address);
+  Shard(rocksdb::DB* db, int shard);
   ~Shard();
 
   rocksdb::ColumnFamilyHandle* cf() const {
     return cf_;
   }
 
+  // While importing, the shard has not yet caught up with the former master,
+  // and it must not be read or written to, or used for iterating.
   bool importing() const {
     return importing_.load();
   }
@@ -55,28 +60,56 @@ class Shard {
     importing_.store(value);
   }
 
-  void set_largest_key(const std::string& largest_key) {
-    write_lock lock(largest_key_mutex_);
-    largest_key_ = largest_key;
+  // Single key operations, counted as reads or writes
+  rocksdb::Status Get(const std::string& key, std::string* value);
+  rocksdb::Status Put(const std::string& key, const std::string& value);
+  rocksdb::Status Delete(const std::string& key);
+
+  // Count writes that were applied to the shard through a batch
+  void CountWrite(size_t bytes, uint64_t count = 1) {
+    writes_ += count;
+    bytes_ += bytes;
   }
 
-  std::string old_address() const {
-    return old_address_;
+  uint64_t reads() const {
+    return reads_.load();
   }
 
-  // Get the key from the database and put it into *value. If it was
-  // not found and there is a possibility that the former master
-  // of the shard has the most recent value, *ask is set to true.
-  rocksdb::Status Get(const std::string& key, std::string* value, bool* ask);
-  rocksdb::Status Put(const std::string& key, const std::string& value);
-  rocksdb::Status Delete(const std::string& key);
+  uint64_t writes() const {
+    return writes_.load();
+  }
+
+  uint64_t bytes() const {
+    return bytes_.load();
+  }
 
-  void Ingest(const std::string& filename, const std::string& largest_key);
+  // The version of the shard is increased after every write to it, so
+  // that clients can tell if a value they have cached may be stale. A
+  // value read after a call to version() is at least as new as that
+  // version. It starts from the time the shard was opened, in
+  // microseconds, to keep increasing across restarts and migrations.
+  uint64_t version() const {
+    return version_.load();
+  }
+
+  // Increase the version, after a write has been applied to the shard
+  void Changed() {
+    version_++;
+  }
+
+  // Return the total size of the SST files of the shard
+  uint64_t Size() const;
+
+  void Ingest(const std::string& filename);
 
-  // Increase the reference counter of the shard. Fails and returns
-  // false if the shard is marked for removal. A referenced
-  // shard is not allowed to be snapshotted and sent to a node.
-  // Should only be used for requests to modify the shard.
+  // Drop every key of an importing shard, by recreating its column family,
+  // so that it can be imported again from a new snapshot
+  void Clear();
+
+  // Increase the reference counter of the shard. Fails and returns false
+  // if the shard is importing or marked for removal. The shard stops
+  // accepting writes before the last updates are sent to the new master,
+  // so this should be used for every request that modifies the shard.
   bool Ref();
 
   // Decrease the reference counter of the shard. Once called with migrating
@@ -86,6 +119,23 @@ class Shard {
   // Wait for the reference counter to reach 0
   void WaitRefs();
 
+  // Files ingested into the shard skip the WAL, from which a migration
+  // reads what was written after its snapshot. So a bulk ingestion must
+  // call BeginIngest() before it and EndIngest() after it, and is not
+  // allowed once the shard is being exported.
+  bool BeginIngest();
+  void EndIngest();
+
+  // Mark the shard as being exported, after waiting for the ingestions in
+  // progress, so that every ingestion is either in the snapshot of the
+  // migration or refused
+  void StartExport();
+
+  bool exporting() {
+    std::lock_guard<std::mutex> lock(ref_mutex_);
+    return exporting_;
+  }
+
  private:
   rocksdb::DB* db_;
   rocksdb::ColumnFamilyHandle* cf_;
@@ -95,9 +145,13 @@ class Shard {
   int refs_;
   std::promise<void> zero_refs_;
   std::mutex ref_mutex_;
-  std::string old_address_;
-  std::string largest_key_;
-  mutable shared_mutex largest_key_mutex_;
+  bool exporting_ = false;
+  int ingests_ = 0;
+  std::condition_variable ingests_cv_;
+  std::atomic<uint64_t> reads_;
+  std::atomic<uint64_t> writes_;
+  std::atomic<uint64_t> bytes_;
+  std::atomic<uint64_t> version_;
 };
 
 class Shards {
@@ -118,10 +172,13 @@ class Shards {
     return shards_.empty();
   }
 
-  std::shared_ptr<Shard> Add(int id, const std::string& old_address);
+  std::shared_ptr<Shard> Add(int id);
 
   void Remove(int id);
 
+  std::vector<int> ids() const;
+
+  // Return the column families of every shard that is not importing
   std::vector<rocksdb::ColumnFamilyHandle*> ColumnFamilies() const;
 
  private:
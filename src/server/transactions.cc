@@ -0,0 +1,196 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "src/server/transactions.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+
+#include "src/common/hash.h"
+#include "src/server/shards.h"
+
+namespace crocks {
+
+namespace {
+
+// A prepared transaction that is not committed or aborted within this
+// time, e.g. because its client crashed, is aborted, so that its keys
+// are not locked forever
+const std::chrono::seconds kPreparedTimeout(10);
+
+// How long a committed transaction is remembered. Longer than a client
+// keeps retrying the commit.
+const std::chrono::seconds kCommittedTimeout(60);
+
+void Unref(const TransactionPart& part) {
+  for (const auto& shard : part.shards)
+    shard->Unref();
+}
+
+}  // namespace
+
+Transactions::Transactions(rocksdb::DB* db)
+    : db_(db), expirer_(&Transactions::ExpireThread, this) {}
+
+Transactions::~Transactions() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  expirer_.join();
+  for (const auto& pair : prepared_)
+    Unref(pair.second->part);
+}
+
+rocksdb::Status Transactions::Prepare(uint64_t id, TransactionPart* part,
+                                      bool commit) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  Expire(now);
+  // Another transaction with the same id would take over its locks
+  if (prepared_.count(id) > 0) {
+    Unref(*part);
+    return rocksdb::Status::Busy("Transaction already prepared");
+  }
+  for (const auto& key : part->keys) {
+    auto it = locks_.find(key);
+    if (it != locks_.end() && it->second != id) {
+      Unref(*part);
+      return rocksdb::Status::Busy("Key locked by another transaction");
+    }
+  }
+  rocksdb::Status s = Validate(*part);
+  if (!s.ok()) {
+    Unref(*part);
+    return s;
+  }
+  if (commit) {
+    s = Apply(part);
+    Unref(*part);
+    return s;
+  }
+  for (const auto& key : part->keys)
+    locks_[key] = id;
+  std::unique_ptr<Prepared> prepared(new Prepared);
+  prepared->part = std::move(*part);
+  prepared_[id] = std::move(prepared);
+  bool wake = expires_.empty();
+  expires_.emplace_back(now + kPreparedTimeout, id);
+  if (wake)
+    cv_.notify_one();
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status Transactions::Commit(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  Expire(now);
+  auto it = prepared_.find(id);
+  if (it == prepared_.end()) {
+    if (committed_.count(id) > 0)
+      return rocksdb::Status::OK();
+    return rocksdb::Status::Aborted("Transaction expired or aborted");
+  }
+  std::unique_ptr<Prepared> prepared = std::move(it->second);
+  Release(id, prepared->part);
+  rocksdb::Status s = Apply(&prepared->part);
+  Unref(prepared->part);
+  if (s.ok()) {
+    committed_.insert(id);
+    forget_.emplace_back(now + kCommittedTimeout, id);
+  }
+  return s;
+}
+
+void Transactions::Abort(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = prepared_.find(id);
+  if (it == prepared_.end())
+    return;
+  std::unique_ptr<Prepared> prepared = std::move(it->second);
+  Release(id, prepared->part);
+  Unref(prepared->part);
+}
+
+// private
+void Transactions::ExpireThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    Expire(std::chrono::steady_clock::now());
+    if (expires_.empty() && forget_.empty()) {
+      cv_.wait(lock);
+      continue;
+    }
+    auto next = std::chrono::steady_clock::time_point::max();
+    if (!expires_.empty())
+      next = expires_.front().first;
+    if (!forget_.empty())
+      next = std::min(next, forget_.front().first);
+    cv_.wait_until(lock, next);
+  }
+}
+
+rocksdb::Status Transactions::Validate(const TransactionPart& part) {
+  std::string value;
+  for (const auto& read : part.reads) {
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), read.cf, read.key,
+                                 &value);
+    if (!s.ok() && !s.IsNotFound())
+      return s;
+    if (s.ok() != read.found || (s.ok() && Hash64(value) != read.digest))
+      return rocksdb::Status::Busy("Key changed since it was read");
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status Transactions::Apply(TransactionPart* part) {
+  rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &part->writes);
+  for (const auto& shard : part->shards)
+    shard->Changed();
+  return s;
+}
+
+void Transactions::Release(uint64_t id, const TransactionPart& part) {
+  for (const auto& key : part.keys) {
+    auto it = locks_.find(key);
+    if (it != locks_.end() && it->second == id)
+      locks_.erase(it);
+  }
+  prepared_.erase(id);
+}
+
+void Transactions::Expire(std::chrono::steady_clock::time_point now) {
+  for (; !expires_.empty() && expires_.front().first <= now;
+       expires_.pop_front()) {
+    // The transaction may have been committed or aborted already
+    uint64_t id = expires_.front().second;
+    auto it = prepared_.find(id);
+    if (it == prepared_.end())
+      continue;
+    std::unique_ptr<Prepared> expired = std::move(it->second);
+    Release(id, expired->part);
+    Unref(expired->part);
+  }
+  for (; !forget_.empty() && forget_.front().first <= now; forget_.pop_front())
+    committed_.erase(forget_.front().second);
+}
+
+}  // namespace crocks
@@ -0,0 +1,133 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CROCKS_SERVER_TRANSACTIONS_H
+#define CROCKS_SERVER_TRANSACTIONS_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <rocksdb/status.h>
+#include <rocksdb/write_batch.h>
+
+namespace rocksdb {
+class ColumnFamilyHandle;
+class DB;
+}  // namespace rocksdb
+
+namespace crocks {
+
+class Shard;
+
+// A key read by a transaction, and what was read
+struct TransactionRead {
+  rocksdb::ColumnFamilyHandle* cf;
+  std::string key;
+  bool found;
+  uint64_t digest;
+};
+
+// The part of a transaction that involves this node
+struct TransactionPart {
+  std::vector<TransactionRead> reads;
+  rocksdb::WriteBatch writes;
+  // Every key read or written
+  std::vector<std::string> keys;
+  // Referenced shards of the keys, so that they are not migrated
+  // before the transaction is over. Unreferenced by Transactions.
+  std::vector<std::shared_ptr<Shard>> shards;
+};
+
+// Optimistic transactions. The client reads keys without locking them and
+// buffers its writes. On commit, each node checks that the keys still have
+// the values that were read, and only then applies the writes. In between,
+// the keys of the transaction are locked, so that no other transaction can
+// change them. A transaction that finds a key locked fails right away
+// instead of waiting, so there are no deadlocks.
+//
+// Writes outside of transactions do not take the locks, so they are not
+// ordered with respect to them.
+//
+// A background thread aborts the prepared transactions that are neither
+// committed nor aborted in time, e.g. because their client crashed, so that
+// their keys and shards are not held forever.
+class Transactions {
+ public:
+  explicit Transactions(rocksdb::DB* db);
+  ~Transactions();
+
+  // Check that the reads of the transaction still hold and lock its keys. If
+  // commit is true, apply its writes and unlock them at once. Else keep them
+  // until Commit() or Abort(). Returns Busy if a key is locked by another
+  // transaction or has changed since it was read, or if a transaction with
+  // the same id is already prepared.
+  rocksdb::Status Prepare(uint64_t id, TransactionPart* part, bool commit);
+
+  // Apply the writes of a prepared transaction. Committing a transaction
+  // that was committed recently succeeds again, so that the commit can be
+  // retried. Returns Aborted if there is no such transaction, e.g. because
+  // it was prepared too long ago and has expired.
+  rocksdb::Status Commit(uint64_t id);
+
+  void Abort(uint64_t id);
+
+ private:
+  struct Prepared {
+    TransactionPart part;
+  };
+
+  using Deadline = std::pair<std::chrono::steady_clock::time_point, uint64_t>;
+
+  // Abort the expired transactions and forget the old committed ones
+  void ExpireThread();
+
+  // Requires mutex_
+  rocksdb::Status Validate(const TransactionPart& part);
+  rocksdb::Status Apply(TransactionPart* part);
+  void Release(uint64_t id, const TransactionPart& part);
+  void Expire(std::chrono::steady_clock::time_point now);
+
+  rocksdb::DB* db_;
+  std::mutex mutex_;
+  // The transaction that holds each locked key
+  std::unordered_map<std::string, uint64_t> locks_;
+  std::unordered_map<uint64_t, std::unique_ptr<Prepared>> prepared_;
+  // Recently committed transactions
+  std::unordered_set<uint64_t> committed_;
+  // When each prepared transaction expires and each committed one is
+  // forgotten, in order, as every transaction gets the same timeout
+  std::deque<Deadline> expires_;
+  std::deque<Deadline> forget_;
+  bool stop_ = false;
+  std::condition_variable cv_;
+  std::thread expirer_;
+};
+
+}  // namespace crocks
+
+#endif  // CROCKS_SERVER_TRANSACTIONS_H
@@ -26,6 +26,7 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <rocksdb/advanced_options.h>
@@ -80,11 +81,79 @@ void ApplyBatchUpdate(rocksdb::WriteBatch* batch,
     case pb::BatchUpdate::CLEAR:
       batch->Clear();
       break;
+    case pb::BatchUpdate::DELETE_RANGE:
+      batch->DeleteRange(cf, batch_update.key(), batch_update.value());
+      break;
     default:
       assert(false);
   }
 }
 
+namespace {
+
+// Copies the updates of a batch to another one, in the given column family
+class Rebinder : public rocksdb::WriteBatch::Handler {
+ public:
+  Rebinder(rocksdb::WriteBatch* batch, rocksdb::ColumnFamilyHandle* cf)
+      : batch_(batch), cf_(cf) {}
+
+  rocksdb::Status PutCF(uint32_t /* cf */, const rocksdb::Slice& key,
+                        const rocksdb::Slice& value) override {
+    Count(key.size() + value.size());
+    batch_->Put(cf_, key, value);
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status DeleteCF(uint32_t /* cf */,
+                           const rocksdb::Slice& key) override {
+    Count(key.size());
+    batch_->Delete(cf_, key);
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status SingleDeleteCF(uint32_t /* cf */,
+                                 const rocksdb::Slice& key) override {
+    Count(key.size());
+    batch_->SingleDelete(cf_, key);
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status MergeCF(uint32_t /* cf */, const rocksdb::Slice& key,
+                          const rocksdb::Slice& value) override {
+    Count(key.size() + value.size());
+    batch_->Merge(cf_, key, value);
+    return rocksdb::Status::OK();
+  }
+
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+
+ private:
+  void Count(size_t size) {
+    count++;
+    bytes += size;
+  }
+
+  rocksdb::WriteBatch* batch_;
+  rocksdb::ColumnFamilyHandle* cf_;
+};
+
+}  // namespace
+
+rocksdb::Status ApplyBatchData(rocksdb::WriteBatch* batch,
+                               rocksdb::ColumnFamilyHandle* cf,
+                               std::string* data, uint64_t* count,
+                               uint64_t* bytes) {
+  if (data->empty())
+    return rocksdb::Status::OK();
+  rocksdb::WriteBatch updates(std::move(*data));
+  Rebinder rebinder(batch, cf);
+  rocksdb::Status s = updates.Iterate(&rebinder);
+  *count += rebinder.count;
+  *bytes += rebinder.bytes;
+  return s;
+}
+
 const int kIteratorBatchSize = 10;
 
 void MakeNextBatch(MultiIterator* it, pb::IteratorResponse* response) {
@@ -208,6 +277,10 @@ rocksdb::Options DefaultRocksdbOptions() {
   options.write_buffer_size = 64 << 20;
   // options.db_write_buffer_size = GetTotalSystemMemory() / 4;
   options.allow_ingest_behind = true;
+  // Keep up to 1GB of WAL around after it's flushed, so that a migrating
+  // shard can catch up from its updates. If they are gone, the migration
+  // starts over from a new snapshot.
+  options.WAL_size_limit_MB = 1024;
   options.level0_slowdown_writes_trigger = 10;
   options.level0_stop_writes_trigger = 15;
   options.listeners.push_back(std::make_shared<Listener>());
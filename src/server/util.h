@@ -18,6 +18,8 @@
 #ifndef CROCKS_SERVER_UTIL_H
 #define CROCKS_SERVER_UTIL_H
 
+#include <stdint.h>
+
 #include <string>
 
 #include <rocksdb/options.h>
@@ -47,6 +49,14 @@ void ApplyBatchUpdate(rocksdb::WriteBatch* batch,
                       rocksdb::ColumnFamilyHandle* cf,
                       const pb::BatchUpdate& batch_update);
 
+// Append the updates encoded in data, as by rocksdb::WriteBatch::Data(), to
+// batch, in the column family cf. The number of updates and their total
+// size are added to *count and *bytes. Takes the contents of data.
+rocksdb::Status ApplyBatchData(rocksdb::WriteBatch* batch,
+                               rocksdb::ColumnFamilyHandle* cf,
+                               std::string* data, uint64_t* count,
+                               uint64_t* bytes);
+
 void ApplyIteratorRequest(MultiIterator* iterator,
                           const pb::IteratorRequest& request,
                           pb::IteratorResponse* response);
@@ -21,6 +21,7 @@
 #include <getopt.h>
 #include <math.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 
 #include <functional>
@@ -34,15 +35,20 @@
 #include <utility>
 #include <vector>
 
+#include <crocks/bulk_loader.h>
 #include <crocks/cluster.h>
+#include <crocks/options.h>
 #include <crocks/status.h>
+#include <crocks/streaming_writer.h>
 #include <crocks/write_batch.h>
+#include "src/client/cluster_impl.h"
 #include "src/common/util.h"
 
 #include "util.h"
 
 const double kMB = 1048576.0;
 const double kGB = kMB * 1024;
+const int kSmallBatch = 3;
 
 std::mutex mutex;
 
@@ -68,12 +74,34 @@ const std::string usage_message(
     "\n"
     "Commands:\n"
     "  fill              Fill db with random data sequentially.\n"
+    "  bulkfill          Fill db with random data in random order, with a\n"
+    "                    BulkLoader.\n"
+    "  streamfill        Fill db with random data sequentially, with a\n"
+    "                    StreamingWriter.\n"
     "  fillseq           Sequential writes.\n"
     "  fillrandom        Random writes from <num> threads.\n"
     "  readseq           Sequential reads.\n"
     "  readrandom        Random reads from <num> threads.\n"
     "  readwhilewriting  Reads and writes from <num> threads each.\n"
     "  fillbatch         Random writes in batches from <num> threads.\n"
+    "                    Like fillrandom, it also reports the client CPU\n"
+    "                    time in milliseconds per MB written, and then the\n"
+    "                    operations per second seen by the threads inside\n"
+    "                    WriteBatch::Put(), which only appends to memory.\n"
+    "  readscaling       Random reads from 1, 2, 4, ... up to <num> threads,\n"
+    "                    all sharing the same client.\n"
+    "  latency           Latency percentiles of random writes.\n"
+    "  batchlatency      Latency percentiles of batches of 3 random writes\n"
+    "                    to the same node, sent with a single BatchWrite\n"
+    "                    request, and then streamed.\n"
+    "  readlatency       Latency percentiles of random reads, from <num>\n"
+    "                    threads, of which only the first one is measured.\n"
+    "  orderedscaling    Random writes in batches with WriteWithLock(), from\n"
+    "                    1, 2, 4, ... up to <num> threads.\n"
+    "  lockedscaling     The same, with each batch written under the global\n"
+    "                    etcd lock instead, as WriteWithLock() used to.\n"
+    "  readskewed        Reads from <num> threads, a third of which go to 1%\n"
+    "                    of the keys. Use with --cache.\n"
     "\n"
     "Options:\n"
     "  -e, --etcd <address>  Etcd address [default: localhost:2379].\n"
@@ -82,6 +110,9 @@ const std::string usage_message(
     "  -t, --threads <num>   Number of threads [default: 1].\n"
     "  -b, --batch <size>    Batch size in operations [default: 128].\n"
     "  -d, --duration <sec>  Benchmark duration in seconds [default: 10].\n"
+    "  -c, --channels <num>  Connections to each node [default: 1].\n"
+    "  -H, --hedge           Enable hedged reads.\n"
+    "  -C, --cache <size>    Client cache size in MB [default: 0].\n"
     "  -h, --help            Show this help message and exit.\n");
 
 void Report(double iops, int value_size, bool nl = true) {
@@ -99,6 +130,14 @@ uint64_t NowMicros() {
   return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
 }
 
+// User and system CPU time of the process, in seconds
+double CpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
 // Based on rocksdb::Duration defined in rocksdb/util/db_bench_tool.cc
 class Duration {
  public:
@@ -157,14 +196,17 @@ void Run(std::function<void(crocks::Cluster*, Generator*, int)> func,
   }
 }
 
-void Latency(crocks::Cluster* db, Generator* gen, int max_seconds,
+// Repeatedly run the given function for max_seconds, and
+// print percentiles of its latency in microseconds.
+void Latency(std::function<void(crocks::Cluster*, Generator*)> func,
+             crocks::Cluster* db, Generator* gen, int max_seconds,
              int batch_size) {
   Duration duration(max_seconds, 0);
   std::map<int, int> map;
   while (!duration.Done(batch_size)) {
     for (int i = 0; i < batch_size; i++) {
       auto start = NowMicros();
-      Ensure(db->Put(gen->NextKey(), gen->NextValue()));
+      func(db, gen);
       map[NowMicros() - start]++;
     }
   }
@@ -212,24 +254,99 @@ void Latency(crocks::Cluster* db, Generator* gen, int max_seconds,
   // std::cout << "dev:\t" << sqrt(dev / all) << std::endl;
 }
 
+void DoWrite(crocks::Cluster* db, Generator* gen) {
+  Ensure(db->Put(gen->NextKey(), gen->NextValue()));
+}
+
+void DoRead(crocks::Cluster* db, Generator* gen) {
+  std::string value;
+  Ensure(db->Get(gen->NextKey(), &value));
+}
+
 void DoWrites(crocks::Cluster* db, Generator* gen, int batch_size) {
   for (int i = 0; i < batch_size; i++)
     Ensure(db->Put(gen->NextKey(), gen->NextValue()));
 }
 
+// Time spent by all threads in WriteBatch::Put(), in microseconds
+uint64_t put_micros = 0;
+
 void DoBatchWrites(crocks::Cluster* db, Generator* gen, int batch_size) {
   crocks::WriteBatch batch(db);
+  uint64_t start = NowMicros();
   for (int i = 0; i < batch_size; i++)
     batch.Put(gen->NextKey(), gen->NextValue());
+  uint64_t micros = NowMicros() - start;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    put_micros += micros;
+  }
+  Ensure(batch.Write());
+}
+
+// A batch of kSmallBatch random writes to keys of the same node. Unless
+// threshold_low is zero, it is written with a single BatchWrite request.
+// Else every update is handed off as soon as it is added, and the batch
+// is streamed.
+void DoSmallBatch(crocks::Cluster* db, Generator* gen, int threshold_low) {
+  crocks::WriteBatch batch(db, threshold_low, 4 * kMB);
+  std::string key = gen->NextKey();
+  int node = db->get()->IndexForKey(key);
+  batch.Put(key, gen->NextValue());
+  for (int i = 1; i < kSmallBatch;) {
+    key = gen->NextKey();
+    if (db->get()->IndexForKey(key) != node)
+      continue;
+    batch.Put(key, gen->NextValue());
+    i++;
+  }
   Ensure(batch.Write());
 }
 
+void DoOrderedBatchWrites(crocks::Cluster* db, Generator* gen,
+                          int batch_size) {
+  crocks::WriteBatch batch(db);
+  for (int i = 0; i < batch_size; i++)
+    batch.Put(gen->NextKey(), gen->NextValue());
+  Ensure(batch.WriteWithLock());
+}
+
+void DoLockedBatchWrites(crocks::Cluster* db, Generator* gen,
+                         int batch_size) {
+  crocks::WriteBatch batch(db);
+  for (int i = 0; i < batch_size; i++)
+    batch.Put(gen->NextKey(), gen->NextValue());
+  db->get()->Lock();
+  crocks::Status status = batch.Write();
+  db->get()->Unlock();
+  Ensure(status);
+}
+
 void DoReads(crocks::Cluster* db, Generator* gen, int batch_size) {
   std::string value;
   for (int i = 0; i < batch_size; i++)
     Ensure(db->Get(gen->NextKey(), &value));
 }
 
+// Run func with 1, 2, 4, ... up to max_threads threads that share the
+// same db, and report the operations per second for each step.
+void Scaling(std::function<void(crocks::Cluster*, Generator*, int)> func,
+             crocks::Cluster* db, Generator* gen, int max_threads,
+             int max_seconds, int batch_size, int value_size) {
+  std::cout << "Threads\tIOPS\tMB/sec" << std::endl;
+  for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    std::cout << num_threads << "\t";
+    std::vector<std::thread> threads;
+    double iops = 0;
+    for (int i = 0; i < num_threads; i++)
+      threads.emplace_back(std::thread(
+          [&] { Run(func, db, gen, max_seconds, batch_size, &iops); }));
+    for (int i = 0; i < num_threads; i++)
+      threads[i].join();
+    Report(iops, value_size);
+  }
+}
+
 void Fill(crocks::Cluster* db, int num_keys, int value_size) {
   Duration duration(0, num_keys);
   Generator gen(SEQUENTIAL, 0, value_size);
@@ -239,6 +356,30 @@ void Fill(crocks::Cluster* db, int num_keys, int value_size) {
     DoBatchWrites(db, &gen, batch_size);
 }
 
+// Same as Fill(), with a StreamingWriter
+void StreamFill(crocks::Cluster* db, int num_keys, int value_size) {
+  Duration duration(0, num_keys);
+  Generator gen(SEQUENTIAL, 0, value_size);
+  crocks::StreamingWriter writer(db);
+  int batch_size = kMB / (kKeySize + value_size);
+  while (!duration.Done(batch_size))
+    for (int i = 0; i < batch_size; i++)
+      writer.Put(gen.NextKey(), gen.NextValue());
+  Ensure(writer.Checkpoint());
+}
+
+// Same as Fill(), in random order, with a BulkLoader
+void BulkFill(crocks::Cluster* db, int num_keys, int value_size) {
+  Duration duration(0, num_keys);
+  Generator gen(RANDOM, num_keys, value_size);
+  crocks::BulkLoader loader(db);
+  int batch_size = kMB / (kKeySize + value_size);
+  while (!duration.Done(batch_size))
+    for (int i = 0; i < batch_size; i++)
+      loader.Add(gen.NextKey(), gen.NextValue());
+  Ensure(loader.Finish());
+}
+
 int main(int argc, char** argv) {
   std::string etcd_address = crocks::GetEtcdEndpoint();
   int db_size = 1;
@@ -246,7 +387,8 @@ int main(int argc, char** argv) {
   int num_threads = 1;
   int batch_size = 128;
   int duration = 10;
-  const char* optstring = "e:s:v:t:b:d:h";
+  crocks::Options options;
+  const char* optstring = "e:s:v:t:b:d:c:HC:h";
   static struct option longopts[] = {
       // clang-format off
       {"etcd",     required_argument, 0, 'e'},
@@ -255,6 +397,9 @@ int main(int argc, char** argv) {
       {"threads",  required_argument, 0, 't'},
       {"batch",    required_argument, 0, 'b'},
       {"duration", required_argument, 0, 'd'},
+      {"channels", required_argument, 0, 'c'},
+      {"hedge",    no_argument,       0, 'H'},
+      {"cache",    required_argument, 0, 'C'},
       {"help",     no_argument,       0, 'h'},
       {0, 0, 0, 0},
       // clang-format on
@@ -281,6 +426,15 @@ int main(int argc, char** argv) {
       case 'd':
         duration = std::stoi(optarg);
         break;
+      case 'c':
+        options.channels_per_node = std::stoi(optarg);
+        break;
+      case 'H':
+        options.hedged_reads = true;
+        break;
+      case 'C':
+        options.cache_size = std::stoi(optarg) * kMB;
+        break;
       case 'h':
         std::cout << usage_message;
         exit(EXIT_SUCCESS);
@@ -298,7 +452,7 @@ int main(int argc, char** argv) {
   std::string command = argv[optind];
   int num_keys = db_size * kGB / (kKeySize + value_size);
 
-  crocks::Cluster* db = crocks::DBOpen(etcd_address);
+  crocks::Cluster* db = new crocks::Cluster(options, etcd_address);
 
   if (command == "fill") {
     std::cout << "Filling db with " << db_size << "GB" << std::endl;
@@ -306,6 +460,18 @@ int main(int argc, char** argv) {
     std::cout << "IOPS\tMB/sec" << std::endl;
     Report(num_keys / duration, value_size);
 
+  } else if (command == "streamfill") {
+    std::cout << "Streaming " << db_size << "GB" << std::endl;
+    double duration = Measure(StreamFill, db, num_keys, value_size);
+    std::cout << "IOPS\tMB/sec" << std::endl;
+    Report(num_keys / duration, value_size);
+
+  } else if (command == "bulkfill") {
+    std::cout << "Bulk loading db with " << db_size << "GB" << std::endl;
+    double duration = Measure(BulkFill, db, num_keys, value_size);
+    std::cout << "IOPS\tMB/sec" << std::endl;
+    Report(num_keys / duration, value_size);
+
   } else if (command == "fillseq") {
     Generator gen(SEQUENTIAL, 0, value_size);
     double iops = 0;
@@ -318,12 +484,23 @@ int main(int argc, char** argv) {
     Generator gen(RANDOM, num_keys, value_size);
     double iops = 0;
     auto func = (command == "fillrandom") ? DoWrites : DoBatchWrites;
+    double cpu = CpuSeconds();
     for (int i = 0; i < num_threads; i++)
       threads.emplace_back(std::thread(
           [&] { Run(func, db, &gen, duration, batch_size, &iops); }));
     for (int i = 0; i < num_threads; i++)
       threads[i].join();
-    Report(iops, value_size);
+    cpu = CpuSeconds() - cpu;
+    Report(iops, value_size, false);
+    // Client CPU milliseconds per MB written
+    double mb = iops * duration * (kKeySize + value_size) / kMB;
+    std::cout << "\t" << cpu * 1000 / mb;
+    // Operations per second of each thread while inside Put(), summed
+    if (command == "fillbatch" && put_micros > 0) {
+      double seconds = put_micros / 1000000.0 / num_threads;
+      std::cout << "\t" << round(iops * duration / seconds);
+    }
+    std::cout << std::endl;
 
   } else if (command == "readseq") {
     Generator gen(SEQUENTIAL, 0, value_size);
@@ -364,9 +541,57 @@ int main(int argc, char** argv) {
     std::cout << "\t";
     Report(write_iops, value_size);
 
+  } else if (command == "readscaling") {
+    Generator gen(RANDOM, num_keys, value_size);
+    Scaling(DoReads, db, &gen, num_threads, duration, batch_size, value_size);
+
+  } else if (command == "orderedscaling" || command == "lockedscaling") {
+    Generator gen(RANDOM, num_keys, value_size);
+    auto func = (command == "orderedscaling") ? DoOrderedBatchWrites
+                                              : DoLockedBatchWrites;
+    Scaling(func, db, &gen, num_threads, duration, batch_size, value_size);
+
   } else if (command == "latency") {
     Generator gen(RANDOM, num_keys, value_size);
-    Latency(db, &gen, duration, batch_size);
+    Latency(DoWrite, db, &gen, duration, batch_size);
+
+  } else if (command == "batchlatency") {
+    using namespace std::placeholders;
+    Generator gen(RANDOM, num_keys, value_size);
+    std::cout << "BatchWrite:" << std::endl;
+    Latency(std::bind(DoSmallBatch, _1, _2, 64 * 1024), db, &gen, duration,
+            batch_size);
+    std::cout << "Streamed:" << std::endl;
+    Latency(std::bind(DoSmallBatch, _1, _2, 0), db, &gen, duration,
+            batch_size);
+
+  } else if (command == "readlatency") {
+    // The rest of the threads only add load
+    std::vector<std::thread> threads;
+    Generator gen(RANDOM, num_keys, value_size);
+    double iops = 0;
+    for (int i = 1; i < num_threads; i++)
+      threads.emplace_back(std::thread(
+          [&] { Run(DoReads, db, &gen, duration, batch_size, &iops); }));
+    Latency(DoRead, db, &gen, duration, batch_size);
+    for (auto& thread : threads)
+      thread.join();
+
+  } else if (command == "readskewed") {
+    std::cout << num_threads << "\t";
+    std::vector<std::thread> threads;
+    Generator gen(SKEWED, num_keys, value_size);
+    double iops = 0;
+    for (int i = 0; i < num_threads; i++)
+      threads.emplace_back(std::thread(
+          [&] { Run(DoReads, db, &gen, duration, batch_size, &iops); }));
+    for (int i = 0; i < num_threads; i++)
+      threads[i].join();
+    Report(iops, value_size, false);
+    crocks::CacheStats stats = db->GetCacheStats();
+    uint64_t lookups = stats.hits + stats.misses;
+    std::cout << "\t" << (lookups ? 100.0 * stats.hits / lookups : 0)
+              << "% hits" << std::endl;
 
   } else {
     std::cerr << usage_message;
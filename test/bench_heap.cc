@@ -0,0 +1,127 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+// Microbenchmark of the heap of the merging iterators. Merges fan_in sorted
+// runs of keys, advancing the top of the heap on each step either with
+// pop() and push(), as the iterators used to, or with replace_top(), and
+// prints the nanoseconds and comparisons per step. Keys either interleave
+// across the runs, as they do across the nodes on the client, or come in
+// clusters of consecutive keys from the same run, as in the column
+// families of a node after a range of keys was written to one shard.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/common/heap.h"
+
+namespace {
+
+const int kKeys = 1000000;
+const int kClusterSize = 100;
+
+struct Run {
+  std::vector<std::string> keys;
+  size_t pos = 0;
+
+  bool Valid() const {
+    return pos < keys.size();
+  }
+
+  const std::string& key() const {
+    return keys[pos];
+  }
+};
+
+uint64_t comparisons = 0;
+
+struct RunGreater {
+  bool operator()(const Run* lhs, const Run* rhs) const {
+    comparisons++;
+    return lhs->key() > rhs->key();
+  }
+};
+
+typedef crocks::Heap<Run, RunGreater> MinHeap;
+
+// Spread kKeys sorted keys over fan_in runs, in clusters of cluster_size
+// consecutive keys
+std::vector<Run> MakeRuns(int fan_in, int cluster_size) {
+  std::vector<Run> runs(fan_in);
+  char key[16];
+  int run = 0;
+  for (int i = 0; i < kKeys; i++) {
+    if (i % cluster_size == 0)
+      run = rand() % fan_in;
+    snprintf(key, sizeof(key), "%015d", i);
+    runs[run].keys.push_back(key);
+  }
+  return runs;
+}
+
+// Merge the runs and return the nanoseconds per step
+double Merge(std::vector<Run> runs, bool replace_top) {
+  MinHeap heap;
+  for (Run& run : runs)
+    if (run.Valid())
+      heap.push_back(&run);
+  heap.make_heap();
+  comparisons = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (Run* top = heap.top(); top != nullptr; top = heap.top()) {
+    if (replace_top) {
+      top->pos++;
+      if (top->Valid())
+        heap.replace_top(top);
+      else
+        heap.pop();
+    } else {
+      heap.pop();
+      top->pos++;
+      if (top->Valid())
+        heap.push(top);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / kKeys;
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "layout\tfan-in\tpop+push\t\treplace_top" << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  for (int cluster_size : {1, kClusterSize}) {
+    for (int fan_in : {2, 8, 50, 200, 1000}) {
+      std::vector<Run> runs = MakeRuns(fan_in, cluster_size);
+      std::cout << (cluster_size == 1 ? "mixed" : "clusters") << "\t"
+                << fan_in << "\t";
+      for (bool replace_top : {false, true}) {
+        double nanos = Merge(runs, replace_top);
+        std::cout << nanos << "ns " << (double)comparisons / kKeys
+                  << "cmp\t";
+      }
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <assert.h>
+
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include "src/common/util.h"
+
+const int kNumKeys = 10000;
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+
+  // Put every key with futures
+  std::cout << "Putting " << kNumKeys << " keys... " << std::flush;
+  std::vector<std::future<crocks::Status>> futures;
+  for (int i = 0; i < kNumKeys; i++) {
+    std::string key = "async_" + std::to_string(i);
+    futures.push_back(db->PutAsync(key, key));
+  }
+  for (auto& future : futures)
+    EnsureRpc(future.get());
+  std::cout << "OK" << std::endl;
+
+  // Get them back with callbacks
+  std::cout << "Getting " << kNumKeys << " keys... " << std::flush;
+  std::atomic<int> pending(kNumKeys);
+  std::promise<void> done;
+  for (int i = 0; i < kNumKeys; i++) {
+    std::string key = "async_" + std::to_string(i);
+    db->GetAsync(key, [key, &pending, &done](const crocks::Status& status,
+                                             const std::string& value) {
+      EnsureRpc(status);
+      assert(value == key);
+      if (--pending == 0)
+        done.set_value();
+    });
+  }
+  done.get_future().wait();
+  std::cout << "OK" << std::endl;
+
+  // Delete them and check that they are gone
+  std::cout << "Deleting " << kNumKeys << " keys... " << std::flush;
+  futures.clear();
+  for (int i = 0; i < kNumKeys; i++)
+    futures.push_back(db->DeleteAsync("async_" + std::to_string(i)));
+  for (auto& future : futures)
+    EnsureRpc(future.get());
+  std::string value;
+  crocks::Status status = db->GetAsync("async_0", &value).get();
+  EnsureRpc(status);
+  assert(status.IsNotFound());
+  std::cout << "OK" << std::endl;
+
+  delete db;
+
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include <crocks/cluster.h>
 #include <crocks/status.h>
 #include <crocks/write_batch.h>
+#include <crocks/write_batch_with_index.h>
 #include "src/common/util.h"
 
 #include "util.h"
@@ -64,12 +65,37 @@ inline void TestRandom(crocks::Cluster* db) {
   }
 }
 
+inline void TestIndexed(crocks::Cluster* db) {
+  std::cout << "Starting an indexed batch" << std::endl;
+  EnsureRpc(db->Put("indexed1", "old"));
+  EnsureRpc(db->Put("indexed2", "old"));
+  crocks::WriteBatchWithIndex batch(db);
+  batch.Put("indexed1", "new");
+  batch.Delete("indexed2");
+
+  std::string value;
+  EnsureRpc(batch.GetFromBatchAndCluster("indexed1", &value));
+  assert(value == "new");
+  assert(batch.GetFromBatchAndCluster("indexed2", &value).IsNotFound());
+  assert(batch.GetFromBatch("indexed3", &value).IsNotFound());
+  EnsureRpc(db->Get("indexed1", &value));
+  assert(value == "old");
+
+  EnsureRpc(batch.Write());
+  EnsureRpc(batch.GetFromBatchAndCluster("indexed1", &value));
+  assert(value == "new");
+  assert(db->Get("indexed2", &value).IsNotFound());
+}
+
 int main() {
   crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
 
   Measure(TestSingle, db);
   std::cout << std::endl;
 
+  Measure(TestIndexed, db);
+  std::cout << std::endl;
+
   Measure(TestBatch, db);
   std::cout << std::endl;
 
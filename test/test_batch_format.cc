@@ -0,0 +1,161 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Checks that the updates that the client encodes for a shard decode with
+// RocksDB to the same updates, for keys and values of every length class
+// of the varint32 prefix. It does not need a running cluster.
+
+#include <assert.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rocksdb/write_batch.h>
+
+#include "gen/crocks.pb.h"
+#include "src/client/write_batch_impl.h"
+
+struct Update {
+  char type;
+  std::string key;
+  std::string value;
+};
+
+// Records the updates of a batch
+class Recorder : public rocksdb::WriteBatch::Handler {
+ public:
+  rocksdb::Status PutCF(uint32_t /* cf */, const rocksdb::Slice& key,
+                        const rocksdb::Slice& value) override {
+    updates.push_back(Update{'p', key.ToString(), value.ToString()});
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status DeleteCF(uint32_t /* cf */,
+                           const rocksdb::Slice& key) override {
+    updates.push_back(Update{'d', key.ToString(), ""});
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status SingleDeleteCF(uint32_t /* cf */,
+                                 const rocksdb::Slice& key) override {
+    updates.push_back(Update{'s', key.ToString(), ""});
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status MergeCF(uint32_t /* cf */, const rocksdb::Slice& key,
+                          const rocksdb::Slice& value) override {
+    updates.push_back(Update{'m', key.ToString(), value.ToString()});
+    return rocksdb::Status::OK();
+  }
+
+  std::vector<Update> updates;
+};
+
+void Add(crocks::Buffer* buffer, const Update& update) {
+  switch (update.type) {
+    case 'p':
+      buffer->AddPut(update.key, update.value);
+      break;
+    case 'd':
+      buffer->AddDelete(update.key);
+      break;
+    case 's':
+      buffer->AddSingleDelete(update.key);
+      break;
+    case 'm':
+      buffer->AddMerge(update.key, update.value);
+      break;
+  }
+}
+
+// Encode the updates with Buffer, decode them with RocksDB and compare
+void Check(const std::vector<Update>& updates) {
+  crocks::Buffer buffer;
+  buffer.set_shard(3);
+  for (const auto& update : updates)
+    Add(&buffer, update);
+  assert(buffer.updates_size() == static_cast<int>(updates.size()));
+
+  crocks::pb::BatchSection section;
+  buffer.Release(&section);
+  assert(section.shard() == 3);
+  assert(buffer.updates_size() == 0);
+
+  rocksdb::WriteBatch batch(section.data());
+  assert(batch.Count() == static_cast<int>(updates.size()));
+  Recorder recorder;
+  rocksdb::Status s = batch.Iterate(&recorder);
+  assert(s.ok());
+  assert(recorder.updates.size() == updates.size());
+  for (size_t i = 0; i < updates.size(); i++) {
+    assert(recorder.updates[i].type == updates[i].type);
+    assert(recorder.updates[i].key == updates[i].key);
+    assert(recorder.updates[i].value == updates[i].value);
+  }
+}
+
+int main() {
+  // Around the boundaries of the 1, 2, 3 and 4 byte varints
+  std::vector<size_t> lengths = {0,     1,     126,    127,     128,    129,
+                                 16383, 16384, 100000, 2097151, 2097152};
+  const char types[] = {'p', 'd', 's', 'm'};
+
+  std::cout << "Starting a single update of every type and length"
+            << std::endl;
+  for (char type : types) {
+    for (size_t length : lengths) {
+      std::string key(length, 'k');
+      std::string value = type == 'p' || type == 'm'
+                              ? std::string(length + 1, 'v')
+                              : "";
+      Check({Update{type, key, value}});
+    }
+  }
+
+  std::cout << "Starting a mix of updates in a single buffer" << std::endl;
+  std::vector<Update> updates;
+  for (size_t i = 0; i < lengths.size(); i++) {
+    char type = types[i % 4];
+    std::string key = std::to_string(i) + std::string(lengths[i], 'k');
+    std::string value = type == 'p' || type == 'm'
+                            ? std::string(lengths[lengths.size() - 1 - i], 'v')
+                            : "";
+    updates.push_back(Update{type, key, value});
+  }
+  Check(updates);
+
+  std::cout << "Starting a buffer that is reused after its release"
+            << std::endl;
+  crocks::Buffer buffer;
+  buffer.set_shard(0);
+  buffer.AddPut(std::string(200, 'a'), std::string(200, 'b'));
+  crocks::pb::BatchSection first;
+  buffer.Release(&first);
+  buffer.AddDelete(std::string(128, 'c'));
+  crocks::pb::BatchSection second;
+  buffer.Release(&second);
+  rocksdb::WriteBatch batch(second.data());
+  assert(batch.Count() == 1);
+  Recorder recorder;
+  rocksdb::Status s = batch.Iterate(&recorder);
+  assert(s.ok());
+  assert(recorder.updates.size() == 1);
+  assert(recorder.updates[0].type == 'd');
+  assert(recorder.updates[0].key == std::string(128, 'c'));
+  return 0;
+}
@@ -0,0 +1,98 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+#include <assert.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <crocks/bulk_loader.h>
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include "src/common/util.h"
+
+#include "util.h"
+
+// Loads count random key-values, many of them added more than once, and
+// checks that each key got the last value added
+void Load(crocks::Cluster* db, size_t memory, int count, int round) {
+  crocks::BulkLoader loader(db, memory);
+  std::map<std::string, std::string> expected;
+  Generator gen(RANDOM, count / 2, 100);
+  for (int i = 0; i < count; i++) {
+    std::string key = "bulkload" + gen.NextKey();
+    std::string value = std::to_string(round) + ":" + std::to_string(i) +
+                        ":" + gen.NextValue();
+    loader.Add(key, value);
+    expected[key] = value;
+  }
+  EnsureRpc(loader.Finish());
+
+  std::string value;
+  for (const auto& pair : expected) {
+    EnsureRpc(db->Get(pair.first, &value));
+    assert(value == pair.second);
+  }
+}
+
+// Everything fits in memory, so the key-values are just sorted
+inline void TestInMemory(crocks::Cluster* db) {
+  std::cout << "Starting an in-memory bulk load of 100.000 key-values"
+            << std::endl;
+  Load(db, 256 * 1024 * 1024, 100000, 0);
+}
+
+// The key-values are spilled to about 40 files, which are merged on Finish()
+inline void TestSpill(crocks::Cluster* db) {
+  std::cout << "Starting a spilling bulk load of 300.000 key-values"
+            << std::endl;
+  Load(db, 1024 * 1024, 300000, 1);
+}
+
+// The loaded values override the ones written before
+inline void TestOverride(crocks::Cluster* db) {
+  std::cout << "Starting a bulk load over existing keys" << std::endl;
+  EnsureRpc(db->Put("bulkoverride", "old"));
+  crocks::BulkLoader loader(db, 1024);
+  loader.Add("bulkoverride", "new1");
+  loader.Add("bulkoverride2", "new");
+  loader.Add("bulkoverride", "new2");
+  EnsureRpc(loader.Finish());
+
+  std::string value;
+  EnsureRpc(db->Get("bulkoverride", &value));
+  assert(value == "new2");
+  EnsureRpc(db->Get("bulkoverride2", &value));
+  assert(value == "new");
+}
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+
+  Measure(TestInMemory, db);
+  std::cout << std::endl;
+
+  Measure(TestSpill, db);
+  std::cout << std::endl;
+
+  Measure(TestOverride, db);
+  std::cout << std::endl;
+
+  delete db;
+
+  return 0;
+}
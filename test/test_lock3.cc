@@ -0,0 +1,142 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Write overlapping batches with WriteWithLock() from many threads at once,
+// and check that every node applied them in the same order. Each batch puts
+// its name in a random half of the keys, so the final value of a key comes
+// from the last batch that wrote it. If the batches were applied in one
+// total order, every other batch that wrote the key comes before that one
+// in it, so these constraints have no cycle.
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include <crocks/write_batch.h>
+#include "src/common/util.h"
+
+#include "util.h"
+
+const int kThreads = 8;
+const int kKeys = 1000;
+
+std::string OrderKey(int i) {
+  char key[16];
+  sprintf(key, "order%04d", i);
+  return key;
+}
+
+// The keys written by batch thread of round
+std::vector<int> Keys(int round, int thread) {
+  std::mt19937 gen(round * kThreads + thread);
+  std::vector<int> keys;
+  for (int i = 0; i < kKeys; i++)
+    if (gen() % 2 == 0)
+      keys.push_back(i);
+  return keys;
+}
+
+void Thread(int round, int thread) {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+  crocks::WriteBatch batch(db);
+  for (int i : Keys(round, thread))
+    batch.Put(OrderKey(i), std::to_string(thread));
+  EnsureRpc(batch.WriteWithLock());
+  delete db;
+}
+
+// Whether the graph has a cycle, with a depth-first search from node
+bool Cycle(const std::vector<std::set<int>>& after, int node,
+           std::vector<int>* state) {
+  // 0: not visited, 1: in the current path, 2: done
+  (*state)[node] = 1;
+  for (int next : after[node]) {
+    if ((*state)[next] == 1)
+      return true;
+    if ((*state)[next] == 0 && Cycle(after, next, state))
+      return true;
+  }
+  (*state)[node] = 2;
+  return false;
+}
+
+inline void TestOrder(crocks::Cluster* db, int round) {
+  std::cout << "Starting " << kThreads << " concurrent ordered batches"
+            << std::endl;
+  // Clear the keys, so that every final value comes from this round
+  crocks::WriteBatch clear(db);
+  for (int i = 0; i < kKeys; i++)
+    clear.Delete(OrderKey(i));
+  EnsureRpc(clear.Write());
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++)
+    threads.emplace_back(Thread, round, i);
+  for (auto& thread : threads)
+    thread.join();
+
+  std::vector<std::set<int>> writers(kKeys);
+  for (int thread = 0; thread < kThreads; thread++)
+    for (int i : Keys(round, thread))
+      writers[i].insert(thread);
+
+  // after[a] has b if batch a must come before batch b
+  std::vector<std::set<int>> after(kThreads);
+  std::string value;
+  for (int i = 0; i < kKeys; i++) {
+    crocks::Status status = db->Get(OrderKey(i), &value);
+    if (writers[i].empty()) {
+      assert(status.IsNotFound());
+      continue;
+    }
+    EnsureRpc(status);
+    int last = std::stoi(value);
+    assert(writers[i].count(last) > 0);
+    for (int thread : writers[i])
+      if (thread != last)
+        after[thread].insert(last);
+  }
+  std::vector<int> state(kThreads, 0);
+  for (int i = 0; i < kThreads; i++) {
+    if (state[i] != 0)
+      continue;
+    bool cycle = Cycle(after, i, &state);
+    assert(!cycle);
+  }
+}
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+
+  for (int i = 0; i < 100; i++) {
+    Measure(TestOrder, db, i);
+    std::cout << std::endl;
+  }
+
+  delete db;
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+// Repeatedly write batches that are big enough to be spilled to disk on the
+// nodes and ingested as SST files (see src/server/bulk_batch.h), and read
+// them back. Like test_migrations, this is supposed to be running with
+// random migrations happening from time to time, and it should never report
+// unexpected results. A batch with a shard that started being migrated
+// after the batch was spilled fails with status TryAgain, and is written
+// again.
+
+#include <stdio.h>
+
+#include <iostream>
+#include <string>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include <crocks/write_batch.h>
+#include "src/common/util.h"
+
+#include "util.h"
+
+// About 200MB per batch, well over the spill threshold of every node
+const int kKeys = 100000;
+const int kValueSize = 2000;
+
+std::string Key(int i) {
+  char key[12];
+  sprintf(key, "bulk%06d", i);
+  return key;
+}
+
+std::string Value(int round) {
+  std::string value = std::to_string(round) + "_";
+  value.resize(kValueSize, 'x');
+  return value;
+}
+
+void WriteRound(crocks::Cluster* db, int round) {
+  while (true) {
+    crocks::WriteBatch batch(db);
+    for (int i = 0; i < kKeys; i++)
+      batch.Put(Key(i), Value(round));
+    crocks::Status status = batch.Write();
+    EnsureRpc(status);
+    if (status.rocksdb_code() != rocksdb::TRY_AGAIN) {
+      if (!status.ok())
+        std::cout << "batch " << round << " failed: " << status.error_message()
+                  << std::endl;
+      break;
+    }
+    std::cout << "batch " << round << " refused by a migrating shard"
+              << std::endl;
+  }
+}
+
+void CheckRound(crocks::Cluster* db, int round) {
+  std::string expected = Value(round);
+  for (int i = 0; i < kKeys; i++) {
+    std::string value;
+    EnsureRpc(db->Get(Key(i), &value));
+    if (value != expected)
+      std::cout << Key(i) << ": expected " << round << " got "
+                << value.substr(0, value.find('_')) << std::endl;
+  }
+}
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+
+  for (int round = 0; round < 1000; round++) {
+    Measure(WriteRound, db, round);
+    Measure(CheckRound, db, round);
+    std::cout << std::endl;
+  }
+
+  delete db;
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Keep overwriting and deleting keys while shards are being moved, so that
+// their new masters have to catch up with the updates written during the
+// migration, and check that none is lost. Unlike test_migrations, it moves
+// the shards itself, from the master of shard 0 to the other nodes, so it
+// needs a running cluster of at least two nodes and no other migrations.
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include <crocks/write_batch.h>
+#include "src/common/info.h"
+#include "src/common/util.h"
+
+#include "util.h"
+
+const int kKeys = 20000;
+
+std::string CatchUpKey(int i) {
+  char key[16];
+  sprintf(key, "catchup%06d", i);
+  return key;
+}
+
+// The value each key should have in round, or empty if it should be deleted
+std::string Expected(int i, int round) {
+  if ((i + round) % 5 == 0)
+    return "";
+  return std::to_string(round) + ":" + std::to_string(i);
+}
+
+// Write round over every key, with single writes and batches
+void Write(crocks::Cluster* db, int round) {
+  crocks::WriteBatch batch(db);
+  for (int i = 0; i < kKeys; i++) {
+    std::string value = Expected(i, round);
+    if (i % 2 == 0) {
+      if (value.empty())
+        EnsureRpc(db->Delete(CatchUpKey(i)));
+      else
+        EnsureRpc(db->Put(CatchUpKey(i), value));
+    } else {
+      if (value.empty())
+        batch.Delete(CatchUpKey(i));
+      else
+        batch.Put(CatchUpKey(i), value);
+    }
+  }
+  EnsureRpc(batch.Write());
+}
+
+void Check(crocks::Cluster* db, int round) {
+  std::string value;
+  for (int i = 0; i < kKeys; i++) {
+    crocks::Status status = db->Get(CatchUpKey(i), &value);
+    std::string expected = Expected(i, round);
+    if (expected.empty()) {
+      assert(status.IsNotFound());
+    } else {
+      EnsureRpc(status);
+      assert(value == expected);
+    }
+  }
+}
+
+// Move a couple of shards away from the master of shard 0, and wait until
+// the migrations are over
+void MoveShards(crocks::Info* info) {
+  info->Get();
+  assert(info->IsRunning() && info->NoMigrations());
+  int hot = info->IndexForShard(0);
+  std::vector<double> loads(info->num_shards(), 0);
+  for (int i = 0; i < info->num_shards(); i++)
+    if (info->IndexForShard(i) == hot)
+      loads[i] = 1;
+  std::vector<uint64_t> sizes(info->num_shards(), 0);
+  auto moves = info->Rebalance(loads, sizes, 2, 0, false);
+  assert(!moves.empty());
+  do {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    info->Get();
+  } while (!info->IsRunning() || !info->NoMigrations());
+}
+
+inline void TestCatchUp(crocks::Cluster* db, crocks::Info* info,
+                        int* round) {
+  std::cout << "Starting a migration with writes in progress" << std::endl;
+  std::atomic<bool> done(false);
+  std::thread mover([&] {
+    MoveShards(info);
+    done.store(true);
+  });
+  // Keep writing during the whole migration
+  do {
+    Write(db, ++*round);
+  } while (!done.load());
+  mover.join();
+  Check(db, *round);
+}
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+  crocks::Info info(crocks::GetEtcdEndpoint());
+
+  int round = 0;
+  Write(db, round);
+  for (int i = 0; i < 20; i++) {
+    Measure(TestCatchUp, db, &info, &round);
+    std::cout << std::endl;
+  }
+
+  delete db;
+
+  return 0;
+}
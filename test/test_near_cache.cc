@@ -0,0 +1,151 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tests of NearCache. They do not need a running cluster.
+
+#include <assert.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <crocks/cluster.h>
+#include "src/client/near_cache.h"
+
+using std::chrono::milliseconds;
+
+const milliseconds kLongTtl(60000);
+
+// Return n keys that fall into the same of the 16 partitions of the cache
+std::vector<std::string> SamePartition(int n) {
+  std::vector<std::string> keys;
+  std::hash<std::string> hash;
+  for (int i = 0; static_cast<int>(keys.size()) < n; i++) {
+    std::string key = "key" + std::to_string(i);
+    if (hash(key) % 16 == hash("key0") % 16)
+      keys.push_back(key);
+  }
+  return keys;
+}
+
+void TestHit() {
+  std::cout << "Starting a hit and a miss" << std::endl;
+  crocks::NearCache cache(1 << 20, kLongTtl, 4);
+  std::string value;
+  assert(!cache.Lookup(0, "a", &value));
+  cache.Insert(0, "a", "1", 1, cache.generation(0));
+  assert(cache.Lookup(0, "a", &value));
+  assert(value == "1");
+  // The key is looked up in another shard after the routing changed
+  assert(!cache.Lookup(1, "a", &value));
+  crocks::CacheStats stats = cache.stats();
+  assert(stats.hits == 1);
+  assert(stats.misses == 2);
+  assert(stats.invalidations == 1);
+}
+
+void TestGeneration() {
+  std::cout << "Starting invalidation by flushes" << std::endl;
+  crocks::NearCache cache(1 << 20, kLongTtl, 4);
+  std::string value;
+  cache.Insert(0, "a", "1", 1, cache.generation(0));
+  cache.Insert(1, "b", "2", 1, cache.generation(1));
+  cache.Flush(0);
+  assert(!cache.Lookup(0, "a", &value));
+  // Other shards are not affected
+  assert(cache.Lookup(1, "b", &value));
+  assert(value == "2");
+
+  // A value read before a flush is not inserted after it
+  uint64_t generation = cache.generation(0);
+  cache.Flush(0);
+  cache.Insert(0, "a", "old", 1, generation);
+  assert(!cache.Lookup(0, "a", &value));
+  cache.Insert(0, "a", "new", 1, cache.generation(0));
+  assert(cache.Lookup(0, "a", &value));
+  assert(value == "new");
+}
+
+void TestVersion() {
+  std::cout << "Starting invalidation by versions" << std::endl;
+  crocks::NearCache cache(1 << 20, kLongTtl, 4);
+  std::string value;
+  cache.Insert(0, "a", "1", 5, cache.generation(0));
+  cache.Insert(0, "b", "2", 5, cache.generation(0));
+  assert(cache.Lookup(0, "a", &value));
+  // Another client wrote to the shard, which we notice on reading b again
+  cache.Insert(0, "b", "3", 6, cache.generation(0));
+  assert(!cache.Lookup(0, "a", &value));
+  assert(cache.Lookup(0, "b", &value));
+  assert(value == "3");
+  // A value read at an older version than one seen is not inserted
+  cache.Insert(0, "a", "1", 5, cache.generation(0));
+  assert(!cache.Lookup(0, "a", &value));
+  // A flush forgets the versions, as the shard may have moved
+  cache.Flush(0);
+  cache.Insert(0, "a", "4", 1, cache.generation(0));
+  assert(cache.Lookup(0, "a", &value));
+  assert(value == "4");
+}
+
+void TestTtl() {
+  std::cout << "Starting expiration" << std::endl;
+  crocks::NearCache cache(1 << 20, milliseconds(50), 1);
+  std::string value;
+  cache.Insert(0, "a", "1", 1, cache.generation(0));
+  assert(cache.Lookup(0, "a", &value));
+  usleep(100000);
+  assert(!cache.Lookup(0, "a", &value));
+  assert(cache.stats().invalidations == 1);
+}
+
+void TestLru() {
+  std::cout << "Starting eviction of the least recently used" << std::endl;
+  std::vector<std::string> keys = SamePartition(4);
+  // Room for 3 entries in each of the 16 partitions, with the overhead
+  // of 128 bytes per entry
+  size_t entry = keys[3].size() + 1 + 128;
+  crocks::NearCache cache(16 * 3 * entry, kLongTtl, 1);
+  std::string value;
+  for (int i = 0; i < 3; i++)
+    cache.Insert(0, keys[i], "v", 1, cache.generation(0));
+  assert(cache.Lookup(0, keys[0], &value));
+  cache.Insert(0, keys[3], "v", 1, cache.generation(0));
+  assert(cache.stats().evictions == 1);
+  // keys[1] was the least recently used
+  assert(!cache.Lookup(0, keys[1], &value));
+  assert(cache.Lookup(0, keys[0], &value));
+  assert(cache.Lookup(0, keys[2], &value));
+  assert(cache.Lookup(0, keys[3], &value));
+
+  // An entry larger than a partition is not cached at all
+  cache.Insert(0, "big", std::string(3 * entry, 'v'), 1, cache.generation(0));
+  assert(!cache.Lookup(0, "big", &value));
+  assert(cache.stats().evictions == 1);
+}
+
+int main() {
+  TestHit();
+  TestGeneration();
+  TestVersion();
+  TestTtl();
+  TestLru();
+  return 0;
+}
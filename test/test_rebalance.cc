@@ -0,0 +1,151 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tests of the planner of InfoWrapper::RebalanceShards(). Unlike the rest of
+// the tests, it does not need a running cluster.
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gen/info.pb.h"
+#include "src/common/info_wrapper.h"
+
+// A running cluster with the given weights of nodes and masters of shards
+void Init(crocks::InfoWrapper* info, const std::vector<double>& weights,
+          const std::vector<int>& masters) {
+  crocks::pb::ClusterInfo cluster;
+  cluster.set_state(crocks::pb::ClusterInfo::RUNNING);
+  cluster.set_num_nodes(weights.size());
+  for (size_t i = 0; i < weights.size(); i++) {
+    crocks::pb::NodeInfo* node = cluster.add_nodes();
+    node->set_address("node" + std::to_string(i));
+    node->set_id(i);
+    node->set_available(true);
+    node->set_weight(weights[i]);
+  }
+  for (int master : masters)
+    cluster.add_shards()->set_master(master);
+  std::string str;
+  bool ok = cluster.SerializeToString(&str);
+  assert(ok);
+  info->Parse(str);
+}
+
+void TestBalanced() {
+  std::cout << "Starting a balanced cluster" << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1}, {0, 0, 1, 1});
+  auto moves = info.RebalanceShards({1, 2, 2, 1}, {0, 0, 0, 0}, 10, 0);
+  assert(moves.empty());
+  assert(info.NoMigrations());
+}
+
+void TestNoLoad() {
+  std::cout << "Starting a cluster without load" << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1}, {0, 0, 0, 1});
+  auto moves = info.RebalanceShards({0, 0, 0, 0}, {5, 5, 5, 5}, 10, 0);
+  assert(moves.empty());
+  assert(info.NoMigrations());
+}
+
+void TestHotNode() {
+  std::cout << "Starting a cluster with a hot node" << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1, 1}, {0, 0, 0, 0, 1, 2});
+  // Shard 4 is hot too, but it is on another node
+  auto moves = info.RebalanceShards({1, 1, 1, 1, 1, 0}, {0, 0, 0, 0, 0, 0},
+                                    10, 0);
+  assert(moves.size() == 2);
+  assert(moves[0].from == 0 && moves[0].to == 2);
+  // Nodes 1 and 2 are then equally cold
+  assert(moves[1].from == 0 && moves[1].to != 0);
+  for (const auto& move : moves) {
+    assert(move.shard < 4);
+    assert(info.IsMigrating(move.shard));
+  }
+  assert(!info.IsMigrating(4));
+  assert(!info.IsMigrating(5));
+}
+
+void TestSmallest() {
+  std::cout << "Starting a choice between shards of similar load"
+            << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1}, {0, 0, 0, 1});
+  auto moves = info.RebalanceShards({1, 0.9, 0.1, 0}, {100, 10, 1, 1}, 1, 0);
+  assert(moves.size() == 1);
+  assert(moves[0].shard == 1);
+}
+
+void TestLimits() {
+  std::cout << "Starting a rebalancing within limits" << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1}, {0, 0, 0, 0, 0, 0, 0, 0});
+  std::vector<double> loads(8, 1);
+  std::vector<uint64_t> sizes(8, 10);
+  auto moves = info.RebalanceShards(loads, sizes, 2, 0);
+  assert(moves.size() == 2);
+
+  Init(&info, {1, 1}, {0, 0, 0, 0, 0, 0, 0, 0});
+  moves = info.RebalanceShards(loads, sizes, 10, 35);
+  assert(moves.size() == 3);
+}
+
+void TestMigrating() {
+  std::cout << "Starting a cluster with a migrating shard" << std::endl;
+  crocks::InfoWrapper info;
+  Init(&info, {1, 1}, {0, 0, 1});
+  auto moves = info.RebalanceShards({5, 1, 0}, {0, 0, 0}, 1, 0);
+  assert(moves.size() == 1);
+  assert(moves[0].shard == 0);
+  // Shard 0 is already being moved, so only shard 1 can be
+  moves = info.RebalanceShards({5, 1, 0}, {0, 0, 0}, 1, 0);
+  assert(moves.size() == 1);
+  assert(moves[0].shard == 1);
+}
+
+void TestWeights() {
+  std::cout << "Starting a cluster of nodes with different weights"
+            << std::endl;
+  crocks::InfoWrapper info;
+  // Node 1 should take twice the load of node 0, which it already has
+  Init(&info, {1, 2}, {0, 1, 1});
+  auto moves = info.RebalanceShards({2, 2, 2}, {0, 0, 0}, 10, 0);
+  assert(moves.empty());
+
+  Init(&info, {1, 2}, {0, 0, 0});
+  moves = info.RebalanceShards({2, 2, 2}, {0, 0, 0}, 10, 0);
+  assert(moves.size() == 2);
+  for (const auto& move : moves)
+    assert(move.from == 0 && move.to == 1);
+}
+
+int main() {
+  TestBalanced();
+  TestNoLoad();
+  TestHotNode();
+  TestSmallest();
+  TestLimits();
+  TestMigrating();
+  TestWeights();
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tests of TokenBucket and RetryPolicy. They do not need a running cluster.
+
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <crocks/options.h>
+#include "src/client/retry_policy.h"
+#include "src/common/util.h"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::system_clock;
+
+void TestTokenBucket() {
+  std::cout << "Starting the token bucket" << std::endl;
+  crocks::TokenBucket bucket(10, 3);
+  // The burst is available right away
+  for (int i = 0; i < 3; i++)
+    assert(bucket.Take() == microseconds(0));
+  // Then a token every 100ms, and each caller waits for the next one
+  microseconds wait = bucket.Take();
+  assert(wait > milliseconds(90) && wait <= milliseconds(100));
+  wait = bucket.Take();
+  assert(wait > milliseconds(190) && wait <= milliseconds(200));
+}
+
+void TestExhausted() {
+  std::cout << "Starting a request that uses up its budget" << std::endl;
+  crocks::Options options;
+  options.retry_budget = 3;
+  options.retry_rate = 0;
+  crocks::RetryPolicy policy(options);
+  microseconds delay;
+  for (int i = 0; i < 3; i++)
+    assert(policy.Delay(0, i, crocks::kNoDeadline, &delay));
+  assert(!policy.Delay(0, 3, crocks::kNoDeadline, &delay));
+  assert(!policy.Backoff(0, 4, crocks::kNoDeadline));
+  crocks::RetryStats stats = policy.stats();
+  assert(stats.retries == 3);
+  assert(stats.exhausted == 2);
+  assert(stats.throttled == 0);
+
+  // Zero means that there is no limit
+  options.retry_budget = 0;
+  crocks::RetryPolicy unlimited(options);
+  assert(unlimited.Delay(0, 1000, crocks::kNoDeadline, &delay));
+}
+
+void TestBackoff() {
+  std::cout << "Starting exponential backoff" << std::endl;
+  crocks::Options options;
+  options.retry_base_ms = 10;
+  options.retry_max_ms = 40;
+  options.retry_budget = 0;
+  options.retry_rate = 0;
+  crocks::RetryPolicy policy(options);
+  uint64_t total = 0;
+  for (int retry = 0; retry < 100; retry++) {
+    microseconds delay;
+    assert(policy.Delay(0, retry, crocks::kNoDeadline, &delay));
+    assert(delay >= microseconds(0));
+    assert(delay <= milliseconds(std::min(10 << std::min(retry, 3), 40)));
+    total += delay.count();
+  }
+  assert(policy.stats().backoff_micros == total);
+}
+
+void TestThrottled() {
+  std::cout << "Starting throttled retries" << std::endl;
+  crocks::Options options;
+  options.retry_base_ms = 0;
+  options.retry_budget = 0;
+  options.retry_rate = 1;
+  options.retry_burst = 1;
+  crocks::RetryPolicy policy(options);
+  microseconds delay;
+  assert(policy.Delay(0, 0, crocks::kNoDeadline, &delay));
+  assert(delay == microseconds(0));
+  assert(policy.Delay(0, 1, crocks::kNoDeadline, &delay));
+  assert(delay > milliseconds(900) && delay <= milliseconds(1000));
+  assert(policy.stats().throttled == 1);
+  // Each node has its own bucket
+  assert(policy.Delay(1, 0, crocks::kNoDeadline, &delay));
+  assert(delay == microseconds(0));
+  assert(policy.stats().throttled == 1);
+}
+
+void TestDeadline() {
+  std::cout << "Starting backoff clamped to the deadline" << std::endl;
+  crocks::Options options;
+  options.retry_base_ms = 0;
+  options.retry_budget = 0;
+  options.retry_rate = 1;
+  options.retry_burst = 1;
+  crocks::RetryPolicy policy(options);
+  microseconds delay;
+  assert(policy.Delay(0, 0, crocks::kNoDeadline, &delay));
+  // The bucket asks for a second, but only 50ms are left
+  auto deadline = system_clock::now() + milliseconds(50);
+  assert(policy.Delay(0, 1, deadline, &delay));
+  assert(delay <= milliseconds(50));
+  // Backoff() sleeps for the clamped delay only
+  auto start = system_clock::now();
+  assert(policy.Backoff(0, 2, system_clock::now() + milliseconds(50)));
+  assert(system_clock::now() - start < milliseconds(500));
+  // Past the deadline, there is no delay at all
+  assert(policy.Delay(0, 3, system_clock::now() - milliseconds(1), &delay));
+  assert(delay == microseconds(0));
+}
+
+int main() {
+  TestTokenBucket();
+  TestExhausted();
+  TestBackoff();
+  TestThrottled();
+  TestDeadline();
+  return 0;
+}
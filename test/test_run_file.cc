@@ -0,0 +1,139 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+// Tests of the run files used to sort more data than fits in memory (see
+// src/common/run_file.h). Unlike the rest of the tests, it does not need a
+// running cluster.
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "src/common/run_file.h"
+
+struct Record {
+  uint32_t tag;
+  char type;
+  std::string key;
+  std::string value;
+};
+
+std::string WriteRun(const std::string& filename,
+                     const std::vector<Record>& records) {
+  crocks::RunWriter writer(filename);
+  for (const Record& r : records)
+    writer.Add(r.tag, r.type, r.key.data(), r.key.size(), r.value.data(),
+               r.value.size());
+  bool ok = writer.Close();
+  assert(ok);
+  return filename;
+}
+
+std::vector<Record> ReadAll(crocks::RunMerger* merger) {
+  std::vector<Record> records;
+  for (; merger->Valid(); merger->Next()) {
+    const crocks::RunReader& r = merger->record();
+    records.push_back(Record{r.tag, r.type, r.key, r.value});
+  }
+  return records;
+}
+
+void TestMerge() {
+  std::cout << "Starting merge of three runs" << std::endl;
+  std::vector<std::string> runs;
+  runs.push_back(WriteRun("/tmp/crocks_test_run_0",
+                          {{0, 0, "a", "0a"},
+                           {0, 0, "c", "0c"},
+                           {1, 0, "a", "0a1"},
+                           {2, 1, "z", ""}}));
+  runs.push_back(WriteRun("/tmp/crocks_test_run_1",
+                          {{0, 1, "a", ""}, {0, 0, "b", "1b"}}));
+  // Empty values and keys that are prefixes of each other
+  runs.push_back(WriteRun("/tmp/crocks_test_run_2",
+                          {{0, 0, "", "2"},
+                           {0, 0, "b", "2b"},
+                           {0, 0, "bb", "2bb"},
+                           {1, 0, "a", ""}}));
+
+  crocks::RunMerger merger(runs);
+  std::vector<Record> records = ReadAll(&merger);
+  assert(merger.ok());
+
+  // Sorted by tag and key, and of the same tag and key the last run wins
+  std::vector<Record> expected{{0, 0, "", "2"},   {0, 1, "a", ""},
+                               {0, 0, "b", "2b"}, {0, 0, "bb", "2bb"},
+                               {0, 0, "c", "0c"}, {1, 0, "a", ""},
+                               {2, 1, "z", ""}};
+  assert(records.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    assert(records[i].tag == expected[i].tag);
+    assert(records[i].type == expected[i].type);
+    assert(records[i].key == expected[i].key);
+    assert(records[i].value == expected[i].value);
+  }
+  for (const auto& run : runs)
+    remove(run.c_str());
+}
+
+void TestLargeRecords() {
+  std::cout << "Starting merge of large records" << std::endl;
+  std::string big(300000, 'v');
+  std::vector<std::string> runs;
+  runs.push_back(WriteRun("/tmp/crocks_test_run_0",
+                          {{7, 0, std::string(1000, 'k'), big}}));
+  crocks::RunMerger merger(runs);
+  std::vector<Record> records = ReadAll(&merger);
+  assert(merger.ok());
+  assert(records.size() == 1);
+  assert(records[0].key == std::string(1000, 'k'));
+  assert(records[0].value == big);
+  remove(runs[0].c_str());
+}
+
+void TestTruncated() {
+  std::cout << "Starting merge of a truncated run" << std::endl;
+  std::string filename = WriteRun("/tmp/crocks_test_run_0",
+                                  {{0, 0, "a", "value"}, {0, 0, "b", "value"}});
+  // Cut the last record in the middle
+  FILE* file = fopen(filename.c_str(), "r+");
+  assert(file != nullptr);
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  int ret = truncate(filename.c_str(), size - 3);
+  assert(ret == 0);
+
+  crocks::RunMerger merger({filename});
+  std::vector<Record> records = ReadAll(&merger);
+  assert(records.size() == 1);
+  assert(!merger.ok());
+  remove(filename.c_str());
+
+  crocks::RunMerger missing({"/tmp/crocks_test_run_missing"});
+  assert(!missing.Valid());
+  assert(!missing.ok());
+}
+
+int main() {
+  TestMerge();
+  TestLargeRecords();
+  TestTruncated();
+  return 0;
+}
@@ -0,0 +1,106 @@
+// Copyright 2017 Panagiotis Ktistakis <panktist@gmail.com>
+//
+// This file is part of crocks.
+//
+// crocks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// crocks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with crocks.  If not, see <http://www.gnu.org/licenses/>.
+
+// Increment a bunch of counters from many threads in parallel, each time
+// moving one unit from one counter to another inside a transaction. Since
+// the counters are spread over the nodes, most transactions are committed
+// in two phases. Conflicting transactions are retried, and in the end the
+// sum of the counters should be the same as in the beginning.
+
+#include <assert.h>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crocks/cluster.h>
+#include <crocks/status.h>
+#include <crocks/transaction.h>
+#include "src/common/util.h"
+
+const int kNumCounters = 100;
+const int kNumThreads = 8;
+const int kNumTransfers = 1000;
+const int kInitial = 1000;
+
+std::string CounterKey(int i) {
+  return "counter" + std::to_string(i);
+}
+
+int ReadCounter(crocks::Transaction* txn, int i, crocks::Status* status) {
+  std::string value;
+  *status = txn->Get(CounterKey(i), &value);
+  return status->ok() ? std::stoi(value) : 0;
+}
+
+void Thread(int seed, int* conflicts) {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+  crocks::Transaction txn(db);
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(0, kNumCounters - 1);
+  for (int i = 0; i < kNumTransfers; i++) {
+    int from = dist(gen);
+    int to = dist(gen);
+    crocks::Status status;
+    do {
+      int a = ReadCounter(&txn, from, &status);
+      EnsureRpc(status);
+      int b = ReadCounter(&txn, to, &status);
+      EnsureRpc(status);
+      txn.Put(CounterKey(from), std::to_string(a - 1));
+      txn.Put(CounterKey(to), std::to_string(b + 1));
+      status = txn.Commit();
+      if (status.IsBusy())
+        (*conflicts)++;
+    } while (status.IsBusy());
+    EnsureRpc(status);
+  }
+  delete db;
+}
+
+int main() {
+  crocks::Cluster* db = crocks::DBOpen(crocks::GetEtcdEndpoint());
+  for (int i = 0; i < kNumCounters; i++)
+    EnsureRpc(db->Put(CounterKey(i), std::to_string(kInitial)));
+
+  std::cout << "Starting " << kNumThreads * kNumTransfers
+            << " transfers in " << kNumThreads << " threads" << std::endl;
+  std::vector<int> conflicts(kNumThreads, 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++)
+    threads.emplace_back(Thread, i, &conflicts[i]);
+  for (auto& thread : threads)
+    thread.join();
+
+  int total = 0;
+  for (int i = 0; i < kNumThreads; i++)
+    total += conflicts[i];
+  std::cout << total << " conflicts retried" << std::endl;
+
+  int sum = 0;
+  for (int i = 0; i < kNumCounters; i++) {
+    std::string value;
+    EnsureRpc(db->Get(CounterKey(i), &value));
+    sum += std::stoi(value);
+  }
+  std::cout << "Sum: " << sum << std::endl;
+  assert(sum == kNumCounters * kInitial);
+  delete db;
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include <crocks/status.h>
 #include "src/client/node.h"
 #include "src/common/info.h"
+#include "src/common/routing_hint.h"
 #include "src/common/util.h"
 
 int main() {
@@ -40,7 +41,13 @@ int main() {
   std::cout << "Sending key intended for node 0 to node 1" << std::endl;
   std::string address = info.Addresses()[1];
   crocks::Node* db = new crocks::Node(address);
-  EnsureRpc(db->Put(key, "test"));
+  crocks::RoutingHint hint;
+  crocks::Status status = db->Put(key, "test", &hint);
+  if (hint.valid())
+    std::cout << "Node 1 says that the master is node " << hint.master
+              << " at " << hint.address << " (revision " << hint.revision
+              << ")" << std::endl;
+  EnsureRpc(status);
 
   delete db;
 
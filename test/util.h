@@ -15,6 +15,7 @@
 // You should have received a copy of the GNU General Public License
 // along with crocks.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -28,7 +29,9 @@
 const int kKeySize = 16;
 const int kBlobSize = 1024 * 1024;
 
-enum WriteMode { RANDOM, SEQUENTIAL };
+// SKEWED picks key x of num_keys with probability density proportional
+// to x^(-3/4), so that e.g. a third of the picks fall on the first 1%.
+enum WriteMode { RANDOM, SEQUENTIAL, SKEWED };
 
 // Based on rocksdb::Benchmark::KeyGenerator
 // defined in rocksdb/util/db_bench_tool.cc
@@ -49,6 +52,9 @@ class Generator {
       case RANDOM:
         sprintf(key, "%015d", rand() % num_keys_);
         break;
+      case SKEWED:
+        sprintf(key, "%015d", static_cast<int>(num_keys_ * pow(Uniform(), 4)));
+        break;
     }
     return std::string(key);
   }
@@ -60,6 +66,11 @@ class Generator {
   }
 
  private:
+  // Uniformly distributed in [0, 1)
+  double Uniform() {
+    return rand() / (RAND_MAX + 1.0);
+  }
+
   char blob_[kBlobSize];
   WriteMode mode_;
   int num_keys_;